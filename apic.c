@@ -0,0 +1,262 @@
+#include "apic.h"
+#include "paging.h"
+#include "i8259.h"
+
+static volatile uint32_t* apic_regs; /* Register page, NULL until apic_init() succeeds */
+static uint32_t apic_khz; /* Timer counts per millisecond, measured against the PIT */
+static uint32_t use_tsc_deadline; /* Set when the timer fires on a TSC value instead of a count */
+
+static void apic_set_oneshot(uint32_t count);
+static void apic_arm_before(uint32_t count);
+static void apic_stop(void);
+static uint32_t apic_is_armed(void);
+
+/* Jump table for the APIC timer as the scheduling clock */
+tick_jump_table_t apic_tick_jmptable = {
+    .set_oneshot = apic_set_oneshot,
+    .arm_before = apic_arm_before,
+    .stop = apic_stop,
+    .is_armed = apic_is_armed
+};
+
+/* uint32_t apic_read()
+ * Description: Reads an APIC register.
+ * Inputs: uint32_t reg (Offset from the APIC base)
+ * Output: None
+ * Returned Value: Register value
+ * Side Effects: None
+ */
+static uint32_t apic_read(uint32_t reg) {
+    return apic_regs[reg / sizeof(uint32_t)];
+}
+
+/* void apic_write()
+ * Description: Writes an APIC register.
+ * Inputs: uint32_t reg (Offset from the APIC base), uint32_t val
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Depends on the register.
+ */
+static void apic_write(uint32_t reg, uint32_t val) {
+    apic_regs[reg / sizeof(uint32_t)] = val;
+}
+
+/* int32_t apic_init()
+ * Description: Enables the local APIC and calibrates its timer against the PIT. The timer then
+ *              replaces the PIT as the scheduling clock, in TSC-deadline mode when the processor
+ *              has it and in one-shot mode otherwise. Without an APIC the PIT stays in use.
+ * Inputs: None
+ * Output: None
+ * Returned Value: 0 upon success, -1 when the PIT has to stay the clock
+ * Side Effects: Busy-waits PIT_CALIBRATE_MS. Masks the PIT IRQ on success.
+ */
+int32_t apic_init() {
+    uint32_t regs[4]; /* cpuid output: eax, ebx, ecx, edx */
+    uint64_t base; /* IA32_APIC_BASE */
+    uint32_t phys; /* Physical address of the registers */
+    cpuid(1, regs);
+    if (!(regs[3] & CPUID_EDX_APIC)) {
+        return -1;
+    }
+    base = rdmsr(IA32_APIC_BASE);
+    phys = (uint32_t)base & APIC_BASE_MASK;
+    if ((phys >> DIR_OFFSET) != (MMIO_MEM_ADD >> DIR_OFFSET)) { /* Relocated out of the mapped page */
+        return -1;
+    }
+    wrmsr(IA32_APIC_BASE, base | APIC_BASE_ENABLE);
+    apic_regs = (volatile uint32_t*)phys; /* Identity-mapped by init_paging() */
+    apic_write(APIC_TPR, 0); /* Accept every vector */
+    apic_write(APIC_SVR, APIC_SVR_ENABLE | SPURIOUS_INDEX);
+
+    /* Count down from the top for PIT_CALIBRATE_MS, with the interrupt masked */
+    apic_write(APIC_TIMER_DCR, APIC_DIVIDE_16);
+    apic_write(APIC_LVT_TIMER, APIC_LVT_MASKED | APIC_TIMER_INDEX);
+    apic_write(APIC_TIMER_ICR, APIC_MAX_COUNT);
+    pit_busy_wait(PIT_CALIBRATE_COUNT);
+    apic_khz = (APIC_MAX_COUNT - apic_read(APIC_TIMER_CCR)) / PIT_CALIBRATE_MS;
+    apic_write(APIC_TIMER_ICR, 0); /* A count of 0 stops the timer */
+    if (apic_khz == 0) {
+        return -1;
+    }
+
+    use_tsc_deadline = (regs[2] & CPUID_ECX_TSC_DEADLINE) && tsc_khz;
+    apic_write(APIC_LVT_TIMER, (use_tsc_deadline ? APIC_TIMER_TSC_DEADLINE : APIC_TIMER_ONESHOT) | APIC_TIMER_INDEX);
+    pit_stop();
+    disable_irq(PIT_IRQ);
+    tick_device = &apic_tick_jmptable;
+    return 0;
+}
+
+/* void apic_ap_init()
+ * Description: Enables the local APIC of an application processor. Every local APIC runs on
+ *              the same bus clock, so the timer reuses the boot processor's calibration.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called on the application processor, after apic_init() on the boot one.
+ */
+void apic_ap_init() {
+    wrmsr(IA32_APIC_BASE, rdmsr(IA32_APIC_BASE) | APIC_BASE_ENABLE);
+    apic_write(APIC_TPR, 0);
+    apic_write(APIC_SVR, APIC_SVR_ENABLE | SPURIOUS_INDEX);
+    apic_write(APIC_TIMER_DCR, APIC_DIVIDE_16);
+    apic_write(APIC_LVT_TIMER, (use_tsc_deadline ? APIC_TIMER_TSC_DEADLINE : APIC_TIMER_ONESHOT) | APIC_TIMER_INDEX);
+}
+
+/* void apic_send_ipi()
+ * Description: Sends an inter-processor interrupt to one processor and waits until the APIC
+ *              has accepted it.
+ * Inputs: uint32_t dest_apic_id (Target's local APIC id),
+ *         uint32_t command (Delivery mode, level and vector bits of the ICR)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Interrupts, starts or resets the target.
+ */
+void apic_send_ipi(uint32_t dest_apic_id, uint32_t command) {
+    apic_write(APIC_ICR_HIGH, dest_apic_id << APIC_ID_SHIFT);
+    apic_write(APIC_ICR_LOW, command);
+    while (apic_read(APIC_ICR_LOW) & APIC_DELIVERY_PENDING) {
+        pause();
+    }
+}
+
+/* void apic_send_ipi_others()
+ * Description: Sends a fixed interrupt to every processor but this one.
+ * Inputs: uint32_t vector (Interrupt vector)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Interrupts the other processors.
+ */
+void apic_send_ipi_others(uint32_t vector) {
+    apic_write(APIC_ICR_LOW, APIC_DEST_OTHERS | APIC_DM_FIXED | vector);
+    while (apic_read(APIC_ICR_LOW) & APIC_DELIVERY_PENDING) {
+        pause();
+    }
+}
+
+/* uint32_t apic_id()
+ * Description: Reads the local APIC id, which IOAPIC redirection entries use as destination.
+ * Inputs: None
+ * Output: None
+ * Returned Value: APIC id
+ * Side Effects: None
+ */
+uint32_t apic_id() {
+    return apic_read(APIC_ID) >> APIC_ID_SHIFT;
+}
+
+/* void apic_eoi()
+ * Description: Acknowledges the interrupt being handled, with one register write.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Lets the APIC deliver interrupts of the same or lower priority again.
+ */
+void apic_eoi() {
+    apic_write(APIC_EOI, 0);
+}
+
+/* void apic_set_oneshot()
+ * Description: Asks for one timer interrupt after the given delay, replacing any that is pending.
+ * Inputs: uint32_t count (Delay in PIT input cycles)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Restarts the APIC timer.
+ */
+static void apic_set_oneshot(uint32_t count) {
+    uint64_t ticks; /* APIC timer counts, in one-shot mode */
+    cpu_t* cpu; /* The timer is this processor's own */
+    if (count == 0) {
+        count = 1;
+    }
+    cpu = this_cpu();
+    cpu -> tick_armed = 1;
+    cpu -> tick_deadline = rdtsc() + div_u64_u32((uint64_t)count * tsc_khz, PIT_COUNTS_PER_MS);
+    if (use_tsc_deadline) {
+        wrmsr(IA32_TSC_DEADLINE, cpu -> tick_deadline);
+        return;
+    }
+    ticks = div_u64_u32((uint64_t)count * apic_khz, PIT_COUNTS_PER_MS);
+    if (ticks == 0) {
+        ticks = 1;
+    }
+    if (ticks > APIC_MAX_COUNT) {
+        ticks = APIC_MAX_COUNT;
+    }
+    apic_write(APIC_TIMER_ICR, (uint32_t)ticks);
+}
+
+/* void apic_arm_before()
+ * Description: Makes sure a timer interrupt comes within the given delay, keeping a pending one
+ *              that comes sooner.
+ * Inputs: uint32_t count (Delay in PIT input cycles)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: May restart the APIC timer. Called with interrupts off.
+ */
+static void apic_arm_before(uint32_t count) {
+    uint64_t deadline; /* TSC when the new interrupt would come */
+    cpu_t* cpu; /* The timer is this processor's own */
+    cpu = this_cpu();
+    deadline = rdtsc() + div_u64_u32((uint64_t)count * tsc_khz, PIT_COUNTS_PER_MS);
+    if (!cpu -> tick_armed || deadline < cpu -> tick_deadline) {
+        apic_set_oneshot(count);
+    }
+}
+
+/* void apic_stop()
+ * Description: Cancels the pending timer interrupt, if any.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+static void apic_stop() {
+    this_cpu() -> tick_armed = 0;
+    if (use_tsc_deadline) {
+        wrmsr(IA32_TSC_DEADLINE, 0); /* A deadline of 0 disarms the timer */
+    } else {
+        apic_write(APIC_TIMER_ICR, 0);
+    }
+}
+
+/* uint32_t apic_is_armed()
+ * Description: Tells whether a timer interrupt is pending.
+ * Inputs: None
+ * Output: None
+ * Returned Value: 1 if a one-shot is pending, 0 otherwise
+ * Side Effects: None
+ */
+static uint32_t apic_is_armed() {
+    return this_cpu() -> tick_armed;
+}
+
+/* void apic_timer_handler()
+ * Description: Runs the expired kernel timers and lets the scheduler switch tasks. The EOI is
+ *              a register write instead of the PIT's port I/O to the 8259.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: May switch tasks. Takes the big kernel lock.
+ */
+void apic_timer_handler() {
+    uint32_t prev_mode; /* Accounting mode of the interrupted task */
+    lock_kernel();
+    prev_mode = account_mode(ACCT_IRQ);
+    apic_eoi(); /* Acknowledge first, scheduler() may not return to this task for a while */
+    this_cpu() -> tick_armed = 0; /* One-shot: nothing more comes until the scheduler asks again */
+    irq_call(run_timers); /* Timer callbacks run on the interrupt stack, the switch on the task's */
+    account_mode(prev_mode); /* The switch itself is charged as the task's own time */
+    scheduler();
+    unlock_kernel();
+}
+
+/* void apic_spurious_handler()
+ * Description: Ignores a spurious interrupt. The APIC expects no EOI for it.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+void apic_spurious_handler() {
+}
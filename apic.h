@@ -0,0 +1,64 @@
+/*
+ * Header File for the Local APIC and its Timer
+ */
+
+#ifndef _APIC_H
+#define _APIC_H
+
+#include "types.h"
+#include "lib.h"
+#include "pit.h"
+#include "idt.h" /* Vectors */
+#include "smp.h" /* Per-processor timer state */
+
+#define IA32_APIC_BASE 0x1B /* MSR holding the APIC base address and enable bit */
+#define IA32_TSC_DEADLINE 0x6E0 /* MSR the timer compares the TSC against in deadline mode */
+#define APIC_BASE_ENABLE 0x800 /* Global enable bit of IA32_APIC_BASE */
+#define APIC_BASE_MASK 0xFFFFF000 /* Physical address bits of IA32_APIC_BASE */
+#define CPUID_EDX_APIC 0x200 /* Leaf 1: on-chip APIC */
+#define CPUID_ECX_TSC_DEADLINE 0x1000000 /* Leaf 1: timer supports TSC-deadline mode */
+
+/* Register offsets from the APIC base */
+#define APIC_ID 0x20 /* Local APIC id, in the top byte */
+#define APIC_TPR 0x80 /* Task priority */
+#define APIC_EOI 0xB0 /* End of interrupt */
+#define APIC_SVR 0xF0 /* Spurious interrupt vector */
+#define APIC_LVT_TIMER 0x320 /* Timer local vector table entry */
+#define APIC_ICR_LOW 0x300 /* Interrupt command, vector and delivery mode; writing it sends */
+#define APIC_ICR_HIGH 0x310 /* Interrupt command, destination in the top byte */
+#define APIC_TIMER_ICR 0x380 /* Timer initial count */
+#define APIC_TIMER_CCR 0x390 /* Timer current count */
+#define APIC_TIMER_DCR 0x3E0 /* Timer divide configuration */
+
+#define APIC_ID_SHIFT 24 /* Bits the id is shifted by in APIC_ID */
+#define APIC_SVR_ENABLE 0x100 /* Software enable bit of the SVR */
+#define APIC_LVT_MASKED 0x10000 /* Masks a local vector table entry */
+#define APIC_TIMER_ONESHOT 0x00000 /* Timer mode bits of the LVT entry */
+#define APIC_TIMER_TSC_DEADLINE 0x40000
+#define APIC_DM_FIXED 0x000 /* Delivery modes of an IPI */
+#define APIC_DM_INIT 0x500
+#define APIC_DM_STARTUP 0x600
+#define APIC_LEVEL_ASSERT 0x4000 /* Level bit, required for INIT and STARTUP */
+#define APIC_DELIVERY_PENDING 0x1000 /* ICR bit set until the IPI has been sent */
+#define APIC_DEST_OTHERS 0xC0000 /* Shorthand: every processor but this one */
+#define APIC_DIVIDE_16 0x3 /* Timer counts the bus clock divided by 16 */
+#define APIC_MAX_COUNT 0xFFFFFFFF /* Longest one-shot count */
+
+extern tick_jump_table_t apic_tick_jmptable;
+
+/* Enables the local APIC and makes its timer the scheduling clock */
+extern int32_t apic_init(void);
+/* Enables the local APIC of an application processor, timer set up like the boot one */
+extern void apic_ap_init(void);
+/* Sends an inter-processor interrupt */
+extern void apic_send_ipi(uint32_t dest_apic_id, uint32_t command);
+extern void apic_send_ipi_others(uint32_t vector);
+/* Id other interrupt sources use to target this processor */
+extern uint32_t apic_id(void);
+/* Acknowledges an interrupt delivered by the APIC */
+extern void apic_eoi(void);
+/* Interrupt handlers */
+extern void apic_timer_handler(void);
+extern void apic_spurious_handler(void);
+
+#endif
@@ -0,0 +1,14 @@
+/*
+ * Wrapper file for exceptions that return to the faulting code
+ */
+#ifndef _EXCEPTION_WRAPPER_H_
+#define _EXCEPTION_WRAPPER_H_
+
+#include "types.h"
+
+#ifndef ASM
+    extern void page_fault_wrapper();
+    extern void device_not_available_wrapper();
+    void page_fault_handler(uint32_t fault_addr, uint32_t error_code);
+#endif
+#endif
@@ -0,0 +1,94 @@
+#include "fpu.h"
+#include "smp.h"
+#include "scheduler.h"
+#include "syscall.h"
+
+/* Lazy FPU/SSE switching. CR0.TS is set whenever the registers don't belong to the running
+ * task, so its first FPU or SSE instruction raises #NM, and only then are its registers loaded.
+ * A task that never touches them costs nothing at switch time. A task that did is saved when
+ * it is switched away from, so its state is never left in another processor's registers if it
+ * migrates. Invariant: TS is clear on a processor exactly when cpu -> fpu_owner is set, and
+ * then the owner is the running task. */
+static uint32_t fpu_usable; /* Set when the processors have fxsave and SSE */
+
+/* void fpu_init()
+ * Description: Turns on SSE and fxsave for the calling processor and sets TS. Without them the
+ *              processor keeps EM set, so an FPU instruction still kills the program.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Writes cr0 and cr4. Called once on each processor while it boots.
+ */
+void fpu_init() {
+    uint32_t regs[4]; /* cpuid leaf 1: eax, ebx, ecx, edx */
+    uint32_t cr0; /* Control register 0 */
+    uint32_t cr4; /* Control register 4 */
+    cpuid(1, regs);
+    asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+    if ((regs[3] & (CPUID_EDX_FXSR | CPUID_EDX_SSE)) == (CPUID_EDX_FXSR | CPUID_EDX_SSE)) {
+        asm volatile ("movl %%cr4, %0" : "=r"(cr4));
+        asm volatile ("movl %0, %%cr4" : : "r"(cr4 | CR4_OSFXSR | CR4_OSXMMEXCPT));
+        cr0 = (cr0 & ~CR0_EM) | CR0_MP | CR0_NE;
+        fpu_usable = 1;
+    } else {
+        cr0 |= CR0_EM;
+    }
+    asm volatile ("movl %0, %%cr0" : : "r"(cr0 | CR0_TS) : "memory");
+    this_cpu() -> fpu_owner = NULL;
+}
+
+/* void fpu_switch_out()
+ * Description: Called on every task switch. If the task giving up the processor loaded the
+ *              FPU/SSE registers during its slice, saves them to its pcb and sets TS again.
+ * Inputs: pcb_t* prev_pcb (Task switched away from)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off.
+ */
+void fpu_switch_out(pcb_t* prev_pcb) {
+    cpu_t* cpu; /* This processor */
+    cpu = this_cpu();
+    if (cpu -> fpu_owner != prev_pcb) {
+        return; /* TS is still set, nothing was loaded */
+    }
+    if (prev_pcb -> state != TASK_DEAD && prev_pcb -> state != TASK_ZOMBIE) { /* Nobody reads an exited task's */
+        asm volatile ("fxsave %0" : "=m"(prev_pcb -> fpu_state));
+    }
+    cpu -> fpu_owner = NULL;
+    stts();
+}
+
+/* void device_not_available_handler()
+ * Description: Handles #NM, raised by the first FPU/SSE instruction a task runs with TS set.
+ *              Loads the task's saved registers, or a clean state on its first use, and lets
+ *              the instruction run again. The registers are always saved at switch time, so
+ *              there is never another owner to evict here.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Clears TS. Kills the program when the processor has no usable FPU. Runs
+ *               without the kernel lock: it only touches this processor and the running task.
+ */
+void device_not_available_handler() {
+    cpu_t* cpu; /* This processor */
+    pcb_t* cur_pcb; /* Task that trapped */
+    uint32_t mxcsr; /* Initial SIMD control/status */
+    cur_pcb = current_task();
+    if (!fpu_usable || cur_pcb == NULL) { /* No FPU, or the kernel used it while booting */
+        lock_kernel();
+        printf("Device Not Available Exception!\n");
+        halt_flag = 1;
+        halt(0);
+    }
+    cpu = this_cpu();
+    clts();
+    if (cur_pcb -> used_math) {
+        asm volatile ("fxrstor %0" : : "m"(cur_pcb -> fpu_state));
+    } else { /* First use: start from the power-on state */
+        mxcsr = MXCSR_DEFAULT;
+        asm volatile ("fninit");
+        asm volatile ("ldmxcsr %0" : : "m"(mxcsr));
+        cur_pcb -> used_math = 1;
+    }
+    cpu -> fpu_owner = cur_pcb;
+}
@@ -0,0 +1,40 @@
+/*
+ * Header File for Lazy FPU/SSE State Switching
+ */
+
+#ifndef _FPU_H
+#define _FPU_H
+
+#include "types.h"
+#include "lib.h"
+
+#define CPUID_EDX_FXSR 0x1000000 /* Leaf 1: fxsave and fxrstor */
+#define CPUID_EDX_SSE 0x2000000 /* Leaf 1: SSE */
+#define CR0_MP 0x2 /* wait/fwait trap on TS too */
+#define CR0_EM 0x4 /* No FPU: every x87 instruction raises #NM */
+#define CR0_TS 0x8 /* Task switched: the next FPU/SSE instruction raises #NM */
+#define CR0_NE 0x20 /* Report x87 errors as exception 16, not through the PIC */
+#define CR4_OSFXSR 0x200 /* The kernel saves SSE state with fxsave, SSE instructions allowed */
+#define CR4_OSXMMEXCPT 0x400 /* Unmasked SIMD errors raise exception 19 */
+#define MXCSR_DEFAULT 0x1F80 /* All SIMD exceptions masked, round to nearest */
+
+/* Sets up the FPU and SSE of the calling processor */
+extern void fpu_init(void);
+/* Saves the FPU/SSE registers of a task switched away from, if it used them */
+extern void fpu_switch_out(pcb_t* prev_pcb);
+/* #NM: gives the FPU/SSE registers to the running task */
+extern void device_not_available_handler(void);
+
+/* Sets CR0.TS, so the next FPU/SSE instruction traps */
+static inline void stts(void) {
+    uint32_t cr0;
+    asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+    asm volatile ("movl %0, %%cr0" : : "r"(cr0 | CR0_TS) : "memory");
+}
+
+/* Clears CR0.TS, so FPU/SSE instructions run */
+static inline void clts(void) {
+    asm volatile ("clts" : : : "memory");
+}
+
+#endif
@@ -5,102 +5,178 @@
 
 /* Following functions provide a unification of driver calls. Used for syscall */ 
 
+/* Chunks lent to tasks whose table grows past the first 8 descriptors.
+ * A zeroed idmap is an empty map, so no initialization is needed. */
+static file_arr_struct_t fd_chunk_pool[FD_CHUNK_POOL_SIZE][FD_CHUNK_SIZE];
+static idmap_t fd_chunk_map;
+static spinlock_t fd_chunk_lock = SPIN_LOCK_UNLOCKED("fd chunks"); /* fd_chunk_map, shared by every task */
+
+/* file_arr_struct_t* fs_abs_get()
+ * Description: A function to look up an open descriptor in a table.
+ * Inputs: fd_table_t* file_table, int32_t id (Referenced table and descriptor ID)
+ * Output: None
+ * Returned Value: Pointer to the descriptor, or NULL if id is not open
+ * Side Effects: None
+ */
+ file_arr_struct_t* fs_abs_get(fd_table_t* file_table, int32_t id) {
+   if (file_table == NULL || id < 0 || id >= MAX_OPENED_FILES) { /* Reject ids the bitmap can't hold */
+     return NULL;
+   }
+   if (!idmap_test(&file_table->open_map, id)) { /* Descriptor not in use */
+     return NULL;
+   }
+   return &file_table->chunks[id / FD_CHUNK_SIZE][id % FD_CHUNK_SIZE];
+ }
+
+/* int32_t fs_abs_alloc()
+ * Description: A function to take the lowest free descriptor, growing the table by a chunk if needed.
+ * Inputs: fd_table_t* file_table (Referenced table)
+ * Output: Updated bitmap and chunk list
+ * Returned Value: Integer - descriptor ID or Failure
+ * Side Effects: May take a chunk from the shared pool.
+ */
+ static int32_t fs_abs_alloc(fd_table_t* file_table) {
+   int32_t id; /* Lowest free descriptor */
+   int32_t chunk_idx; /* Index of the pool chunk backing it */
+   id = idmap_alloc(&file_table->open_map); /* Find first zero bit */
+   if (id < 0) { /* Table is at its maximum size */
+     return FS_ABSTRACTION_FAILURE;
+   }
+   if (file_table->chunks[id / FD_CHUNK_SIZE] == NULL) { /* First descriptor in a new chunk */
+     spin_lock(&fd_chunk_lock);
+     chunk_idx = idmap_alloc(&fd_chunk_map);
+     spin_unlock(&fd_chunk_lock);
+     if (chunk_idx < 0) { /* Pool exhausted */
+       idmap_free(&file_table->open_map, id);
+       return FS_ABSTRACTION_FAILURE;
+     }
+     memset(fd_chunk_pool[chunk_idx], 0, sizeof(fd_chunk_pool[chunk_idx]));
+     file_table->chunks[id / FD_CHUNK_SIZE] = fd_chunk_pool[chunk_idx];
+   }
+   return id;
+ }
+
 /* int32_t fs_abs_init()
- * Description: A function to initialize the file descriptor array.
- * Inputs: file_arr_struct_t* file_array (pointer to an uninitialized file array)
- * Output: Updated file des. array; returned flag to signify success/failure
+ * Description: A function to initialize the file descriptor table.
+ * Inputs: fd_table_t* file_table (pointer to an uninitialized file table)
+ * Output: Updated file des. table; returned flag to signify success/failure
  * Returned Value: Integer - Success or Failure
- * Side Effects: Changes the input array.
+ * Side Effects: Changes the input table. Descriptors 0 and 1 are bound to the terminal.
  */
- int32_t fs_abs_init(file_arr_struct_t* file_array) {
+ int32_t fs_abs_init(fd_table_t* file_table) {
    int loop_idx; /* Loop index to initialize entries */
-   if (file_array != NULL) { /* Ensure input pointer is valid */
-     loop_idx = 0; /* Start at descriptor 0 */
-     while (loop_idx < MAX_OPENED_FILES) { /* Iterate thru entries */
-       if (loop_idx == STDIN_IDX) { /* Deal with stdin */
-         file_array[loop_idx].jmp_table = &terminal_stdin_jmptable; /* Initialize jmp table*/
-       } else if (loop_idx == STDOUT_IDX) { /* Deal with stdout */
-         file_array[loop_idx].jmp_table = &terminal_stdout_jmptable; /* Initialize jmp table */
-       } else { /* Initialize jump table to null for other entries */
-         file_array[loop_idx].jmp_table = NULL;
-       }
-       /* Initialize other elements in structure to default zero */
-       file_array[loop_idx].inode = 0;
-       file_array[loop_idx].file_position = 0;
-       file_array[loop_idx].flags = 0;
-       loop_idx++; /* Move to next entry */
+   if (file_table != NULL) { /* Ensure input pointer is valid */
+     idmap_init(&file_table->open_map, MAX_OPENED_FILES);
+     for (loop_idx = 0; loop_idx < FD_MAX_CHUNKS; loop_idx++) {
+       file_table->chunks[loop_idx] = NULL; /* Later chunks come from the pool on demand */
      }
+     file_table->chunks[0] = file_table->first_chunk;
+     memset(file_table->first_chunk, 0, sizeof(file_table->first_chunk));
+     /* stdin and stdout are always open; terminal close fails so they stay put */
+     file_table->first_chunk[STDIN_IDX].jmp_table = &terminal_stdin_jmptable;
+     file_table->first_chunk[STDOUT_IDX].jmp_table = &terminal_stdout_jmptable;
+     idmap_set(&file_table->open_map, STDIN_IDX);
+     idmap_set(&file_table->open_map, STDOUT_IDX);
      return FS_ABSTRACTION_SUCCESS; /* Always succeed upon valid input pointer */
    }
    return FS_ABSTRACTION_FAILURE; /* Fails upon invalid pointer */
  }
 
+ /* void fs_abs_destroy()
+  * Description: A function to close every descriptor and return grown chunks to the pool.
+  * Inputs: fd_table_t* file_table (Referenced table)
+  * Output: None
+  * Returned Value: None
+  * Side Effects: Closes files; the table must be re-initialized before reuse.
+  */
+  void fs_abs_destroy(fd_table_t* file_table) {
+    int32_t id; /* Descriptor being closed */
+    int32_t chunk; /* Chunk being returned */
+    for (id = 0; id < MAX_OPENED_FILES; id++) {
+      if (file_table->chunks[id / FD_CHUNK_SIZE] == NULL) { /* Skip chunks never grown */
+        id += FD_CHUNK_SIZE - 1;
+        continue;
+      }
+      fs_abs_close(file_table, id);
+    }
+    for (chunk = 1; chunk < FD_MAX_CHUNKS; chunk++) { /* Chunk 0 lives in the table itself */
+      if (file_table->chunks[chunk] != NULL) {
+        spin_lock(&fd_chunk_lock);
+        idmap_free(&fd_chunk_map, (file_table->chunks[chunk] - fd_chunk_pool[0]) / FD_CHUNK_SIZE);
+        spin_unlock(&fd_chunk_lock);
+        file_table->chunks[chunk] = NULL;
+      }
+    }
+  }
+
  /* int32_t fs_abs_open()
   * Description: A function to open file (by specific driver) and modify array.
-  * Inputs: file_arr_struct_t* file_array, const char* filename
-  * Output: Updated file des. array, or returned flag to signify failure
-  * Returned Value: Integer - index in the array or Failure
-  * Side Effects: Changes the input array.
+  * Inputs: fd_table_t* file_table, const char* filename
+  * Output: Updated file des. table, or returned flag to signify failure
+  * Returned Value: Integer - descriptor ID in the table or Failure
+  * Side Effects: Changes the input table, growing it by a chunk if it is full.
   */
-  int32_t fs_abs_open(file_arr_struct_t* file_array, const char* filename) {
-      int cur_idx; /* Allocated index for opened file in array */
+  int32_t fs_abs_open(fd_table_t* file_table, const char* filename) {
+      int cur_idx; /* Allocated descriptor ID for opened file */
+      file_arr_struct_t* file_array; /* Allocated descriptor entry */
       dentry_t dir_entry; /* Referenced directory entry */
       uint32_t cur_file_type; /* Current file type */
       if (filename[0] == '\0') {
         return FS_ABSTRACTION_FAILURE;
       }
-      for (cur_idx = 0; ; cur_idx++) { /* Start at first entry, iterate through */
-        if (cur_idx >= MAX_OPENED_FILES) { /* Index out of bounds (no seats in array) */
-          return FS_ABSTRACTION_FAILURE; /* Failure */
-        }
-        if (file_array[cur_idx].jmp_table == NULL) { /* Empty spot found */
-          break; /* Take current index and stop iteration */
-        }
+      cur_idx = fs_abs_alloc(file_table); /* Lowest free descriptor via find-first-zero */
+      if (cur_idx == FS_ABSTRACTION_FAILURE) { /* No seats left in table */
+        return FS_ABSTRACTION_FAILURE; /* Failure */
       }
+      file_array = &file_table->chunks[cur_idx / FD_CHUNK_SIZE][cur_idx % FD_CHUNK_SIZE];
       if (strncmp("stdin", filename, STRLEN_STDIN + 1) == 0) {
-        file_array[cur_idx].jmp_table = &terminal_stdin_jmptable; /* Open stdin */
+        file_array->jmp_table = &terminal_stdin_jmptable; /* Open stdin */
       } else if (strncmp("stdout", filename, STRLEN_STDOUT + 1) == 0) {
-        file_array[cur_idx].jmp_table = &terminal_stdout_jmptable; /* Open stdout */
+        file_array->jmp_table = &terminal_stdout_jmptable; /* Open stdout */
       } else if (read_dentry_by_name((char*)filename, &dir_entry) == FS_SUCCESS) { /* Try to read file info*/
         cur_file_type = dir_entry.file_type; /* Get type of current file */
         if (cur_file_type == RTC_TYPE_FILE) {
-          file_array[cur_idx].jmp_table = &rtc_jmptable; /* Open rtc file */
+          file_array->jmp_table = &rtc_jmptable; /* Open rtc file */
         } else if (cur_file_type == FOLDER_TYPE_FILE) {
-          file_array[cur_idx].jmp_table = &fs_dir_jmptable; /* Open a directory */
+          file_array->jmp_table = &fs_dir_jmptable; /* Open a directory */
         } else if (cur_file_type == DEFAULT_TYPE_FILE) {
-          file_array[cur_idx].jmp_table = &fs_file_jmptable; /* Open regular file */
+          file_array->jmp_table = &fs_file_jmptable; /* Open regular file */
         } else {
+          idmap_free(&file_table->open_map, cur_idx);
           return FS_ABSTRACTION_FAILURE; /* Invalid filetype */
         }
       } else {
+        idmap_free(&file_table->open_map, cur_idx);
         return FS_ABSTRACTION_FAILURE; /* No such file exists / file is invalid */
       }
       /* Prereq 1 : the jump table has a valid "open" function pointer */
-      if (file_array[cur_idx].jmp_table -> open != NULL) {
+      if (file_array->jmp_table -> open != NULL) {
         /* Prereq 2: "open" task opens the file correctly */
-        if ((*file_array[cur_idx].jmp_table -> open)(&file_array[cur_idx].inode, (char*)filename) != FS_ABSTRACTION_FAILURE) {
-          file_array[cur_idx].file_position = 0; /* Start at the starting point of file */
+        if ((*file_array->jmp_table -> open)(&file_array->inode, (char*)filename) != FS_ABSTRACTION_FAILURE) {
+          file_array->file_position = 0; /* Start at the starting point of file */
           return cur_idx; /* Return index that held current descriptor */
         }
       }
+      file_array->jmp_table = NULL;
+      idmap_free(&file_table->open_map, cur_idx); /* Give the descriptor back */
       return FS_ABSTRACTION_FAILURE; /* Prereqs not all met. Return failure */
  }
 
  /* int32_t fs_abs_close()
-  * Description: A function to close file (by specific driver) and modify array
-  * Inputs: file_arr_struct_t* file_array, int32_t id (Referenced array and descriptor ID)
-  * Output: Updated file des. array, or returned flag to signify failure
-  * Returned Value: Integer - index in the array or Failure
-  * Side Effects: Changes the input array.
+  * Description: A function to close file (by specific driver) and modify table
+  * Inputs: fd_table_t* file_table, int32_t id (Referenced table and descriptor ID)
+  * Output: Updated file des. table, or returned flag to signify failure
+  * Returned Value: Integer - Success or Failure
+  * Side Effects: Changes the input table; the descriptor becomes free for reuse.
   */
-  int32_t fs_abs_close(file_arr_struct_t* file_array, int32_t id) {
-    if (id >= 0 && id < MAX_OPENED_FILES) { /* Prereq 1 : the id should be a valid index in array */
-      if (file_array[id].jmp_table != NULL) { /* Prereq 2: the file has to be opened */
-        if (file_array[id].jmp_table -> close != NULL) { /* Prereq 3: current jump table has a valid close func. pointer */
-          if ((*file_array[id].jmp_table->close) (&file_array[id].inode) != FS_ABSTRACTION_FAILURE) { /* Prereq 4: Func works */
-            file_array[id].jmp_table = NULL; /* Close the file by clearing jump table */
-            return FS_ABSTRACTION_SUCCESS; /* Always succeed when prereqs met */
-          }
+  int32_t fs_abs_close(fd_table_t* file_table, int32_t id) {
+    file_arr_struct_t* file_array = fs_abs_get(file_table, id); /* Prereq 1 : the file has to be opened */
+    if (file_array != NULL && file_array->jmp_table != NULL) {
+      if (file_array->jmp_table -> close != NULL) { /* Prereq 2: current jump table has a valid close func. pointer */
+        if ((*file_array->jmp_table->close) (&file_array->inode) != FS_ABSTRACTION_FAILURE) { /* Prereq 3: Func works */
+          file_array->jmp_table = NULL; /* Close the file by clearing jump table */
+          idmap_free(&file_table->open_map, id); /* Descriptor is free again */
+          return FS_ABSTRACTION_SUCCESS; /* Always succeed when prereqs met */
         }
       }
     }
@@ -108,38 +184,36 @@
   }
 
   /* int32_t fs_abs_read()
-   * Description: A function to read file (by specific driver) and modify array
-   * Inputs: file_arr_struct_t* file_array, int32_t id, void* buf, int32_t len(Referenced array, descriptor ID, buf, length)
+   * Description: A function to read file (by specific driver) and modify table
+   * Inputs: fd_table_t* file_table, int32_t id, void* buf, int32_t len(Referenced table, descriptor ID, buf, length)
    * Output: Updated buf and pos in desc.structure, or returned flag to signify failure
    * Returned Value: Integer - # bytes read or Failure
-   * Side Effects: Changes the input array and the buf.
+   * Side Effects: Changes the input table and the buf.
    */
-  int32_t fs_abs_read(file_arr_struct_t* file_array, int32_t id, void* buf, int32_t len) {
-    if (id >= 0 && id < MAX_OPENED_FILES) { /* Prereq 1 : the id should be a valid index in array */
-      if (file_array[id].jmp_table != NULL) { /* Prereq 2: the file has to be opened */
-        if (file_array[id].jmp_table -> read != NULL) { /* Prereq 3: current jump table has a valid read func. pointer */
-          /* Call appropriate task to perform reading ( might fail in this case) */
-           return (*file_array[id].jmp_table -> read) (&file_array[id].inode, &file_array[id].file_position, (char*) buf, len);
-        }
+  int32_t fs_abs_read(fd_table_t* file_table, int32_t id, void* buf, int32_t len) {
+    file_arr_struct_t* file_array = fs_abs_get(file_table, id); /* Prereq 1 : the file has to be opened */
+    if (file_array != NULL && file_array->jmp_table != NULL) {
+      if (file_array->jmp_table -> read != NULL) { /* Prereq 2: current jump table has a valid read func. pointer */
+        /* Call appropriate task to perform reading ( might fail in this case) */
+         return (*file_array->jmp_table -> read) (&file_array->inode, &file_array->file_position, (char*) buf, len);
       }
     }
     return FS_ABSTRACTION_FAILURE; /* Fails when prereqs not fully met */
   }
 
   /* int32_t fs_abs_write()
-   * Description: A function to write to file (by specific driver) and modify array
-   * Inputs: file_arr_struct_t* file_array, int32_t id, const void* buf, int32_t len(Referenced array, descriptor ID, buf, length)
+   * Description: A function to write to file (by specific driver) and modify table
+   * Inputs: fd_table_t* file_table, int32_t id, const void* buf, int32_t len(Referenced table, descriptor ID, buf, length)
    * Output: Updated buf and pos in desc.structure, or returned flag to signify failure
    * Returned Value: Integer - # bytes read or Failure
-   * Side Effects: Changes the input array and the buf.
+   * Side Effects: Changes the input table and the buf.
    */
-   int32_t fs_abs_write(file_arr_struct_t* file_array, int32_t id, const void* buf, int32_t len) {
-     if (id >= 0 && id < MAX_OPENED_FILES) { /* Prereq 1 : the id should be a valid index in array */
-       if (file_array[id].jmp_table != NULL) { /* Prereq 2: the file has to be opened */
-         if (file_array[id].jmp_table -> write != NULL) { /* Prereq 3: current jump table has a valid write func. pointer */
-           /* Call appropriate task to perform writing ( might fail in this case) */
-            return (*file_array[id].jmp_table -> write) (&file_array[id].inode, &file_array[id].file_position, (const char*) buf, len);
-         }
+   int32_t fs_abs_write(fd_table_t* file_table, int32_t id, const void* buf, int32_t len) {
+     file_arr_struct_t* file_array = fs_abs_get(file_table, id); /* Prereq 1 : the file has to be opened */
+     if (file_array != NULL && file_array->jmp_table != NULL) {
+       if (file_array->jmp_table -> write != NULL) { /* Prereq 2: current jump table has a valid write func. pointer */
+         /* Call appropriate task to perform writing ( might fail in this case) */
+          return (*file_array->jmp_table -> write) (&file_array->inode, &file_array->file_position, (const char*) buf, len);
        }
      }
      return FS_ABSTRACTION_FAILURE; /* Fails when prereqs not fully met */
@@ -10,7 +10,8 @@
 
 #define FS_ABSTRACTION_SUCCESS 0
 #define FS_ABSTRACTION_FAILURE -1
-#define MAX_OPENED_FILES 8  /* Each task can have up to 8 open files. */
+#define MAX_OPENED_FILES IDMAP_MAX_IDS  /* Each task can grow to 256 open files. */
+#define FD_CHUNK_POOL_SIZE IDMAP_MAX_IDS  /* Chunks shared by all tasks for descriptors past the first 8 */
 #define STDIN_IDX 0 /* stdin corresponds to file descriptor 0 */
 #define STDOUT_IDX 1  /* stout corresponds to file descriptor 1 */
 #define STRLEN_STDIN 5 /* String "stdin" has 5 chars */
@@ -18,11 +19,13 @@
 
 
 
-/* Functions that operates file descriptor array */
-int32_t fs_abs_init(file_arr_struct_t* file_array);
-int32_t fs_abs_open(file_arr_struct_t* file_array, const char* filename);
-int32_t fs_abs_read(file_arr_struct_t* file_array, int32_t id, void* buf, int32_t len);
-int32_t fs_abs_write(file_arr_struct_t* file_array, int32_t id, const void* buf, int32_t len);
-int32_t fs_abs_close(file_arr_struct_t* file_array, int32_t id);
+/* Functions that operates file descriptor table */
+int32_t fs_abs_init(fd_table_t* file_table);
+int32_t fs_abs_open(fd_table_t* file_table, const char* filename);
+int32_t fs_abs_read(fd_table_t* file_table, int32_t id, void* buf, int32_t len);
+int32_t fs_abs_write(fd_table_t* file_table, int32_t id, const void* buf, int32_t len);
+int32_t fs_abs_close(fd_table_t* file_table, int32_t id);
+file_arr_struct_t* fs_abs_get(fd_table_t* file_table, int32_t id);
+void fs_abs_destroy(fd_table_t* file_table);
 
 #endif
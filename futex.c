@@ -0,0 +1,146 @@
+#include "futex.h"
+#include "paging.h"
+#include "scheduler.h"
+
+/* Fast user-space mutexes. A user lock is a word in user memory changed with atomic
+ * instructions; taking or releasing it while nobody else wants it never enters the kernel.
+ * Only a task that finds it taken calls futex(FUTEX_WAIT) to sleep until the holder, which
+ * sees from the word that someone waits, calls futex(FUTEX_WAKE). Waiters are kept in
+ * buckets hashed by the physical address of the word, so tasks sharing the page meet on the
+ * same key whatever address each maps it at. */
+static futex_bucket_t futex_hash[FUTEX_BUCKETS];
+
+/* futex_bucket_t* futex_bucket()
+ * Description: Finds the bucket a word's waiters are kept in.
+ * Inputs: uint32_t key (Physical address of the word)
+ * Output: None
+ * Returned Value: The bucket
+ * Side Effects: None
+ */
+static futex_bucket_t* futex_bucket(uint32_t key) {
+    return &futex_hash[((key >> 2) * FUTEX_HASH_MULT) >> (32 - FUTEX_HASH_BITS)];
+}
+
+/* void futex_unqueue()
+ * Description: Takes a waiter off its bucket without waking it.
+ * Inputs: futex_bucket_t* bucket (Its bucket, locked), futex_q_t* q (The waiter)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+static void futex_unqueue(futex_bucket_t* bucket, futex_q_t* q) {
+    futex_q_t* prev; /* Waiter before q, NULL at the head */
+    futex_q_t* cur; /* Waiter being looked at */
+    prev = NULL;
+    for (cur = bucket -> head; cur && cur != q; cur = cur -> next) {
+        prev = cur;
+    }
+    if (!cur) {
+        return;
+    }
+    if (prev) {
+        prev -> next = q -> next;
+    } else {
+        bucket -> head = q -> next;
+    }
+    if (bucket -> tail == q) {
+        bucket -> tail = prev;
+    }
+}
+
+/* void futex_init()
+ * Description: Empties the wait buckets and names their locks.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+void futex_init() {
+    uint32_t idx; /* Bucket being set up */
+    for (idx = 0; idx < FUTEX_BUCKETS; idx++) {
+        spin_lock_init(&futex_hash[idx].lock, "futex");
+        futex_hash[idx].head = NULL;
+        futex_hash[idx].tail = NULL;
+    }
+}
+
+/* int32_t futex_wait()
+ * Description: Sleeps the running task until futex_wake() is called on the word, unless the
+ *              word no longer holds val. The value is checked under the bucket lock, so a
+ *              wake sent after the holder changed the word can't be missed.
+ * Inputs: uint32_t key (Physical address of the word), uint32_t val (Value the caller saw)
+ * Output: None
+ * Returned Value: 0 once woken, -1 if the word had already changed or the thread was killed
+ * Side Effects: Switches to another task while sleeping.
+ */
+int32_t futex_wait(uint32_t key, uint32_t val) {
+    futex_bucket_t* bucket; /* Where the waiter is kept */
+    futex_q_t q; /* The waiter, on our stack: we don't return before we are off the bucket */
+    uint32_t flags; /* Saved EFLAGS */
+    bucket = futex_bucket(key);
+    spin_lock_irqsave(&bucket -> lock, flags);
+    if (*(volatile uint32_t*)PHYS_TO_VIRT(key) != val) {
+        spin_unlock_irqrestore(&bucket -> lock, flags);
+        return -1;
+    }
+    q.next = NULL;
+    q.key = key;
+    q.woken = 0;
+    q.queue.head = NULL;
+    q.queue.tail = NULL;
+    if (bucket -> tail) {
+        bucket -> tail -> next = &q;
+    } else {
+        bucket -> head = &q;
+    }
+    bucket -> tail = &q;
+    while (!q.woken) {
+        if (thread_killed()) { /* Still on the bucket, and q is about to go away */
+            futex_unqueue(bucket, &q);
+            spin_unlock_irqrestore(&bucket -> lock, flags);
+            return -1;
+        }
+        sleep_on_locked(&q.queue, &bucket -> lock);
+    }
+    spin_unlock_irqrestore(&bucket -> lock, flags);
+    return 0;
+}
+
+/* int32_t futex_wake()
+ * Description: Wakes up to nr_wake tasks sleeping on a word, the longest waiting first.
+ * Inputs: uint32_t key (Physical address of the word), uint32_t nr_wake (Most tasks to wake)
+ * Output: None
+ * Returned Value: The number of tasks woken
+ * Side Effects: Puts the woken tasks back on a run queue.
+ */
+int32_t futex_wake(uint32_t key, uint32_t nr_wake) {
+    futex_bucket_t* bucket; /* Where the waiters are kept */
+    futex_q_t* q; /* Waiter being looked at */
+    futex_q_t* prev; /* Waiter before it, NULL at the head */
+    futex_q_t* next; /* Waiter after it */
+    uint32_t flags; /* Saved EFLAGS */
+    int32_t woken = 0; /* Tasks woken so far */
+    bucket = futex_bucket(key);
+    spin_lock_irqsave(&bucket -> lock, flags);
+    prev = NULL;
+    for (q = bucket -> head; q && (uint32_t)woken < nr_wake; q = next) {
+        next = q -> next;
+        if (q -> key != key) { /* Another word hashed to the same bucket */
+            prev = q;
+            continue;
+        }
+        if (prev) {
+            prev -> next = next;
+        } else {
+            bucket -> head = next;
+        }
+        if (bucket -> tail == q) {
+            bucket -> tail = prev;
+        }
+        q -> woken = 1;
+        wake_up(&q -> queue); /* The waiter needs the bucket lock to return, so q stays valid */
+        woken++;
+    }
+    spin_unlock_irqrestore(&bucket -> lock, flags);
+    return woken;
+}
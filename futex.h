@@ -0,0 +1,23 @@
+/*
+ * Header File for Futexes
+ */
+
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include "types.h"
+#include "lib.h"
+
+#define FUTEX_WAIT 0 /* Sleep while the word still holds the expected value */
+#define FUTEX_WAKE 1 /* Wake up to a number of tasks sleeping on the word */
+#define FUTEX_HASH_BITS 6
+#define FUTEX_BUCKETS (1 << FUTEX_HASH_BITS) /* Wait buckets waiters are hashed into */
+#define FUTEX_HASH_MULT 0x9E3779B1 /* Golden ratio, spreads neighbouring words over the buckets */
+
+/* Initializes the wait buckets */
+extern void futex_init(void);
+/* Wait and wake on a word, named by its physical address */
+extern int32_t futex_wait(uint32_t key, uint32_t val);
+extern int32_t futex_wake(uint32_t key, uint32_t nr_wake);
+
+#endif
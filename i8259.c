@@ -9,6 +9,18 @@
 /* Interrupt masks to determine which interrupts are enabled and disabled */
 uint8_t master_mask; /* IRQs 0-7  */
 uint8_t slave_mask;  /* IRQs 8-15 */
+
+static void i8259_enable_irq(uint32_t irq_num);
+static void i8259_disable_irq(uint32_t irq_num);
+static void i8259_send_eoi(uint32_t irq_num);
+
+/* Jump table for the 8259 PICs, the fallback without an IOAPIC */
+irq_jump_table_t i8259_irq_jmptable = {
+    .enable = i8259_enable_irq,
+    .disable = i8259_disable_irq,
+    .eoi = i8259_send_eoi
+};
+irq_jump_table_t* irq_chip = &i8259_irq_jmptable; /* Controller the IRQs go through */
 /*
 i8259_init
 DESCRIPTION: initalizes master and slave pic
@@ -36,17 +48,70 @@ void i8259_init(void) {
     outb(ICW2_SLAVE, SLAVE_VAL);
     outb(ICW3_SLAVE, SLAVE_VAL);
     outb(ICW4, SLAVE_VAL);
-    enable_irq(SLAVE_IRQ);
+    i8259_enable_irq(SLAVE_IRQ);
+}
+
+/*
+i8259_mask_all
+DESCRIPTION: masks every IRQ on both PICs, when another controller takes over
+INPUTS: none
+OUTPUTS: none
+RETURN VALUE: the previous masks, bit n set when IRQ n was masked
+SIDE EFFECTS: the PICs deliver nothing afterwards
+*/
+uint32_t i8259_mask_all(void) {
+    uint32_t prev_mask = (slave_mask << IRQ_VAL) | master_mask;
+    master_mask = 0xFF;
+    slave_mask = 0xFF;
+    outb(master_mask, MASTER_VAL);
+    outb(slave_mask, SLAVE_VAL);
+    return prev_mask;
 }
+
 /*
 enable_irq
-DESCRIPTION: enable (unmask) the specified IRQ
+DESCRIPTION: enable (unmask) the specified IRQ on whichever controller is in use
 Inputs: irq_num - number of irq to be enabled
 Outputs: none
 Return Value: none
 SIDE EFFECTS: none
 */
 void enable_irq(uint32_t irq_num) {
+    irq_chip -> enable(irq_num);
+}
+
+/*
+disable_irq
+DESCRIPTION: disable (mask) the specified IRQ on whichever controller is in use
+Inputs: irq_num - number of irq to be disabled
+Outputs: none
+Return Value: none
+SIDE EFFECTS: none
+*/
+void disable_irq(uint32_t irq_num) {
+    irq_chip -> disable(irq_num);
+}
+
+/*
+send_eoi
+DESCRIPTION: Send end-of-interrupt signal for the specified IRQ to whichever controller is in use
+INPUTS: irq_num - number of irq being acknowledged
+OUTPUTS: none
+RETURN VALUES: none
+SIDE EFFECTS: none
+*/
+void send_eoi(uint32_t irq_num) {
+    irq_chip -> eoi(irq_num);
+}
+/*
+i8259_enable_irq
+DESCRIPTION: enable (unmask) the specified IRQ
+Inputs: irq_num - number of irq to be enabled
+Outputs: none
+Return Value: none
+SIDE EFFECTS: none
+*/
+static void i8259_enable_irq(uint32_t irq_num) {
     uint16_t loc;
     if (irq_num < IRQ_VAL){ //number of irq in one pic
         loc = MASTER_VAL; //irq on master pic
@@ -61,14 +126,14 @@ void enable_irq(uint32_t irq_num) {
     }
 }
 /*
-disable_irq
+i8259_disable_irq
 DESCRIPTION:  Disable (mask) the specified IRQ
 INPUTS: irq_num - number of irq that has to be enabled
 OUTPUTS: none
 RETURN VALUES: none
 SIDE EFFECTS: none
 */
-void disable_irq(uint32_t irq_num) {
+static void i8259_disable_irq(uint32_t irq_num) {
     uint16_t loc;
     if (irq_num < IRQ_VAL){ //check if slave or master
         loc = MASTER_VAL; 
@@ -82,14 +147,14 @@ void disable_irq(uint32_t irq_num) {
     }
 }
 /*
-send_eoi
+i8259_send_eoi
 DESCRIPTION: Send end-of-interrupt signal for the specified IRQ
 INPUTS: irq_num - number of irq to be enabled
 OUTPUTS: none
 RETURN VALUES: none
 SIDE EFFECTS: none
 */
-void send_eoi(uint32_t irq_num) {
+static void i8259_send_eoi(uint32_t irq_num) {
     if (irq_num >= IRQ_VAL){//check if irq is on slave pic
         outb(EOI | (irq_num - IRQ_VAL), SLAVE_8259_PORT);
         outb(EOI | SLAVE_IRQ, MASTER_8259_PORT);
@@ -35,8 +35,14 @@
 
 /* Externally-visible functions */
 
+/* Controller in use, the 8259s until ioapic_init() takes over */
+extern irq_jump_table_t i8259_irq_jmptable;
+extern irq_jump_table_t* irq_chip;
+
 /* Initialize both PICs */
 void i8259_init(void);
+/* Mask everything on both PICs, returning the old masks */
+uint32_t i8259_mask_all(void);
 /* Enable (unmask) the specified IRQ */
 void enable_irq(uint32_t irq_num);
 /* Disable (mask) the specified IRQ */
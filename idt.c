@@ -7,9 +7,12 @@
 #include "syscall.h"
 #include "keyboard.h"
 #include "syscall_wrapper.h"
+#include "exception_wrapper.h"
+#include "smp.h"
 
 #define EXCEPTION(name,msg)	\
 void name() {				\
+	lock_kernel();			\
 	printf("%s\n",#msg);	\
 	halt_flag = 1;			\
 	halt(0);				\
@@ -23,19 +26,86 @@ EXCEPTION(exception4,"Breakpoint Exception!");
 EXCEPTION(exception5,"Overflow Exception!");
 EXCEPTION(exception6,"BOUND Range Exceeded Exception!");
 EXCEPTION(exception7,"Invalid Opcode Exception!");
-EXCEPTION(exception8,"Device Not Available Exception!");
-EXCEPTION(exception9,"Double Fault Exception!");
 EXCEPTION(exception10,"Coprocessor Segment Exception!");
 EXCEPTION(exception11,"Invalid TSS Exception!");
 EXCEPTION(exception12,"Segment Not Present!");
 EXCEPTION(exception13,"Stack Fault Exception!");
 EXCEPTION(exception14,"General Protection Exception!");
-EXCEPTION(exception15,"Page Fault Exception!");
 EXCEPTION(exception16,"Floating Point Exception");
 EXCEPTION(exception17,"Alignment Check Exception!");
 EXCEPTION(exception18,"Machine Check Exception!");
 EXCEPTION(exception19,"SIMD Floating-Point Exception!");
 
+static tss_t df_tss; /* Task the double fault gate switches to */
+static uint8_t df_stack[DF_STACK_SIZE] __attribute__((aligned (DF_STACK_SIZE)));
+
+/* load_image_page
+* description: backs an image page with a frame holding its part of the executable
+* input: cur_pcb, page_addr (page aligned, inside the file)
+* output: none
+* return value: 0 upon success, -1 when memory is exhausted
+*/
+static int32_t load_image_page(pcb_t* cur_pcb, uint32_t page_addr) {
+	uint32_t frame; /* Frame backing the page */
+	uint32_t offset; /* Offset of the page in the file */
+	uint32_t len; /* Bytes of the file on this page, the rest stays zero */
+	frame = alloc_zeroed_frame();
+	if (frame == NO_FRAME) {
+		return -1;
+	}
+	offset = page_addr - PROGRAM_IMG_ADDRESS;
+	len = cur_pcb->image_len - offset;
+	if (len > PAGE_SIZE_4KB) {
+		len = PAGE_SIZE_4KB;
+	}
+	read_data(cur_pcb->image_inode, offset, PHYS_TO_VIRT(frame), len);
+	if (map_user_page(cur_pcb->page_dir, page_addr, frame) == -1) {
+		free_frame(frame);
+		return -1;
+	}
+	return 0;
+}
+
+/* page_fault_handler
+* description: serves faults on pages a process owns but that were never touched:
+*              image pages are read from the executable (major fault); bss, heap
+*              and stack pages down to USER_STACK_LIMIT are zero-filled (minor
+*              fault). Anything else kills the process.
+* input: fault_addr (cr2), error_code (pushed by the cpu)
+* output: none
+* return value: none
+*/
+void page_fault_handler(uint32_t fault_addr, uint32_t error_code) {
+	pcb_t* cur_pcb = get_active_pcb();
+	pcb_t* proc = cur_pcb ? cur_pcb->leader : NULL; /* Owner of the address space */
+	uint32_t page_addr = fault_addr & ~(PAGE_SIZE_4KB - 1); /* Start of the faulting page */
+	if (cur_pcb != NULL && proc->page_dir != NO_FRAME && /* Kernel threads have no user pages */
+	    !(error_code & PF_PRESENT)) { /* Protection faults are never served */
+		if (virt_to_phys(proc->page_dir, page_addr) != NO_FRAME) {
+			return; /* Another thread of the process mapped it while we waited for the lock */
+		} else if (page_addr >= PROGRAM_IMG_ADDRESS && page_addr - PROGRAM_IMG_ADDRESS < proc->image_len) {
+			if (load_image_page(proc, page_addr) == 0) {
+				cur_pcb->maj_flt++;
+				return; /* Retry the access */
+			}
+		} else if ((page_addr >= PROGRAM_IMG_ADDRESS && page_addr < proc->image_end) || /* bss */
+		           (page_addr >= USER_STACK_LIMIT && page_addr < USER_STACK_ADDRESS) || /* Stack growth */
+		           (page_addr >= USER_HEAP_START && page_addr < proc->brk)) { /* Heap */
+			if (map_zeroed_page(proc->page_dir, page_addr) == 0) {
+				cur_pcb->min_flt++;
+				return; /* Retry the access */
+			}
+		}
+	}
+	printf("Page Fault Exception! %s %s of 0x%x (%s)\n",
+	       (error_code & PF_USER) ? "user" : "kernel",
+	       (error_code & PF_WRITE) ? "write" : "read",
+	       fault_addr,
+	       (error_code & PF_PRESENT) ? "protection violation" : "page not present");
+	halt_flag = 1;
+	halt(0);
+}
+
 /*general interruption
 *description: a general one that not defined in table
 * input: none
@@ -47,6 +117,76 @@ void general_interruption(){
 	printf("Undefined interruption!");
 }
 
+/* double_fault_task
+* description: body of the double fault task. A double fault usually means the kernel
+*              stack overflowed, so the fault can't be handled on it; the task gate got us
+*              here on df_stack instead. Reports where the processor was and stops it
+* input: none
+* output: none
+* return value: none, does not return
+*/
+void double_fault_task() {
+	tss_t* prev = NULL; /* TSS the processor was running on */
+	uint32_t idx; /* Processor looked at */
+	for (idx = 0; idx < MAX_CPUS; idx++) {
+		if (TSS_SELECTOR(idx) == df_tss.prev_task_link) {
+			prev = cpus[idx].tss;
+			break;
+		}
+	}
+	if (prev) {
+		printf("Double Fault Exception! cpu %d eip 0x%x esp 0x%x\n", idx, prev->eip, prev->esp);
+	} else {
+		printf("Double Fault Exception!\n");
+	}
+	while (1) {
+		asm volatile ("cli; hlt");
+	}
+}
+
+/* init_double_fault_task
+* description: sets up the TSS of the double fault task and points vector 8 at it with a
+*              task gate. There is one such task for every processor, so it only reports the
+*              first double fault; a second one resets the machine
+* input: none
+* output: none
+* return value: none
+*/
+static void init_double_fault_task() {
+	seg_desc_t the_tss_desc; /* Its GDT entry */
+	df_tss.esp = (uint32_t)df_stack + DF_STACK_SIZE;
+	df_tss.ss = KERNEL_DS;
+	df_tss.ds = KERNEL_DS;
+	df_tss.es = KERNEL_DS;
+	df_tss.fs = KERNEL_DS;
+	df_tss.gs = KERNEL_DS;
+	df_tss.cs = KERNEL_CS;
+	df_tss.eip = (uint32_t)double_fault_task;
+	df_tss.eflags = 0x2; /* Interrupts off */
+	df_tss.cr3 = (uint32_t)page_directory; /* The kernel half is the same in every address space */
+	df_tss.ldt_segment_selector = KERNEL_LDT;
+	df_tss.io_base_addr = TSS_SIZE; /* No I/O bitmap */
+
+	/* An available 32-bit TSS, like the processors' own */
+	the_tss_desc.granularity   = 0x0;
+	the_tss_desc.opsize        = 0x0;
+	the_tss_desc.reserved      = 0x0;
+	the_tss_desc.avail         = 0x0;
+	the_tss_desc.present       = 0x1;
+	the_tss_desc.dpl           = 0x0;
+	the_tss_desc.sys           = 0x0;
+	the_tss_desc.type          = 0x9;
+	SET_TSS_PARAMS(the_tss_desc, &df_tss, tss_size);
+	df_tss_desc_ptr = the_tss_desc;
+
+	idt[DOUBLE_FAULT_INDEX].seg_selector = DOUBLE_FAULT_TSS;
+	idt[DOUBLE_FAULT_INDEX].reserved3 = TASK_GATE_TYPE & 0x1; /* Type bits, lowest first */
+	idt[DOUBLE_FAULT_INDEX].reserved2 = (TASK_GATE_TYPE >> 1) & 0x1;
+	idt[DOUBLE_FAULT_INDEX].reserved1 = (TASK_GATE_TYPE >> 2) & 0x1;
+	idt[DOUBLE_FAULT_INDEX].size = (TASK_GATE_TYPE >> 3) & 0x1;
+	SET_IDT_ENTRY(idt[DOUBLE_FAULT_INDEX], 0); /* Unused by task gates */
+}
+
 /* init_idt
 * description: initialize the interrupts
 * input: none
@@ -79,14 +219,13 @@ void init_idt(){
 	SET_IDT_ENTRY(idt[4], exception5);
 	SET_IDT_ENTRY(idt[5], exception6);
 	SET_IDT_ENTRY(idt[6], exception7);
-	SET_IDT_ENTRY(idt[7], exception8);
-	SET_IDT_ENTRY(idt[8], exception9);
+	SET_IDT_ENTRY(idt[7], device_not_available_wrapper);
 	SET_IDT_ENTRY(idt[9], exception10);
 	SET_IDT_ENTRY(idt[10], exception11);
 	SET_IDT_ENTRY(idt[11], exception12);
 	SET_IDT_ENTRY(idt[12], exception13);
 	SET_IDT_ENTRY(idt[13], exception14);
-	SET_IDT_ENTRY(idt[14], exception15);	
+	SET_IDT_ENTRY(idt[14], page_fault_wrapper);	
 	SET_IDT_ENTRY(idt[16], exception16);
 	SET_IDT_ENTRY(idt[17], exception17);
 	SET_IDT_ENTRY(idt[18], exception18);
@@ -95,5 +234,10 @@ void init_idt(){
 	SET_IDT_ENTRY(idt[RTC_INDEX], RTC_INTERRUPT);
 	SET_IDT_ENTRY(idt[SYSCALL_INDEX], syscall_wrapper);
 	SET_IDT_ENTRY(idt[PIT_INDEX], PIT_INTERRUPT);
+	SET_IDT_ENTRY(idt[APIC_TIMER_INDEX], APIC_TIMER_INTERRUPT);
+	SET_IDT_ENTRY(idt[SPURIOUS_INDEX], SPURIOUS_INTERRUPT);
+	SET_IDT_ENTRY(idt[RESCHED_INDEX], RESCHED_INTERRUPT);
+	SET_IDT_ENTRY(idt[TLB_FLUSH_INDEX], TLB_FLUSH_INTERRUPT);
+	init_double_fault_task();
 }
 
@@ -6,11 +6,23 @@
 #define KEYBOARD_INDEX 0x21
 #define SYSCALL_INDEX 0x80
 #define PIT_INDEX 0x20
+#define APIC_TIMER_INDEX 0x30 /* Above the vectors the PICs use */
+#define RESCHED_INDEX 0xF0 /* IPI: run the scheduler, sent to idle processors */
+#define TLB_FLUSH_INDEX 0xF1 /* IPI: reload cr3 after a page table change */
+#define SPURIOUS_INDEX 0xFF /* APIC spurious vector, low nibble all ones */
 
 #define SYSCALL_VECTOR		0x80
+#define DOUBLE_FAULT_INDEX 0x08
+#define DF_STACK_SIZE 0x1000 /* Stack of the double fault task */
+#define TASK_GATE_TYPE 0x5 /* IDT gate type that switches to the task of a TSS */
 
 void init_idt();
+void double_fault_task();
 void RTC_INTERRUPT();
 void KEYBOARD_INTERRUPT();
 void PIT_INTERRUPT();
+void APIC_TIMER_INTERRUPT();
+void SPURIOUS_INTERRUPT();
+void RESCHED_INTERRUPT();
+void TLB_FLUSH_INTERRUPT();
 #endif
@@ -0,0 +1,290 @@
+#include "ioapic.h"
+#include "paging.h"
+#include "i8259.h"
+
+static volatile uint32_t* ioapic_regs; /* Register page of the IOAPIC handling GSI 0 */
+static uint32_t ioapic_gsi_base; /* GSI of its first input */
+static uint32_t ioapic_nr_redir; /* Number of redirection entries */
+static uint32_t ioapic_dest; /* High word of every entry: this processor's APIC id */
+static uint32_t isa_gsi[ISA_IRQS]; /* GSI each ISA IRQ is wired to */
+static uint32_t isa_redir_flags[ISA_IRQS]; /* Polarity and trigger mode of each ISA IRQ */
+
+static void ioapic_enable_irq(uint32_t irq_num);
+static void ioapic_disable_irq(uint32_t irq_num);
+static void ioapic_send_eoi(uint32_t irq_num);
+
+/* Jump table for the IOAPIC, with EOIs going to the local APIC */
+irq_jump_table_t ioapic_irq_jmptable = {
+    .enable = ioapic_enable_irq,
+    .disable = ioapic_disable_irq,
+    .eoi = ioapic_send_eoi
+};
+
+/* uint32_t ioapic_read()
+ * Description: Reads an IOAPIC register through the select and window registers.
+ * Inputs: uint32_t reg (Register index)
+ * Output: None
+ * Returned Value: Register value
+ * Side Effects: Changes the selected register. Called with interrupts off.
+ */
+static uint32_t ioapic_read(uint32_t reg) {
+    ioapic_regs[IOREGSEL / sizeof(uint32_t)] = reg;
+    return ioapic_regs[IOWIN / sizeof(uint32_t)];
+}
+
+/* void ioapic_write()
+ * Description: Writes an IOAPIC register through the select and window registers.
+ * Inputs: uint32_t reg (Register index), uint32_t val
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Changes the selected register. Called with interrupts off.
+ */
+static void ioapic_write(uint32_t reg, uint32_t val) {
+    ioapic_regs[IOREGSEL / sizeof(uint32_t)] = reg;
+    ioapic_regs[IOWIN / sizeof(uint32_t)] = val;
+}
+
+/* uint32_t acpi_checksum_ok()
+ * Description: Checks an ACPI structure, whose bytes have to add up to 0.
+ * Inputs: const void* table, uint32_t len (Bytes to add)
+ * Output: None
+ * Returned Value: 1 if the sum is 0, 0 otherwise
+ * Side Effects: None
+ */
+static uint32_t acpi_checksum_ok(const void* table, uint32_t len) {
+    const uint8_t* byte = table; /* Byte being added */
+    uint8_t sum = 0;
+    while (len--) {
+        sum += *byte++;
+    }
+    return sum == 0;
+}
+
+/* acpi_rsdp_t* scan_rsdp()
+ * Description: Looks for the ACPI root pointer on the 16-byte boundaries of a physical range.
+ * Inputs: uint32_t start, uint32_t end (Physical range, in the direct map)
+ * Output: None
+ * Returned Value: The root pointer, or NULL if it is not there
+ * Side Effects: None
+ */
+static acpi_rsdp_t* scan_rsdp(uint32_t start, uint32_t end) {
+    acpi_rsdp_t* rsdp; /* Candidate */
+    for (; start + sizeof(acpi_rsdp_t) <= end; start += RSDP_ALIGN) {
+        rsdp = PHYS_TO_VIRT(start);
+        if (!strncmp(rsdp -> signature, (int8_t*)"RSD PTR ", sizeof(rsdp -> signature)) &&
+            acpi_checksum_ok(rsdp, sizeof(acpi_rsdp_t))) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+/* acpi_madt_t* acpi_find_madt()
+ * Description: Finds the MADT through the RSDP and the RSDT. The RSDP is in the first 1KB of
+ *              the EBDA or in the BIOS ROM.
+ * Inputs: None
+ * Output: None
+ * Returned Value: The MADT, or NULL without ACPI or outside the direct map
+ * Side Effects: None
+ */
+acpi_madt_t* acpi_find_madt() {
+    acpi_rsdp_t* rsdp; /* Root pointer */
+    acpi_header_t* rsdt; /* Root table, an array of table addresses after the header */
+    acpi_header_t* table; /* Table it points to */
+    uint32_t* entry; /* Physical addresses in the RSDT */
+    uint32_t ebda; /* Physical address of the EBDA */
+    uint32_t idx;
+    ebda = (uint32_t)*(uint16_t*)PHYS_TO_VIRT(EBDA_SEG_PTR) << 4; /* Stored as a real-mode segment */
+    rsdp = ebda ? scan_rsdp(ebda, ebda + EBDA_SEARCH_LEN) : NULL;
+    if (!rsdp) {
+        rsdp = scan_rsdp(BIOS_ROM_START, BIOS_ROM_END);
+    }
+    if (!rsdp || rsdp -> rsdt_addr >= DIRECT_MAP_SIZE) {
+        return NULL;
+    }
+    rsdt = PHYS_TO_VIRT(rsdp -> rsdt_addr);
+    if (!acpi_checksum_ok(rsdt, rsdt -> length)) {
+        return NULL;
+    }
+    entry = (uint32_t*)(rsdt + 1);
+    for (idx = 0; idx < (rsdt -> length - sizeof(acpi_header_t)) / sizeof(uint32_t); idx++) {
+        if (entry[idx] >= DIRECT_MAP_SIZE) {
+            continue;
+        }
+        table = PHYS_TO_VIRT(entry[idx]);
+        if (!strncmp(table -> signature, (int8_t*)"APIC", sizeof(table -> signature)) &&
+            acpi_checksum_ok(table, table -> length)) {
+            return (acpi_madt_t*)table;
+        }
+    }
+    return NULL;
+}
+
+/* uint32_t parse_madt()
+ * Description: Finds the IOAPIC that handles GSI 0 and where each ISA IRQ is wired. IRQs
+ *              without an override keep their number as GSI and are edge-triggered, active high.
+ * Inputs: acpi_madt_t* madt
+ * Output: Fills isa_gsi, isa_redir_flags and ioapic_gsi_base
+ * Returned Value: Physical address of the IOAPIC, 0 if there is none
+ * Side Effects: None
+ */
+static uint32_t parse_madt(acpi_madt_t* madt) {
+    uint8_t* pos; /* Entry being read */
+    uint8_t* end; /* End of the table */
+    madt_ioapic_t* ioapic; /* IOAPIC entry */
+    madt_iso_t* iso; /* Override entry */
+    uint32_t addr = 0; /* IOAPIC found */
+    uint32_t irq;
+    for (irq = 0; irq < ISA_IRQS; irq++) {
+        isa_gsi[irq] = irq;
+        isa_redir_flags[irq] = 0;
+    }
+    pos = (uint8_t*)(madt + 1);
+    end = (uint8_t*)madt + madt -> header.length;
+    while (pos + 2 <= end && pos[1] >= 2) { /* Type and length bytes, a 0 length would loop forever */
+        if (pos[0] == MADT_IOAPIC && !addr) {
+            ioapic = (madt_ioapic_t*)pos;
+            if (ioapic -> gsi_base == 0) { /* The one the ISA IRQs go to */
+                addr = ioapic -> addr;
+                ioapic_gsi_base = ioapic -> gsi_base;
+            }
+        } else if (pos[0] == MADT_ISO) {
+            iso = (madt_iso_t*)pos;
+            if (iso -> bus == 0 && iso -> source < ISA_IRQS) {
+                isa_gsi[iso -> source] = iso -> gsi;
+                isa_redir_flags[iso -> source] =
+                    ((iso -> flags & MPS_POLARITY_MASK) == MPS_POLARITY_LOW ? REDIR_ACTIVE_LOW : 0) |
+                    ((iso -> flags & MPS_TRIGGER_MASK) == MPS_TRIGGER_LEVEL ? REDIR_LEVEL : 0);
+            }
+        }
+        pos += pos[1];
+    }
+    return addr;
+}
+
+/* void ioapic_route()
+ * Description: Programs the redirection entry of an ISA IRQ: the vector the 8259s gave it,
+ *              fixed delivery to this processor, and its polarity and trigger mode.
+ * Inputs: uint32_t irq_num, uint32_t mask (REDIR_MASKED or 0)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off.
+ */
+static void ioapic_route(uint32_t irq_num, uint32_t mask) {
+    uint32_t pin; /* IOAPIC input */
+    if (irq_num >= ISA_IRQS) {
+        return;
+    }
+    pin = isa_gsi[irq_num] - ioapic_gsi_base;
+    if (pin >= ioapic_nr_redir) {
+        return;
+    }
+    ioapic_write(IOAPIC_REDTBL + 2 * pin + 1, ioapic_dest);
+    ioapic_write(IOAPIC_REDTBL + 2 * pin, (ICW2_MASTER + irq_num) | isa_redir_flags[irq_num] | mask);
+}
+
+/* int32_t ioapic_init()
+ * Description: Routes the ISA IRQs through the IOAPIC described by the ACPI MADT. The IRQs that
+ *              are enabled on the 8259s stay enabled, on the same vectors, and the 8259s are
+ *              then masked. Needs the local APIC enabled by apic_init().
+ * Inputs: None
+ * Output: None
+ * Returned Value: 0 upon success, -1 when the 8259s have to stay in use
+ * Side Effects: enable_irq(), disable_irq() and send_eoi() go to the IOAPIC afterwards.
+ */
+int32_t ioapic_init() {
+    acpi_madt_t* madt; /* Table describing the interrupt controllers */
+    uint32_t addr; /* Physical address of the IOAPIC */
+    uint32_t pin;
+    uint32_t irq;
+    uint32_t enabled; /* Bit n set when IRQ n was unmasked on the 8259s */
+    uint32_t flags; /* Saved EFLAGS */
+    madt = acpi_find_madt();
+    if (!madt) {
+        return -1;
+    }
+    addr = parse_madt(madt);
+    if (!addr || (addr >> DIR_OFFSET) != (MMIO_MEM_ADD >> DIR_OFFSET)) { /* Outside the mapped page */
+        return -1;
+    }
+    cli_and_save(flags);
+    ioapic_regs = (volatile uint32_t*)addr; /* Identity-mapped by init_paging() */
+    ioapic_nr_redir = ((ioapic_read(IOAPIC_VER) >> IOAPIC_MAX_REDIR_SHIFT) & IOAPIC_MAX_REDIR_MASK) + 1;
+    ioapic_dest = apic_id() << REDIR_DEST_SHIFT;
+    for (pin = 0; pin < ioapic_nr_redir; pin++) {
+        ioapic_write(IOAPIC_REDTBL + 2 * pin, REDIR_MASKED);
+    }
+    enabled = ~i8259_mask_all();
+    irq_chip = &ioapic_irq_jmptable;
+    for (irq = 0; irq < ISA_IRQS; irq++) {
+        if (irq != SLAVE_IRQ && (enabled & (1 << irq))) { /* There is no cascade any more */
+            ioapic_route(irq, 0);
+        }
+    }
+    restore_flags(flags);
+    return 0;
+}
+
+/* void ioapic_enable_irq()
+ * Description: Unmasks an ISA IRQ in its redirection entry.
+ * Inputs: uint32_t irq_num
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+static void ioapic_enable_irq(uint32_t irq_num) {
+    uint32_t flags; /* Saved EFLAGS */
+    cli_and_save(flags);
+    ioapic_route(irq_num, 0);
+    restore_flags(flags);
+}
+
+/* void ioapic_disable_irq()
+ * Description: Masks an ISA IRQ in its redirection entry.
+ * Inputs: uint32_t irq_num
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+static void ioapic_disable_irq(uint32_t irq_num) {
+    uint32_t flags; /* Saved EFLAGS */
+    cli_and_save(flags);
+    ioapic_route(irq_num, REDIR_MASKED);
+    restore_flags(flags);
+}
+
+/* int32_t ioapic_get_redir()
+ * Description: Reads back the redirection entry of an ISA IRQ.
+ * Inputs: uint32_t irq_num, uint32_t* low (Vector, flags and mask), uint32_t* high (Destination)
+ * Output: Fills low and high
+ * Returned Value: 0 upon success, -1 when the IRQ has no entry on this IOAPIC
+ * Side Effects: None
+ */
+int32_t ioapic_get_redir(uint32_t irq_num, uint32_t* low, uint32_t* high) {
+    uint32_t pin; /* IOAPIC input */
+    uint32_t flags; /* Saved EFLAGS */
+    if (!ioapic_regs || irq_num >= ISA_IRQS) {
+        return -1;
+    }
+    pin = isa_gsi[irq_num] - ioapic_gsi_base;
+    if (pin >= ioapic_nr_redir) {
+        return -1;
+    }
+    cli_and_save(flags);
+    *low = ioapic_read(IOAPIC_REDTBL + 2 * pin);
+    *high = ioapic_read(IOAPIC_REDTBL + 2 * pin + 1);
+    restore_flags(flags);
+    return 0;
+}
+
+/* void ioapic_send_eoi()
+ * Description: Acknowledges an IOAPIC interrupt with one write to the local APIC, whatever the
+ *              IRQ. The local APIC passes level-triggered EOIs on to the IOAPIC.
+ * Inputs: uint32_t irq_num (Unused)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+static void ioapic_send_eoi(uint32_t irq_num) {
+    apic_eoi();
+}
@@ -0,0 +1,107 @@
+/*
+ * Header File for the IOAPIC and the ACPI Tables Describing It
+ */
+
+#ifndef _IOAPIC_H
+#define _IOAPIC_H
+
+#include "types.h"
+#include "lib.h"
+#include "apic.h"
+
+#define ISA_IRQS 16 /* IRQs the 8259s had */
+#define EBDA_SEG_PTR 0x40E /* BIOS data area word holding the EBDA segment */
+#define EBDA_SEARCH_LEN 0x400 /* The RSDP may be in the first 1KB of the EBDA */
+#define BIOS_ROM_START 0xE0000 /* ... or in the BIOS ROM */
+#define BIOS_ROM_END 0x100000
+#define RSDP_ALIGN 16 /* The RSDP is on a 16-byte boundary */
+#define MADT_LAPIC 0 /* MADT entry: a processor's local APIC */
+#define MADT_LAPIC_ENABLED 0x1 /* Local APIC entry flags: the processor is usable */
+#define MADT_IOAPIC 1 /* MADT entry: an IOAPIC */
+#define MADT_ISO 2 /* MADT entry: an ISA IRQ wired to another GSI */
+#define MPS_POLARITY_MASK 0x3 /* Override flags: polarity bits */
+#define MPS_POLARITY_LOW 0x3
+#define MPS_TRIGGER_MASK 0xC /* Override flags: trigger mode bits */
+#define MPS_TRIGGER_LEVEL 0xC
+
+/* IOAPIC registers, reached through a select and a window register */
+#define IOREGSEL 0x00 /* Offset of the register select */
+#define IOWIN 0x10 /* Offset of the data window */
+#define IOAPIC_VER 0x01 /* Version, with the last redirection entry in bits 16 - 23 */
+#define IOAPIC_REDTBL 0x10 /* First redirection entry, two registers each */
+#define IOAPIC_MAX_REDIR_SHIFT 16
+#define IOAPIC_MAX_REDIR_MASK 0xFF
+#define REDIR_VECTOR_MASK 0xFF /* Redirection entry: vector */
+#define REDIR_ACTIVE_LOW 0x2000 /* Redirection entry: polarity */
+#define REDIR_LEVEL 0x8000 /* Redirection entry: trigger mode */
+#define REDIR_MASKED 0x10000 /* Redirection entry: masked */
+#define REDIR_DEST_SHIFT 24 /* Destination APIC id, in the high register */
+
+/* Root pointer to the ACPI tables */
+typedef struct __attribute__((packed)) {
+    int8_t signature[8]; /* "RSD PTR " */
+    uint8_t checksum;
+    int8_t oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr; /* Physical address of the RSDT */
+} acpi_rsdp_t;
+
+/* Header every ACPI table starts with */
+typedef struct __attribute__((packed)) {
+    int8_t signature[4];
+    uint32_t length; /* Whole table, header included */
+    uint8_t revision;
+    uint8_t checksum;
+    int8_t oem_id[6];
+    int8_t oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} acpi_header_t;
+
+/* Multiple APIC Description Table, followed by variable-length entries */
+typedef struct __attribute__((packed)) {
+    acpi_header_t header; /* Signature "APIC" */
+    uint32_t lapic_addr;
+    uint32_t flags;
+} acpi_madt_t;
+
+/* MADT entry: a processor and its local APIC */
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t length;
+    uint8_t acpi_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} madt_lapic_t;
+
+/* MADT entry: an IOAPIC and the first GSI it handles */
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t length;
+    uint8_t id;
+    uint8_t reserved;
+    uint32_t addr;
+    uint32_t gsi_base;
+} madt_ioapic_t;
+
+/* MADT entry: interrupt source override */
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t length;
+    uint8_t bus; /* 0, ISA */
+    uint8_t source; /* ISA IRQ */
+    uint32_t gsi; /* Input it is wired to */
+    uint16_t flags; /* Polarity and trigger mode */
+} madt_iso_t;
+
+extern irq_jump_table_t ioapic_irq_jmptable;
+
+/* Finds the ACPI table describing the interrupt controllers */
+extern acpi_madt_t* acpi_find_madt(void);
+/* Routes the ISA IRQs through the IOAPIC, leaving the 8259s masked */
+extern int32_t ioapic_init(void);
+/* Reads back the redirection entry of an ISA IRQ */
+extern int32_t ioapic_get_redir(uint32_t irq_num, uint32_t* low, uint32_t* high);
+
+#endif
@@ -16,18 +16,28 @@
 #include "fs.h" /* File System Supporter */
 #include "syscall.h"
 #include "pit.h"
+#include "apic.h"
+#include "ioapic.h"
+#include "smp.h"
+#include "scheduler.h"
+#include "futex.h"
+#include "workqueue.h"
+#include "fpu.h"
 
 #define RUN_TESTS
 
 /* Macros. */
 /* Check if the bit BIT in FLAGS is set. */
 #define CHECK_FLAG(flags, bit)   ((flags) & (1 << (bit)))
+/* Assume 64MB above 1MB if the boot loader does not report memory */
+#define DEFAULT_MEM_UPPER_KB     0xFC00
 
 /* Check if MAGIC is valid and print the Multiboot information structure
    pointed by ADDR. */
 void entry(unsigned long magic, unsigned long addr) {
 
     multiboot_info_t *mbi;
+    uint32_t mem_upper_kb = DEFAULT_MEM_UPPER_KB; /* Memory above 1MB, used to size the user page pool */
 
     /* Clear the screen. */
     clear();
@@ -45,8 +55,10 @@ void entry(unsigned long magic, unsigned long addr) {
     printf("flags = 0x%#x\n", (unsigned)mbi->flags);
 
     /* Are mem_* valid? */
-    if (CHECK_FLAG(mbi->flags, 0))
+    if (CHECK_FLAG(mbi->flags, 0)) {
         printf("mem_lower = %uKB, mem_upper = %uKB\n", (unsigned)mbi->mem_lower, (unsigned)mbi->mem_upper);
+        mem_upper_kb = mbi->mem_upper;
+    }
 
     /* Is boot_device valid? */
     if (CHECK_FLAG(mbi->flags, 1))
@@ -147,12 +159,21 @@ void entry(unsigned long magic, unsigned long addr) {
 
     /* Init Paging */
     init_paging();
+    init_user_pages(mem_upper_kb);
+    fpu_init(); /* Programs get the FPU and SSE lazily, on their first use */
     /* Init the PIC */
     i8259_init();
     init_terminal();
     rtc_init();
     keyboard_init();
     pit_init();
+    if (apic_init() == 0) { /* Takes over as the scheduling clock, or leaves the PIT */
+        ioapic_init(); /* Takes over from the 8259s when the ACPI tables describe an IOAPIC */
+    }
+    smp_init(); /* Starts the other processors, which wait in cpu_idle() for the kernel lock */
+    timer_init();
+    futex_init();
+    workqueue_init(); /* Queues the "events" thread, it runs once cpu_idle() starts scheduling */
 
 
     /* Initialize devices, memory, filesystem, enable device interrupts on the
@@ -167,12 +188,12 @@ void entry(unsigned long magic, unsigned long addr) {
 #ifdef RUN_TESTS
     /* Run tests */
     //launch_tests();
+    //start_task_tests();
 #endif
     /* clear screen*/
     clear();
     reset_cursor();
-    /* Execute the first program ("shell") ... */
-    execute((uint8_t*)"shell");
-    /* Spin (nicely, so we don't chew up cycles) */
-    asm volatile (".1: hlt; jmp .1;");
+    /* Queue a shell on every terminal, then become the idle task, which runs them */
+    multiterminal_init();
+    cpu_idle();
 }
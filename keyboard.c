@@ -1,4 +1,6 @@
 #include "keyboard.h"
+#include "scheduler.h"
+#include "softirq.h"
 
 //scancode_t has 2 attributes: key name and scancode value
 typedef struct scancode {
@@ -15,6 +17,13 @@ typedef struct ascii {
 uint8_t scancode_to_key(scancode_t* map, uint8_t scan);
 uint8_t key_to_ascii(ascii_t* map, uint8_t key);
 void echo_key(uint8_t key);
+static void keyboard_softirq(void);
+
+/* Scancodes queued by keyboard_handler for keyboard_softirq. Only the handler moves the head
+ * and only the bottom half the tail, so neither needs a lock */
+static volatile uint8_t kbd_ring[KBD_RING_SIZE];
+static volatile uint32_t kbd_ring_head;    //next slot the handler fills
+static volatile uint32_t kbd_ring_tail;    //next slot the bottom half reads
 
 //declare all the key names we use
 enum uint8_t {
@@ -115,6 +124,7 @@ void keyboard_init(void){
     shift_flag = 0;
     ctrl_flag = 0;
     alt_flag = 0;
+    open_softirq(KEYBOARD_SOFTIRQ, keyboard_softirq);
     enable_irq(KEYBOARD_IRQ);
 }
 
@@ -159,6 +169,7 @@ uint8_t key_to_ascii(ascii_t* map, uint8_t key) {
 * input: void
 * outuput: none
 * return value: none
+* side effect: caller holds term[terminal_id].lock
 */
 void clear_kayboard_buffer(int32_t terminal_id) {
     int i; //loop index
@@ -212,17 +223,15 @@ void echo_key(uint8_t key) {
 }
 
 /*
- * KEYBOARD_INTERRUPT
- * DESCRIPTION: keyboard interrupt handler
- * INPUT: NONE
+ * keyboard_event
+ * DESCRIPTION: handles one scancode, in the keyboard bottom half
+ * INPUT: scan: scancode read by keyboard_handler
  * OUTPUT: NONE
  * SIDE EFFECT: see which key is being pressed and if the pressed key is a recognizable key,
  *              print it to the screen
  */
-void keyboard_handler(void) {
-    uint8_t scan = inb(KEYBOARD_PORT);
+static void keyboard_event(uint8_t scan) {
     uint8_t key = scancode_to_key(scancode_table, scan);
-    uint32_t vm_idx; /* Video memory index in page tables */
 
     //If the key is special key, we first handle those
     if (key == CAPS_LOCK) {     // deal caps lock key
@@ -231,30 +240,23 @@ void keyboard_handler(void) {
         } else if (caps_flag == 1) {
             caps_flag = 0;
         }
-        send_eoi(KEYBOARD_IRQ);
         return;
     } else if(key == CAPS_LOCK_RELEASED) {  //when caps lock released, do nothing
-        send_eoi(KEYBOARD_IRQ);
         return;
     } else if (key == LEFT_CONTROL) {   //set ctrl flag on when ctrl pressed
         ctrl_flag = 1;
-        send_eoi(KEYBOARD_IRQ);
         return;
     } else if(key == LEFT_CONTROL_RELEASED) {   //clear ctrl flag when ctrl released
         ctrl_flag = 0;
-        send_eoi(KEYBOARD_IRQ);
         return;
     } else if (key == LEFT_SHIFT || key == RIGHT_SHIFT) {   //when shift pressed, set shift flag
         shift_flag = 1;
-        send_eoi(KEYBOARD_IRQ);
         return;
     } else if (key == LEFT_SHIFT_RELEASED || key == RIGHT_SHIFT_RELEASED) { //cleae shift flag when shift released
         shift_flag = 0;
-        send_eoi(KEYBOARD_IRQ);
         return;
     } else if (key == TAB) {
         echo_key(SPACE);
-        send_eoi(KEYBOARD_IRQ);
         return;
     } else if (key == LEFT_ALT) {
         alt_flag = 1;
@@ -270,16 +272,6 @@ void keyboard_handler(void) {
         switch_terminal(2);
     }
 
-    vm_idx = ((VID_MEM_ADD & MASK_21_12) >> TBL_OFFSET);
-    page_table[vm_idx].page_start_add = vm_idx; /* Put it on vid. mem. */
-    asm volatile ( /* Flush the TLB by writing to register cr3 */
-      "movl %%cr3, %%eax     ;"
-      "movl %%eax, %%cr3     ;"
-      : /* No outputs */
-      : /* No inputs */
-      : "eax", "cc"  /* Clobbers */
-      );
-    
     if (key == BACKSPACE) {  //when backspace pressed, delete previous character if it exists
         
         if (term[visible_terminal].buf_idx > 0) {      //also delete that character from keyboard buffer
@@ -288,8 +280,6 @@ void keyboard_handler(void) {
             term[visible_terminal].line_buff[term[visible_terminal].buf_idx - 1] = NEW_LINE;
             term[visible_terminal].buf_idx--;
         }
-
-        send_eoi(KEYBOARD_IRQ);
     }
 
     if (ctrl_flag == 1 && key == L) {    //when ctrl + L or ctrl + l pressed, clear screen
@@ -300,38 +290,13 @@ void keyboard_handler(void) {
             //terminal_write(0,0,"391OS> ",7);
             printf("391OS> ");
         }
-        if (visible_terminal == running_terminal) {/* Process is on screen */
-            page_table[vm_idx].page_start_add = vm_idx;
-        } else { /* Process not on screen */
-            page_table[vm_idx].page_start_add = vm_idx + 1 + running_terminal;
-        }
-        asm volatile ( /* Flush the TLB by writing to register cr3 */
-        "movl %%cr3, %%eax     ;"
-        "movl %%eax, %%cr3     ;"
-        : /* No outputs */
-        : /* No inputs */
-        : "eax", "cc"  /* Clobbers */
-        );
-        send_eoi(KEYBOARD_IRQ);
         return;
     } 
 
     if (key == ENTER) {  //when enter pressed, go to next line
         putc('\n', visible_terminal);
         term[visible_terminal].enter_flag = 1;
-        send_eoi(KEYBOARD_IRQ);
-        if (visible_terminal == running_terminal) {/* Process is on screen */
-            page_table[vm_idx].page_start_add = vm_idx;
-        } else { /* Process not on screen */
-            page_table[vm_idx].page_start_add = vm_idx + 1 + running_terminal;
-        }
-        asm volatile ( /* Flush the TLB by writing to register cr3 */
-        "movl %%cr3, %%eax     ;"
-        "movl %%eax, %%cr3     ;"
-        : /* No outputs */
-        : /* No inputs */
-        : "eax", "cc"  /* Clobbers */
-        );
+        wake_up_input(&term[visible_terminal].read_queue); /* Let terminal_read return */
         return;
     }
 
@@ -339,22 +304,76 @@ void keyboard_handler(void) {
     if (key != UNKOWN_KEY) {    
         echo_key(key);
     }
+    return;
+}
 
-    if (visible_terminal == running_terminal) {/* Process is on screen */
-        page_table[vm_idx].page_start_add = vm_idx;
-    } else { /* Process not on screen */
-        page_table[vm_idx].page_start_add = vm_idx + 1 + running_terminal;
+/*
+ * keyboard_softirq
+ * DESCRIPTION: keyboard bottom half. Decodes the queued scancodes, echoes them and switches
+ *              terminals, with interrupts on
+ * INPUT: NONE
+ * OUTPUT: NONE
+ * SIDE EFFECT: empties the scancode ring. Runs under the kernel lock, which keeps it the
+ *              only consumer of the ring
+ */
+static void keyboard_softirq(void) {
+    uint8_t scan;           //scancode being handled
+    int32_t terminal_id;    //terminal the key goes to
+    while (kbd_ring_tail != kbd_ring_head) {
+        scan = kbd_ring[kbd_ring_tail & KBD_RING_MASK];
+        asm volatile ("" : : : "memory");   //read the slot before handing it back
+        kbd_ring_tail++;
+        terminal_id = visible_terminal;
+        spin_lock(&term[terminal_id].lock); /* No interrupt handler takes it any more */
+        keyboard_event(scan);
+        spin_unlock(&term[terminal_id].lock);
     }
-    asm volatile ( /* Flush the TLB by writing to register cr3 */
-      "movl %%cr3, %%eax     ;"
-      "movl %%eax, %%cr3     ;"
-      : /* No outputs */
-      : /* No inputs */
-      : "eax", "cc"  /* Clobbers */
-      );
-    //send eoi signal to PIC
-    send_eoi(KEYBOARD_IRQ);
-    return;
 }
 
+/*
+ * keyboard_queue
+ * DESCRIPTION: queues a scancode for keyboard_softirq. Called by the top half with
+ *              interrupts off, which keeps it the only producer of the ring
+ * INPUT: scan: scancode to queue
+ * OUTPUT: 0 if queued, -1 if the ring was full
+ * SIDE EFFECT: a scancode that finds the ring full is dropped
+ */
+int32_t keyboard_queue(uint8_t scan) {
+    if (kbd_ring_head - kbd_ring_tail >= KBD_RING_SIZE) {
+        return -1;
+    }
+    kbd_ring[kbd_ring_head & KBD_RING_MASK] = scan;
+    asm volatile ("" : : : "memory"); /* Fill the slot before publishing it */
+    kbd_ring_head++;
+    return 0;
+}
+
+/*
+ * keyboard_interrupt
+ * DESCRIPTION: the top half, run on the interrupt stack. Only reads the scancode, queues it
+ *              for keyboard_softirq and sends the EOI; the rest runs at irq_exit with
+ *              interrupts on
+ * INPUT: NONE
+ * OUTPUT: NONE
+ * SIDE EFFECT: a scancode that finds the ring full is dropped
+ */
+static void keyboard_interrupt(void) {
+    keyboard_queue(inb(KEYBOARD_PORT));
+    send_eoi(KEYBOARD_IRQ);
+    raise_softirq(KEYBOARD_SOFTIRQ);
+    irq_exit();
+}
 
+/*
+ * KEYBOARD_INTERRUPT
+ * DESCRIPTION: keyboard interrupt handler
+ * INPUT: NONE
+ * OUTPUT: NONE
+ * SIDE EFFECT: the time is charged as interrupt time
+ */
+void keyboard_handler(void) {
+    uint32_t prev_mode; /* Accounting mode of the interrupted task */
+    prev_mode = account_mode(ACCT_IRQ);
+    irq_call(keyboard_interrupt);
+    account_mode(prev_mode);
+}
@@ -13,11 +13,15 @@
 #define ASCII_SIZE 48
 #define MAX_BUF 128
 #define NEW_LINE 0x0A
+#define KBD_RING_SIZE 64 /* Scancodes the handler can queue ahead of the bottom half, a power of two */
+#define KBD_RING_MASK (KBD_RING_SIZE - 1)
 
 /* keyboard initialization function */
 extern void keyboard_init(void);
-/* keyboard interrupt handler */
+/* keyboard interrupt handler, the top half */
 extern void keyboard_handler(void);
+/* queues a scancode for the bottom half, as the top half does */
+extern int32_t keyboard_queue(uint8_t scan);
 /* function use to clear keyboard buffer */
 extern void clear_kayboard_buffer(int32_t terminal_id);
 
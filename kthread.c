@@ -0,0 +1,48 @@
+#include "kthread.h"
+#include "syscall.h"
+#include "scheduler.h"
+
+/* Kernel threads are tasks without a user half. They take a pid, a pcb and a kernel stack like
+ * a process and are scheduled the same way, but run on the boot page directory, never return
+ * to user mode and hold the kernel lock whenever they run, like a task inside a syscall. */
+
+/* int32_t kthread_create()
+ * Description: Starts a kernel thread. It is queued right away and runs fn(data) once the
+ *              scheduler picks it; when fn returns the thread exits.
+ * Inputs: void (*fn)(uint32_t) (Body of the thread), uint32_t data (Its argument),
+ *         const char* name (Shown in place of the command line)
+ * Output: None
+ * Returned Value: The thread's pid, or -1 when the process table is full
+ * Side Effects: Takes a pid and puts the thread on the run queue.
+ */
+int32_t kthread_create(void (*fn)(uint32_t), uint32_t data, const char* name) {
+    int32_t pid; /* The thread's pid */
+    pcb_t* pcb; /* Its pcb */
+    pid = get_available_tid(); /* Only the kernel half is used, the boot directory has it */
+    if (pid == INVALID_PID) {
+        return -1;
+    }
+    pcb = get_pcb(pid);
+    file_desc_array_init(pcb); /* Nothing is opened, but halt() may close the table */
+    pcb -> parent_pid = INVALID_PID;
+    pcb -> terminal_id = 0;
+    pcb -> background = TRUE_; /* Nobody waits for it */
+    memset(pcb -> arg, 0, MAX_ARG_LENGTH + 1);
+    strncpy(pcb -> arg, name, MAX_ARG_LENGTH);
+    prepare_kthread_entry(pcb, fn, data);
+    enqueue_task(pcb);
+    return pid;
+}
+
+/* void kthread_exit()
+ * Description: Ends the running kernel thread. Also where fn returns to.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None (does not return)
+ * Side Effects: Switches away for good; the next task frees the pid.
+ */
+void kthread_exit() {
+    cli();
+    fs_abs_destroy(&get_active_pcb() -> file_desc_table);
+    scheduler_exit(TASK_DEAD);
+}
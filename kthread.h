@@ -0,0 +1,16 @@
+/*
+ * Header File for Kernel Threads
+ */
+
+#ifndef _KTHREAD_H
+#define _KTHREAD_H
+
+#include "types.h"
+#include "lib.h"
+
+/* Starts a task that runs fn(data) in the kernel */
+extern int32_t kthread_create(void (*fn)(uint32_t), uint32_t data, const char* name);
+/* Ends the running kernel thread */
+extern void kthread_exit(void);
+
+#endif
@@ -4,15 +4,33 @@
 #include "lib.h"
 #include "types.h"
 #include "terminal.h"
+#include "smp.h"
+#include "timer.h" /* tick_device, for deferred preemption */
+#include "pit.h" /* tsc_khz */
 
 #define VIDEO       0xB8000
 #define NUM_COLS    80
 #define NUM_ROWS    25
 #define ATTRIB      0x7
 
+/* Guards lock_list. Registered from the start, so taking it never registers it again */
+static spinlock_t lock_list_lock = { .locked = 0, .name = "lock_list", .registered = 1 };
+static spinlock_t* lock_list = &lock_list_lock; /* Every lock taken so far, for print_lock_stats() */
+
 //static int screen_x;
 //static int screen_y;
-static char* video_mem = (char *)VIDEO;
+
+/* char* term_video(int32_t terminal_id);
+ * Inputs: int32_t terminal_id = terminal to draw on
+ * Return Value: the screen if the terminal is visible, its backing page otherwise
+ * Function: Finds where a terminal's text lives. Both are identity-mapped in every
+ *           address space, so this works on any processor whatever task runs there */
+static char* term_video(int32_t terminal_id) {
+    if (terminal_id == visible_terminal) {
+        return (char *)VIDEO;
+    }
+    return (char *)term[terminal_id].vid_mem;
+}
 
 /* void clear(void);
  * Inputs: void
@@ -20,6 +38,7 @@ static char* video_mem = (char *)VIDEO;
  * Function: Clears video memory */
 void clear(void) {
     int32_t i;
+    char* video_mem = term_video(visible_terminal); /* Where the text goes */
     for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
         *(uint8_t *)(video_mem + (i << 1)) = ' ';
         *(uint8_t *)(video_mem + (i << 1) + 1) = ATTRIB;
@@ -66,6 +85,7 @@ return value: none
 */
 void scroll_up(int32_t terminal_id) {
     int32_t ind;
+    char* video_mem = term_video(terminal_id); /* Where the text goes */
     for (ind = 0; ind < NUM_COLS*(NUM_ROWS-1); ind++){
         *(uint8_t *)(video_mem + (ind << 1)) = *(uint8_t *)(video_mem + ((ind+NUM_COLS) << 1)); //moves character up one line
         *(uint8_t *)(video_mem + (ind << 1) + 1) = *(uint8_t *)(video_mem + ((ind+NUM_COLS) << 1) + 1); //moves attribute up one line
@@ -90,6 +110,7 @@ return value: none
 */
 void scroll_down(int32_t terminal_id){
     int32_t ind;
+    char* video_mem = term_video(terminal_id); /* Where the text goes */
     for (ind = NUM_COLS*NUM_ROWS - 1; ind >= NUM_COLS; ind--){
         *(uint8_t *)(video_mem + (ind << 1)) = *(uint8_t *)(video_mem + ((ind-NUM_COLS) << 1)); //moves character up one line
         *(uint8_t *)(video_mem + (ind << 1) + 1) = *(uint8_t *)(video_mem + ((ind-NUM_COLS) << 1) + 1); //moves attribute up one line
@@ -247,6 +268,7 @@ int32_t puts(int8_t* s) {
     return index;
 }
 void backspace(void) {
+    char* video_mem = term_video(visible_terminal); /* Where the text goes */
     if (term[visible_terminal].term_x != 0) {
         term[visible_terminal].term_x--;
     } else if (term[visible_terminal].term_x == 0 && term[visible_terminal].term_y == 0) {
@@ -264,6 +286,7 @@ void backspace(void) {
  * Return Value: void
  *  Function: Output a character to the console */
 void putc(uint8_t c, int32_t terminal_id) {
+    char* video_mem = term_video(terminal_id); /* Where the text goes */
     if(c == '\n' || c == '\r') {
         if (term[terminal_id].term_y == NUM_ROWS - 1) {
             scroll_up(terminal_id);
@@ -572,12 +595,231 @@ int8_t* strncpy(int8_t* dest, const int8_t* src, uint32_t n) {
     return dest;
 }
 
+/* void idmap_init(idmap_t* map, uint32_t limit)
+ * Inputs: idmap_t* map = bitmap to initialize
+ *         uint32_t limit = number of usable ids, at most IDMAP_MAX_IDS
+ * Return Value: none
+ * Function: marks ids [0, limit) free and every id past the limit as used,
+ *           so they are never handed out */
+void idmap_init(idmap_t* map, uint32_t limit) {
+    uint32_t id;
+    map->full = 0;
+    memset(map->words, 0, sizeof(map->words));
+    for (id = limit; id < IDMAP_MAX_IDS; id++) {
+        idmap_set(map, id);
+    }
+}
+
+/* int32_t idmap_alloc(idmap_t* map)
+ * Inputs: idmap_t* map = bitmap to allocate from
+ * Return Value: lowest free id, or -1 if every id is in use
+ * Function: finds the first word with a free id through the summary word,
+ *           then the first free bit in that word. Two bit scans, so O(1) */
+int32_t idmap_alloc(idmap_t* map) {
+    uint32_t word;
+    uint32_t bit;
+    if ((map->full & ((1 << IDMAP_WORDS) - 1)) == ((1 << IDMAP_WORDS) - 1)) {
+        return -1;
+    }
+    word = find_first_zero(map->full);
+    bit = find_first_zero(map->words[word]);
+    map->words[word] |= (1 << bit);
+    if (map->words[word] == 0xFFFFFFFF) {
+        map->full |= (1 << word); /* Word exhausted, skip it in later scans */
+    }
+    return word * IDMAP_WORD_BITS + bit;
+}
+
+/* void idmap_free(idmap_t* map, uint32_t id)
+ * Inputs: idmap_t* map = bitmap owning the id
+ *         uint32_t id = id to release
+ * Return Value: none
+ * Function: marks id free again */
+void idmap_free(idmap_t* map, uint32_t id) {
+    if (id >= IDMAP_MAX_IDS) {
+        return;
+    }
+    map->words[id / IDMAP_WORD_BITS] &= ~(1 << (id % IDMAP_WORD_BITS));
+    map->full &= ~(1 << (id / IDMAP_WORD_BITS));
+}
+
+/* void idmap_set(idmap_t* map, uint32_t id)
+ * Inputs: idmap_t* map = bitmap owning the id
+ *         uint32_t id = id to reserve
+ * Return Value: none
+ * Function: marks a specific id as in use */
+void idmap_set(idmap_t* map, uint32_t id) {
+    if (id >= IDMAP_MAX_IDS) {
+        return;
+    }
+    map->words[id / IDMAP_WORD_BITS] |= (1 << (id % IDMAP_WORD_BITS));
+    if (map->words[id / IDMAP_WORD_BITS] == 0xFFFFFFFF) {
+        map->full |= (1 << (id / IDMAP_WORD_BITS));
+    }
+}
+
+/* int32_t idmap_test(idmap_t* map, uint32_t id)
+ * Inputs: idmap_t* map = bitmap owning the id
+ *         uint32_t id = id to look up
+ * Return Value: 1 if the id is in use, 0 otherwise
+ * Function: checks a single id */
+int32_t idmap_test(idmap_t* map, uint32_t id) {
+    if (id >= IDMAP_MAX_IDS) {
+        return 1;
+    }
+    return (map->words[id / IDMAP_WORD_BITS] >> (id % IDMAP_WORD_BITS)) & 1;
+}
+
+/* void preempt_disable(void)
+ * Inputs: void
+ * Return Value: void
+ * Function: keeps the running task on this processor until preempt_enable(). Calls nest;
+ *           the scheduler defers involuntary switches while any is outstanding */
+void preempt_disable(void) {
+    uint32_t flags;
+    cli_and_save(flags);
+    this_cpu()->preempt_count++;
+    restore_flags(flags);
+}
+
+/* void preempt_enable(void)
+ * Inputs: void
+ * Return Value: void
+ * Function: undoes preempt_disable(). A preemption deferred in the meantime is taken at
+ *           the next tick, asked for right away */
+void preempt_enable(void) {
+    uint32_t flags;
+    cpu_t* cpu;
+    cli_and_save(flags);
+    cpu = this_cpu();
+    if (cpu->preempt_count && --cpu->preempt_count == 0 && cpu->need_resched) {
+        cpu->need_resched = 0;
+        tick_device->set_oneshot(1);
+    }
+    restore_flags(flags);
+}
+
+/* void spin_lock_init(spinlock_t* lock, const char* name)
+ * Inputs: spinlock_t* lock = lock to set up
+ *         const char* name = name print_lock_stats() shows
+ * Return Value: void
+ * Function: makes a lock unlocked with clear statistics. Statically allocated locks can
+ *           use SPIN_LOCK_UNLOCKED instead */
+void spin_lock_init(spinlock_t* lock, const char* name) {
+    uint32_t registered = lock->registered;
+    spinlock_t* next = lock->next;
+    memset(lock, 0, sizeof(spinlock_t));
+    lock->name = name;
+    lock->registered = registered; /* Stays on the list if it already was */
+    lock->next = next;
+}
+
+/* void lock_register(spinlock_t* lock)
+ * Inputs: spinlock_t* lock = lock just taken for the first time, held by the caller
+ * Return Value: void
+ * Function: adds a lock to the list print_lock_stats() walks. Other processors may be
+ *           registering or walking at the same time, so the list has its own lock */
+static void lock_register(spinlock_t* lock) {
+    uint32_t flags;
+    spin_lock_irqsave(&lock_list_lock, flags);
+    lock->next = lock_list;
+    lock_list = lock;
+    lock->registered = 1;
+    spin_unlock_irqrestore(&lock_list_lock, flags);
+}
+
+/* int32_t spin_trylock(spinlock_t* lock)
+ * Inputs: spinlock_t* lock = lock to take
+ * Return Value: 1 if the lock was taken, 0 if it is held
+ * Function: takes a lock only if it is free, without spinning */
+int32_t spin_trylock(spinlock_t* lock) {
+    preempt_disable();
+    if (xchg(&lock->locked, 1)) {
+        preempt_enable();
+        return 0;
+    }
+    if (!lock->registered) {
+        lock_register(lock);
+    }
+    lock->acquired++;
+    lock->hold_start = rdtsc();
+    return 1;
+}
+
+/* void spin_lock(spinlock_t* lock)
+ * Inputs: spinlock_t* lock = lock to take
+ * Return Value: void
+ * Function: spins until the lock is ours. The wait only reads the lock, so waiters don't
+ *           bounce its cache line; the time spent counts as contention */
+void spin_lock(spinlock_t* lock) {
+    uint64_t start;
+    preempt_disable();
+    if (xchg(&lock->locked, 1)) {
+        start = rdtsc();
+        do {
+            while (lock->locked) {
+                pause();
+            }
+        } while (xchg(&lock->locked, 1));
+        lock->contended++;
+        lock->wait_cycles += rdtsc() - start;
+    }
+    if (!lock->registered) {
+        lock_register(lock);
+    }
+    lock->acquired++;
+    lock->hold_start = rdtsc();
+}
+
+/* void spin_unlock(spinlock_t* lock)
+ * Inputs: spinlock_t* lock = lock to release, held by the caller
+ * Return Value: void
+ * Function: records how long the lock was held and releases it */
+void spin_unlock(spinlock_t* lock) {
+    uint64_t held = rdtsc() - lock->hold_start;
+    lock->hold_cycles += held;
+    if (held > lock->max_hold) {
+        lock->max_hold = held;
+    }
+    xchg(&lock->locked, 0); /* Also a barrier: our writes are seen before the release */
+    preempt_enable();
+}
+
+/* uint32_t cycles_to_us(uint64_t cycles)
+ * Inputs: uint64_t cycles = TSC cycles
+ * Return Value: the same time in microseconds, 0 before the TSC is calibrated */
+static uint32_t cycles_to_us(uint64_t cycles) {
+    return tsc_khz ? (uint32_t)div_u64_u32(cycles * 1000, tsc_khz) : 0;
+}
+
+/* void print_lock_stats(void)
+ * Inputs: void
+ * Return Value: void
+ * Function: prints, for every lock taken so far, how often it was taken and waited for,
+ *           the time spent waiting and its average and longest hold times */
+void print_lock_stats(void) {
+    spinlock_t* lock;
+    spinlock_t* head;
+    uint32_t flags;
+    spin_lock_irqsave(&lock_list_lock, flags);
+    head = lock_list; /* Locks are only ever added at the head, the rest can be walked unlocked */
+    spin_unlock_irqrestore(&lock_list_lock, flags);
+    for (lock = head; lock; lock = lock->next) {
+        printf("%s: %u taken, %u contended, %u us waiting, hold avg %u us max %u us\n",
+               lock->name ? lock->name : "?", lock->acquired, lock->contended,
+               cycles_to_us(lock->wait_cycles),
+               lock->acquired ? cycles_to_us(div_u64_u32(lock->hold_cycles, lock->acquired)) : 0,
+               cycles_to_us(lock->max_hold));
+    }
+}
+
 /* void test_interrupts(void)
  * Inputs: void
  * Return Value: void
  * Function: increments video memory. To be used to test rtc */
 void test_interrupts(void) {
     int32_t i;
+    char* video_mem = term_video(visible_terminal); /* Where the text goes */
     for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
         video_mem[i << 1]++;
     }
@@ -31,6 +31,27 @@ int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n);
 int8_t* strcpy(int8_t* dest, const int8_t*src);
 int8_t* strncpy(int8_t* dest, const int8_t*src, uint32_t n);
 
+/* Two-level bitmap id allocation (pids, file descriptors) */
+void idmap_init(idmap_t* map, uint32_t limit);
+int32_t idmap_alloc(idmap_t* map);
+void idmap_free(idmap_t* map, uint32_t id);
+void idmap_set(idmap_t* map, uint32_t id);
+int32_t idmap_test(idmap_t* map, uint32_t id);
+
+/* Spinlocks. A holder can't be preempted; locks shared with interrupt handlers are taken
+ * with spin_lock_irqsave(). Every syscall, fault and IRQ entry still takes the big kernel
+ * lock, so for now they don't contend between processors. Sleepers queue themselves before
+ * dropping theirs (sleep_on_locked()), but the wait queues and run queues are only guarded
+ * by the big kernel lock, so no path can drop lock_kernel() yet */
+#define SPIN_LOCK_UNLOCKED(lock_name) { .locked = 0, .name = (lock_name) }
+void spin_lock_init(spinlock_t* lock, const char* name);
+void spin_lock(spinlock_t* lock);
+int32_t spin_trylock(spinlock_t* lock);
+void spin_unlock(spinlock_t* lock);
+void print_lock_stats(void);
+void preempt_disable(void);
+void preempt_enable(void);
+
 /* Userspace address-check functions */
 int32_t bad_userspace_addr(const void* addr, int32_t len);
 int32_t safe_strncpy(int8_t* dest, const int8_t* src, int32_t n);
@@ -79,6 +100,84 @@ static inline uint32_t inl(port) {
     return val;
 }
 
+/* Returns the index of the lowest clear bit in "word". The caller
+ * guarantees that at least one bit is clear */
+static inline uint32_t find_first_zero(uint32_t word) {
+    uint32_t idx;
+    asm volatile ("bsfl %1, %0"
+            : "=r"(idx)
+            : "r"(~word)
+            : "cc"
+    );
+    return idx;
+}
+
+/* Divides a 64-bit number by a 32-bit one, in two divl steps, since
+ * there is no libgcc to provide 64-bit division */
+static inline uint64_t div_u64_u32(uint64_t dividend, uint32_t divisor) {
+    uint32_t high = (uint32_t)(dividend >> 32);
+    uint32_t q_high = high / divisor;
+    uint32_t rem = high % divisor;
+    uint32_t q_low;
+    asm ("divl %2"
+            : "=a"(q_low), "=d"(rem)
+            : "rm"(divisor), "a"((uint32_t)dividend), "d"(rem)
+            : "cc"
+    );
+    return ((uint64_t)q_high << 32) | q_low;
+}
+
+/* Reads the time stamp counter, which counts processor cycles */
+static inline uint64_t rdtsc(void) {
+    uint64_t tsc;
+    asm volatile ("rdtsc"
+            : "=A"(tsc)
+    );
+    return tsc;
+}
+
+/* Runs cpuid for a leaf, returning eax, ebx, ecx and edx in regs[0..3] */
+static inline void cpuid(uint32_t leaf, uint32_t* regs) {
+    asm volatile ("cpuid"
+            : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+            : "a"(leaf), "c"(0)
+    );
+}
+
+/* Reads a model-specific register */
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint64_t val;
+    asm volatile ("rdmsr"
+            : "=A"(val)
+            : "c"(msr)
+    );
+    return val;
+}
+
+/* Writes a model-specific register */
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+    asm volatile ("wrmsr"
+            :
+            : "c"(msr), "A"(val)
+            : "memory"
+    );
+}
+
+/* Atomically stores val at ptr and returns what was there */
+static inline uint32_t xchg(volatile uint32_t* ptr, uint32_t val) {
+    asm volatile ("xchgl %0, %1"
+            : "+r"(val), "+m"(*ptr)
+            :
+            : "memory"
+    );
+    return val;
+}
+
+/* Tells the processor it is in a spin-wait loop */
+static inline void pause(void) {
+    asm volatile ("pause" : : : "memory");
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
@@ -160,4 +259,19 @@ do {                                    \
     );                                  \
 } while (0)
 
+/* Disables interrupts on this processor, then takes a spinlock */
+#define spin_lock_irqsave(lock, flags)  \
+do {                                    \
+    cli_and_save(flags);                \
+    spin_lock(lock);                    \
+} while (0)
+
+/* Releases a spinlock, then restores the interrupt flag saved by
+ * spin_lock_irqsave(lock, flags) */
+#define spin_unlock_irqrestore(lock, flags) \
+do {                                    \
+    spin_unlock(lock);                  \
+    restore_flags(flags);               \
+} while (0)
+
 #endif /* _LIB_H */
@@ -4,6 +4,32 @@
 
 #include "paging.h"
 
+static idmap_t user_page_map; /* Bit set marks a user program page as taken */
+static uint32_t frame_free_list; /* Physical address of the first free frame, NO_FRAME when empty */
+static uint32_t frame_bump; /* Next never-used frame in the current 4MB page */
+static uint32_t frame_bump_end; /* End of the current 4MB page */
+static uint32_t zero_pool_list; /* Physical address of the first pre-zeroed frame, NO_FRAME when empty */
+static uint32_t zero_pool_count; /* Number of frames in the zero pool */
+
+/* void zero_frame()
+ * Description: Clears a frame with rep stosl.
+ * Inputs: uint32_t frame (Physical address of the frame)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Overwrites the frame.
+ */
+static void zero_frame(uint32_t frame) {
+    void* dst = PHYS_TO_VIRT(frame); /* Kernel view of the frame */
+    uint32_t count = PAGE_SIZE_4KB / 4; /* Number of longs to store */
+    asm volatile (
+        "cld                ;"
+        "rep stosl          ;"
+        : "+D" (dst), "+c" (count)
+        : "a" (0)
+        : "memory", "cc"
+        );
+}
+
 /* void init_paging()
  * Description: A function to initialize paging functionality - page directory and page table for virtual memory implementation
  * Inputs: None
@@ -14,14 +40,17 @@
 void init_paging() {
     uint32_t init_i; /* Loop index for the very first null initialization */
     uint32_t idx; /* Loop index to set specific values in directory and table */
+    uint32_t tbl; /* Vidmap table of a terminal */
     for (init_i = 0; init_i < NUM_PDE_ENTRIES; init_i++) { /* Loop through page directory */
         page_directory[init_i].val = ZERO; /* Initialize all bits to be 0 at first */
     }
     for (init_i = 0; init_i < NUM_PTE_ENTRIES; init_i++) { /* Loop through page table */
         page_table[init_i].val = ZERO; /* Initialize all bits to be 0 at first */
     }
-    for (init_i = 0; init_i < NUM_PTE_ENTRIES; init_i++) { /* Loop through user vidmap page table */
-        user_vidmap_page_table[init_i].val = ZERO; /* Initialize all bits to be 0 at first */
+    for (tbl = 0; tbl < VIDMAP_TABLES; tbl++) { /* Loop through the user vidmap page tables */
+        for (init_i = 0; init_i < NUM_PTE_ENTRIES; init_i++) {
+            user_vidmap_page_table[tbl][init_i].val = ZERO; /* Initialize all bits to be 0 at first */
+        }
     }
     for (idx = 0; idx < NUM_PTE_ENTRIES; idx++) { /* Loop through page directory */
         if (idx == ((VID_MEM_ADD & MASK_21_12) >> TBL_OFFSET)) { /* Get bits 21~12 of Vid. Mem. Add. for corr.table idx */ 
@@ -36,10 +65,13 @@ void init_paging() {
         } 
         page_table[idx].page_start_add = idx; /* Record the default (relative) page starting address */
     }
-    for (idx = 0; idx < NUM_PTE_ENTRIES; idx++) { /* Initialize the vidmap page table */
-        user_vidmap_page_table[idx].read_write = ON; /* R/W is always enabled */
-        user_vidmap_page_table[idx].user_supervisor = ON; /* Always applicable by user */
-        user_vidmap_page_table[idx].page_start_add = idx; /* Initialize default address */
+    for (tbl = 0; tbl < VIDMAP_TABLES; tbl++) { /* Initialize the vidmap page tables */
+        for (idx = 0; idx < NUM_PTE_ENTRIES; idx++) {
+            user_vidmap_page_table[tbl][idx].read_write = ON; /* R/W is always enabled */
+            user_vidmap_page_table[tbl][idx].user_supervisor = ON; /* Always applicable by user */
+            user_vidmap_page_table[tbl][idx].page_start_add = idx; /* Initialize default address */
+        }
+        set_vidmap_target(tbl, tbl == 0); /* Terminal 0 starts on screen */
     }
     page_directory[0].present_4kb = ON; /* Mark the 0MB-4MB chunk as "present" */
     page_directory[0].read_write_4kb = ON;
@@ -51,13 +83,36 @@ void init_paging() {
     page_directory[1].page_size_4mb = ON; /* Page size is 4mb */
     page_directory[1].page_start_add_4mb = KER_MEM_ADD >> DIR_OFFSET; /* Get the (relative) page starting address */
 
+    page_directory[KSTACK_MEM_ADD >> DIR_OFFSET].present_4mb = ON; /* Mark the 8MB-12MB kernel stack chunk as "present" */
+    page_directory[KSTACK_MEM_ADD >> DIR_OFFSET].read_write_4mb = ON; /* Kernel stacks are writable, supervisor only */
+    page_directory[KSTACK_MEM_ADD >> DIR_OFFSET].global_page_4mb = ON; /* Shared by every process */
+    page_directory[KSTACK_MEM_ADD >> DIR_OFFSET].page_size_4mb = ON; /* Page size is 4mb */
+    page_directory[KSTACK_MEM_ADD >> DIR_OFFSET].page_start_add_4mb = KSTACK_MEM_ADD >> DIR_OFFSET;
+
     page_directory[PT_USER_VIDMAP_LOCATION].present_4kb = ON; /* Entry for vidmap is always present */
     page_directory[PT_USER_VIDMAP_LOCATION].read_write_4kb = ON; /* Allow r/w */
     page_directory[PT_USER_VIDMAP_LOCATION].user_supervisor_4kb = ON; /* Always enabling user access */
-    page_directory[PT_USER_VIDMAP_LOCATION].tbl_start_add_4kb = ((uint32_t)user_vidmap_page_table) >> TBL_OFFSET; /* Address */
+    page_directory[PT_USER_VIDMAP_LOCATION].tbl_start_add_4kb = ((uint32_t)user_vidmap_page_table[0]) >> TBL_OFFSET; /* vidmap() points processes to their terminal's table */
+
+    for (idx = 0; idx < DIRECT_MAP_SIZE / USER_PAGE_SIZE; idx++) { /* Direct map of physical memory for the kernel */
+        page_directory[(DIRECT_MAP_BASE >> DIR_OFFSET) + idx].present_4mb = ON;
+        page_directory[(DIRECT_MAP_BASE >> DIR_OFFSET) + idx].read_write_4mb = ON; /* Supervisor only */
+        page_directory[(DIRECT_MAP_BASE >> DIR_OFFSET) + idx].global_page_4mb = ON; /* Same in every address space */
+        page_directory[(DIRECT_MAP_BASE >> DIR_OFFSET) + idx].page_size_4mb = ON;
+        page_directory[(DIRECT_MAP_BASE >> DIR_OFFSET) + idx].page_start_add_4mb = idx;
+    }
+
+    page_directory[MMIO_MEM_ADD >> DIR_OFFSET].present_4mb = ON; /* APIC registers, identity-mapped */
+    page_directory[MMIO_MEM_ADD >> DIR_OFFSET].read_write_4mb = ON; /* Supervisor only */
+    page_directory[MMIO_MEM_ADD >> DIR_OFFSET].write_through_4mb = ON;
+    page_directory[MMIO_MEM_ADD >> DIR_OFFSET].cache_disabled_4mb = ON; /* Device registers must not be cached */
+    page_directory[MMIO_MEM_ADD >> DIR_OFFSET].global_page_4mb = ON;
+    page_directory[MMIO_MEM_ADD >> DIR_OFFSET].page_size_4mb = ON;
+    page_directory[MMIO_MEM_ADD >> DIR_OFFSET].page_start_add_4mb = MMIO_MEM_ADD >> DIR_OFFSET;
 
     for (idx = 2; idx < NUM_PDE_ENTRIES; idx++) { /* Loop through the rest of page directory */
-        if (idx == PT_USER_VIDMAP_LOCATION) { /* Index 33 has already been updated */
+        if (idx == PT_USER_VIDMAP_LOCATION || idx == (KSTACK_MEM_ADD >> DIR_OFFSET) ||
+            idx >= (DIRECT_MAP_BASE >> DIR_OFFSET)) { /* Already updated above */
             continue;
         }
         page_directory[idx].page_start_add_4mb = idx; /* Default (relative) address */
@@ -68,8 +123,8 @@ void init_paging() {
 	    "andl $0xFFFFFC00, %%eax          ;"
 	    "movl %%eax, %%cr3                ;" /* Set cr3 to be bit 31~12 of page directory base */
 	    "movl %%cr4, %%eax                ;"
-	    "orl $0x00000010, %%eax           ;"
-	    "movl %%eax, %%cr4                ;" /* Bit 4 of cr4 set to enable 4-mbyte pages with 32 bit paging */
+	    "orl $0x00000090, %%eax           ;"
+	    "movl %%eax, %%cr4                ;" /* Bit 4 of cr4 enables 4-mbyte pages, bit 7 keeps global pages across cr3 loads */
 	    "movl %%cr0, %%eax                ;"
 	    "orl $0x80000000, %%eax 	      ;"
 	    "movl %%eax, %%cr0                ;" /* Set highest bit of cr0 to 1 to  enable paging */
@@ -80,3 +135,341 @@ void init_paging() {
 
   return;
 }
+
+/* void set_vidmap_target()
+ * Description: Points the video page of a terminal's vidmap table at the screen, or at the
+ *              terminal's backing page while it is not visible. The kernel itself always writes
+ *              through the fixed identity mappings, so only user vidmap goes through here.
+ * Inputs: uint32_t terminal_id, uint32_t on_screen (Whether the terminal is visible)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: TLBs caching the old page have to be flushed by the caller.
+ */
+void set_vidmap_target(uint32_t terminal_id, uint32_t on_screen) {
+    uint32_t vm_idx; /* Vid. Mem. index */
+    vm_idx = (VID_MEM_ADD & MASK_21_12) >> TBL_OFFSET;
+    user_vidmap_page_table[terminal_id][vm_idx].page_start_add = on_screen ? vm_idx : vm_idx + 1 + terminal_id;
+    user_vidmap_page_table[terminal_id][vm_idx].present = ON;
+}
+
+/* void init_user_pages()
+ * Description: Sets up the allocator for the 4MB physical pages that frames are carved from.
+ *              Pages start right after the kernel stacks and stop at the end of physical memory.
+ * Inputs: uint32_t mem_upper_kb (KB of memory above 1MB, as reported by multiboot)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Resets the user page bitmap.
+ */
+void init_user_pages(uint32_t mem_upper_kb) {
+    uint32_t mem_top; /* First byte past physical memory */
+    uint32_t num_pages; /* Number of whole 4MB pages available to programs */
+    mem_top = LOW_MEM_SIZE + mem_upper_kb * 1024;
+    num_pages = 0;
+    if (mem_top > USER_PAGE_BASE * USER_PAGE_SIZE) {
+        num_pages = (mem_top - USER_PAGE_BASE * USER_PAGE_SIZE) / USER_PAGE_SIZE;
+    }
+    if (num_pages > IDMAP_MAX_IDS) { /* The bitmap caps how many pages we track */
+        num_pages = IDMAP_MAX_IDS;
+    }
+    if (num_pages > DIRECT_MAP_SIZE / USER_PAGE_SIZE - USER_PAGE_BASE) { /* Frames must be reachable through the direct map */
+        num_pages = DIRECT_MAP_SIZE / USER_PAGE_SIZE - USER_PAGE_BASE;
+    }
+    idmap_init(&user_page_map, num_pages);
+}
+
+/* int32_t alloc_user_page()
+ * Description: Takes a free 4MB physical page to carve frames from.
+ * Inputs: None
+ * Output: None
+ * Returned Value: Physical page number (address >> 22), or INVALID_PAGE when memory is exhausted
+ * Side Effects: Marks the page as taken. Pages are never given back; their frames are.
+ */
+static int32_t alloc_user_page() {
+    int32_t idx; /* Index of the page in the bitmap */
+    idx = idmap_alloc(&user_page_map);
+    if (idx < 0) {
+        return INVALID_PAGE;
+    }
+    return USER_PAGE_BASE + idx;
+}
+
+/* uint32_t alloc_frame()
+ * Description: Takes a free 4KB frame. Freed frames are reused first; otherwise frames are
+ *              carved in order out of a 4MB user page, so both paths are O(1).
+ * Inputs: None
+ * Output: None
+ * Returned Value: Physical address of the frame, or NO_FRAME when memory is exhausted
+ * Side Effects: May take a 4MB user page to carve frames from, or a frame from the zero pool
+ *               when nothing else is left.
+ */
+uint32_t alloc_frame() {
+    uint32_t frame; /* Frame handed out */
+    int32_t page; /* 4MB page to carve frames from */
+    uint32_t flags; /* Saved EFLAGS, the lists are shared with the idle refill */
+    cli_and_save(flags);
+    frame = NO_FRAME;
+    if (frame_free_list != NO_FRAME) { /* Pop the free list; the next link lives in the frame itself */
+        frame = frame_free_list;
+        frame_free_list = *(uint32_t*)PHYS_TO_VIRT(frame);
+    } else {
+        if (frame_bump == frame_bump_end) { /* Current 4MB page used up */
+            page = alloc_user_page();
+            if (page != INVALID_PAGE) {
+                frame_bump = (uint32_t)page << DIR_OFFSET;
+                frame_bump_end = frame_bump + USER_PAGE_SIZE;
+            }
+        }
+        if (frame_bump != frame_bump_end) {
+            frame = frame_bump;
+            frame_bump += PAGE_SIZE_4KB;
+        } else if (zero_pool_list != NO_FRAME) { /* Out of memory, fall back on the zero pool */
+            frame = zero_pool_list;
+            zero_pool_list = *(uint32_t*)PHYS_TO_VIRT(frame);
+            zero_pool_count--;
+        }
+    }
+    restore_flags(flags);
+    return frame;
+}
+
+/* uint32_t alloc_zeroed_frame()
+ * Description: Takes a clean 4KB frame. It comes from the pre-zeroed pool in O(1) when the
+ *              pool has one, so clearing stays off the latency path; otherwise it is cleared here.
+ * Inputs: None
+ * Output: None
+ * Returned Value: Physical address of the frame, or NO_FRAME when memory is exhausted
+ * Side Effects: None
+ */
+uint32_t alloc_zeroed_frame() {
+    uint32_t frame; /* Frame handed out */
+    uint32_t flags; /* Saved EFLAGS */
+    cli_and_save(flags);
+    frame = zero_pool_list;
+    if (frame != NO_FRAME) {
+        zero_pool_list = *(uint32_t*)PHYS_TO_VIRT(frame);
+        zero_pool_count--;
+    }
+    restore_flags(flags);
+    if (frame != NO_FRAME) {
+        *(uint32_t*)PHYS_TO_VIRT(frame) = 0; /* Only the list link was dirty */
+        return frame;
+    }
+    frame = alloc_frame(); /* Pool ran dry, clear one on the spot */
+    if (frame != NO_FRAME) {
+        zero_frame(frame);
+    }
+    return frame;
+}
+
+/* int32_t refill_zero_pool()
+ * Description: Clears one frame and adds it to the zero pool, if the pool is below
+ *              ZERO_POOL_TARGET. Called from places that would otherwise wait idly.
+ * Inputs: None
+ * Output: None
+ * Returned Value: 1 if a frame was added, 0 if the pool is full or memory is exhausted
+ * Side Effects: Takes a frame. Interrupts stay enabled while the frame is cleared.
+ */
+int32_t refill_zero_pool() {
+    uint32_t frame; /* Frame being cleared */
+    uint32_t flags; /* Saved EFLAGS */
+    if (zero_pool_count >= ZERO_POOL_TARGET) {
+        return 0;
+    }
+    frame = alloc_frame();
+    if (frame == NO_FRAME) {
+        return 0;
+    }
+    zero_frame(frame);
+    cli_and_save(flags);
+    *(uint32_t*)PHYS_TO_VIRT(frame) = zero_pool_list;
+    zero_pool_list = frame;
+    zero_pool_count++;
+    restore_flags(flags);
+    return 1;
+}
+
+/* void free_frame()
+ * Description: Gives a 4KB frame back to the allocator.
+ * Inputs: uint32_t frame (Physical address returned by alloc_frame)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Pushes the frame on the free list. Frames are not returned to the 4MB page pool.
+ */
+void free_frame(uint32_t frame) {
+    uint32_t flags; /* Saved EFLAGS */
+    if (frame == NO_FRAME) {
+        return;
+    }
+    cli_and_save(flags);
+    *(uint32_t*)PHYS_TO_VIRT(frame) = frame_free_list;
+    frame_free_list = frame;
+    restore_flags(flags);
+}
+
+/* uint32_t create_page_dir()
+ * Description: Creates the page directory of a new address space. The kernel part is
+ *              copied from the boot page directory, the user part starts empty.
+ * Inputs: None
+ * Output: None
+ * Returned Value: Physical address of the page directory, or NO_FRAME when memory is exhausted
+ * Side Effects: Takes a frame.
+ */
+uint32_t create_page_dir() {
+    uint32_t page_dir; /* New page directory */
+    page_dir = alloc_frame();
+    if (page_dir != NO_FRAME) {
+        memcpy(PHYS_TO_VIRT(page_dir), page_directory, PDE_SIZE);
+    }
+    return page_dir;
+}
+
+/* void destroy_page_dir()
+ * Description: Frees a page directory with its user page tables and the frames they map.
+ * Inputs: uint32_t page_dir (Physical address returned by create_page_dir)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Falls back to the boot page directory if page_dir is loaded.
+ */
+void destroy_page_dir(uint32_t page_dir) {
+    uint32_t cur_dir; /* Page directory loaded in cr3 */
+    if (page_dir == NO_FRAME) {
+        return;
+    }
+    asm volatile ("movl %%cr3, %0" : "=r" (cur_dir));
+    if (cur_dir == page_dir) { /* Never free the directory we're running on */
+        load_page_dir((uint32_t)page_directory);
+    }
+    unmap_user_range(page_dir, USER_IMAGE_START, USER_IMAGE_END); /* Image, bss and stack */
+    unmap_user_range(page_dir, USER_HEAP_START, USER_HEAP_LIMIT);
+    free_frame(page_dir);
+}
+
+/* void load_page_dir()
+ * Description: Switches to another address space. Global kernel pages stay in the TLB.
+ * Inputs: uint32_t page_dir (Physical address of the page directory)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Loads cr3, flushing non-global TLB entries.
+ */
+void load_page_dir(uint32_t page_dir) {
+    asm volatile ("movl %0, %%cr3" : : "r" (page_dir) : "memory");
+}
+
+/* int32_t map_user_page()
+ * Description: Maps a frame as a writable user page, creating its page table if needed.
+ * Inputs: uint32_t page_dir, uint32_t vaddr, uint32_t frame (Address space, any address in the page, frame)
+ * Output: None
+ * Returned Value: 0 upon success, -1 when no frame is left for the page table
+ * Side Effects: May take a frame for the page table.
+ */
+int32_t map_user_page(uint32_t page_dir, uint32_t vaddr, uint32_t frame) {
+    pde_instance* dir; /* Kernel view of the page directory */
+    pte_instance* table; /* Kernel view of the page table */
+    uint32_t table_frame; /* Frame holding a new page table */
+    dir = PHYS_TO_VIRT(page_dir);
+    if (!dir[vaddr >> DIR_OFFSET].present_4kb) { /* First page in this 4MB range */
+        table_frame = alloc_zeroed_frame();
+        if (table_frame == NO_FRAME) {
+            return -1;
+        }
+        dir[vaddr >> DIR_OFFSET].present_4kb = ON;
+        dir[vaddr >> DIR_OFFSET].read_write_4kb = ON;
+        dir[vaddr >> DIR_OFFSET].user_supervisor_4kb = ON;
+        dir[vaddr >> DIR_OFFSET].tbl_start_add_4kb = table_frame >> TBL_OFFSET;
+    }
+    table = PHYS_TO_VIRT(dir[vaddr >> DIR_OFFSET].tbl_start_add_4kb << TBL_OFFSET);
+    table[(vaddr & MASK_21_12) >> TBL_OFFSET].val = ZERO;
+    table[(vaddr & MASK_21_12) >> TBL_OFFSET].present = ON;
+    table[(vaddr & MASK_21_12) >> TBL_OFFSET].read_write = ON;
+    table[(vaddr & MASK_21_12) >> TBL_OFFSET].user_supervisor = ON;
+    table[(vaddr & MASK_21_12) >> TBL_OFFSET].page_start_add = frame >> TBL_OFFSET;
+    return 0;
+}
+
+/* uint32_t virt_to_phys()
+ * Description: Walks an address space's page tables to find where an address lives in memory.
+ *              Handles the kernel's 4MB pages as well as 4KB user pages.
+ * Inputs: uint32_t page_dir, uint32_t vaddr (Address space and address)
+ * Output: None
+ * Returned Value: The physical address, or NO_FRAME when the page is not mapped
+ * Side Effects: None
+ */
+uint32_t virt_to_phys(uint32_t page_dir, uint32_t vaddr) {
+    pde_instance* dir; /* Kernel view of the page directory */
+    pte_instance* table; /* Kernel view of the page table */
+    dir = PHYS_TO_VIRT(page_dir);
+    if (!dir[vaddr >> DIR_OFFSET].present_4kb) {
+        return NO_FRAME;
+    }
+    if (dir[vaddr >> DIR_OFFSET].page_size_4kb) { /* 4MB page */
+        return ((uint32_t)dir[vaddr >> DIR_OFFSET].page_start_add_4mb << DIR_OFFSET) | (vaddr & (USER_PAGE_SIZE - 1));
+    }
+    table = PHYS_TO_VIRT(dir[vaddr >> DIR_OFFSET].tbl_start_add_4kb << TBL_OFFSET);
+    if (!table[(vaddr & MASK_21_12) >> TBL_OFFSET].present) {
+        return NO_FRAME;
+    }
+    return ((uint32_t)table[(vaddr & MASK_21_12) >> TBL_OFFSET].page_start_add << TBL_OFFSET) | (vaddr & (PAGE_SIZE_4KB - 1));
+}
+
+/* int32_t map_zeroed_page()
+ * Description: Backs a user page with a fresh zero-filled frame.
+ * Inputs: uint32_t page_dir, uint32_t vaddr (Address space and any address in the page)
+ * Output: None
+ * Returned Value: 0 upon success, -1 when memory is exhausted
+ * Side Effects: Takes one or two frames.
+ */
+int32_t map_zeroed_page(uint32_t page_dir, uint32_t vaddr) {
+    uint32_t frame; /* Frame backing the page */
+    frame = alloc_zeroed_frame();
+    if (frame == NO_FRAME) {
+        return -1;
+    }
+    if (map_user_page(page_dir, vaddr, frame) == -1) {
+        free_frame(frame);
+        return -1;
+    }
+    return 0;
+}
+
+/* void unmap_user_range()
+ * Description: Unmaps and frees the 4KB user pages in [start, end). Page tables left empty
+ *              are freed as well. Both bounds are rounded up to a page.
+ * Inputs: uint32_t page_dir, uint32_t start, uint32_t end (Address space and range)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Frees frames and flushes their TLB entries.
+ */
+void unmap_user_range(uint32_t page_dir, uint32_t start, uint32_t end) {
+    pde_instance* dir; /* Kernel view of the page directory */
+    pte_instance* table; /* Kernel view of the page table */
+    uint32_t vaddr; /* Page being unmapped */
+    uint32_t idx; /* Index in the page table */
+    uint32_t in_use; /* Whether the page table still maps anything */
+    dir = PHYS_TO_VIRT(page_dir);
+    vaddr = (start + PAGE_SIZE_4KB - 1) & ~(PAGE_SIZE_4KB - 1);
+    end = (end + PAGE_SIZE_4KB - 1) & ~(PAGE_SIZE_4KB - 1);
+    while (vaddr < end) {
+        if (!dir[vaddr >> DIR_OFFSET].present_4kb || dir[vaddr >> DIR_OFFSET].page_size_4kb) { /* No 4KB pages here */
+            vaddr = ((vaddr >> DIR_OFFSET) + 1) << DIR_OFFSET;
+            continue;
+        }
+        table = PHYS_TO_VIRT(dir[vaddr >> DIR_OFFSET].tbl_start_add_4kb << TBL_OFFSET);
+        idx = (vaddr & MASK_21_12) >> TBL_OFFSET;
+        if (table[idx].present) {
+            free_frame(table[idx].page_start_add << TBL_OFFSET);
+            table[idx].val = ZERO;
+            asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+        }
+        vaddr += PAGE_SIZE_4KB;
+        if ((vaddr & MASK_21_12) == 0 || vaddr >= end) { /* Done with this table, free it if it is empty */
+            in_use = 0;
+            for (idx = 0; idx < NUM_PTE_ENTRIES; idx++) {
+                in_use |= table[idx].present;
+            }
+            if (!in_use) {
+                free_frame(dir[(vaddr - 1) >> DIR_OFFSET].tbl_start_add_4kb << TBL_OFFSET);
+                dir[(vaddr - 1) >> DIR_OFFSET].val = ZERO;
+            }
+        }
+    }
+}
@@ -17,11 +17,49 @@
 #define MASK_21_12  0x003FF000  /** Bitmask for bits between 21 and 12(inclusive) */ 
 #define KER_MEM_ADD 0x00400000  /* Kernal loaded at 4MB */
 #define DIR_OFFSET  22  /* Offset ofor page directory */
+#define KSTACK_MEM_ADD 0x00800000  /* Kernel stacks get their own 4MB page at 8MB */
+#define KSTACK_MEM_SIZE 0x00400000  /* Size of the kernel stack region */
+#define USER_PAGE_BASE  3  /* Memory for frames starts at 12MB (3 4MB pages), after the kernel stacks */
+#define USER_PAGE_SIZE  0x00400000  /* Frames are carved from 4MB pages */
+#define LOW_MEM_SIZE    0x00100000  /* Multiboot mem_upper counts from 1MB */
+#define INVALID_PAGE    -1  /* Returned when no 4MB page is left */
+#define PAGE_SIZE_4KB   0x1000  /* Size of a frame and of a small page */
+#define FRAMES_PER_PAGE (USER_PAGE_SIZE / PAGE_SIZE_4KB)  /* 4KB frames carved from one 4MB user page */
+#define NO_FRAME        0  /* Returned when no frame is left; frame 0 is never handed out */
+#define ZERO_POOL_TARGET 64  /* Frames kept cleared ahead of time (256KB) */
+#define DIRECT_MAP_BASE 0xC0000000  /* Physical memory is mapped for the kernel from 3GB */
+#define DIRECT_MAP_SIZE 0x20000000  /* Up to 512MB of physical memory is direct-mapped */
+#define PHYS_TO_VIRT(addr) ((void*)((uint32_t)(addr) + DIRECT_MAP_BASE))  /* Kernel pointer to a frame */
+#define MMIO_MEM_ADD    0xFEC00000  /* The 4MB page holding the IOAPIC and local APIC registers */
+#define USER_IMAGE_START 0x08000000  /* The 4MB range holding the program image, bss and stack */
+#define USER_IMAGE_END  0x08400000
+#define USER_HEAP_START 0x08800000  /* The heap starts at 136MB, right after the vidmap page */
+#define USER_HEAP_LIMIT 0x10000000  /* The break can grow up to 256MB */
+#define PF_PRESENT      0x1  /* Page fault error code: the page was present (protection fault) */
+#define PF_WRITE        0x2  /* Page fault error code: the access was a write */
+#define PF_USER         0x4  /* Page fault error code: the access came from user mode */
 
 #define PT_USER_VIDMAP_LOCATION  33  /* The page table for user vidmap is 4 * 33 = 132 MB away from start of PD */
 
  /* Function to initialize paging */
  extern void init_paging();
+ /* Function to point a terminal's user vidmap at the screen or at its backing page */
+ extern void set_vidmap_target(uint32_t terminal_id, uint32_t on_screen);
+ /* Function to hand the memory above the kernel stacks to the frame allocator */
+ extern void init_user_pages(uint32_t mem_upper_kb);
+ /* Functions to hand out 4KB frames and manage per-process page directories */
+ extern uint32_t alloc_frame();
+ extern uint32_t alloc_zeroed_frame();
+ extern int32_t refill_zero_pool();
+ extern void free_frame(uint32_t frame);
+ extern uint32_t create_page_dir();
+ extern void destroy_page_dir(uint32_t page_dir);
+ extern void load_page_dir(uint32_t page_dir);
+ extern int32_t map_user_page(uint32_t page_dir, uint32_t vaddr, uint32_t frame);
+ extern int32_t map_zeroed_page(uint32_t page_dir, uint32_t vaddr);
+ extern void unmap_user_range(uint32_t page_dir, uint32_t start, uint32_t end);
+ /* Function to translate an address through a page directory */
+ extern uint32_t virt_to_phys(uint32_t page_dir, uint32_t vaddr);
 
  #endif
 
@@ -2,22 +2,41 @@
 #include "lib.h"
 #include "i8259.h"
 
-void pit_init() {
-    uint16_t divider;
-    uint8_t lobyte;
-    uint8_t hibyte;
-    /*
-    * we want interrupt every 10ms
-    * therefore, we need 100hz frequency
-    * since we know our base frequency, we need to find divider
-    * since base_freq / divider = frequency, we need to do base_freq / freq to get divider
-    * PIT only accepts 8 bit value, we divide them into low bytes and high bytes
-    */
-    divider = BASE_FREQUENCY / PIT_FREQ;
-    //PIT only accepts 8 bit value, we divide them into low bytes and high bytes
-    lobyte = divider & 0x00FF; //we mask it wih 00FF to get lower bytes.
-    hibyte = divider >> 2*BYTE; //we want to shift it by 8 bit o get high byte
-    
+static volatile uint32_t pit_armed; /* Set while a one-shot is counting down */
+uint32_t tsc_khz; /* TSC cycles per millisecond, measured against the PIT */
+
+/* Jump table for the PIT as the scheduling clock, the fallback without an APIC */
+tick_jump_table_t pit_tick_jmptable = {
+    .set_oneshot = pit_set_oneshot,
+    .arm_before = pit_arm_before,
+    .stop = pit_stop,
+    .is_armed = pit_is_armed
+};
+
+/* uint32_t pit_read_count()
+ * Description: Latches and reads the current count of channel 0.
+ * Inputs: None
+ * Output: None
+ * Returned Value: Count left before the one-shot fires
+ * Side Effects: None
+ */
+static uint32_t pit_read_count() {
+    uint32_t lobyte;
+    uint32_t hibyte;
+    outb(PIT_LATCH_CMD, MODE_CMD_REGISTER);
+    lobyte = inb(CHANNEL_0);
+    hibyte = inb(CHANNEL_0);
+    return (hibyte << 2*BYTE) | lobyte;
+}
+
+/* void pit_load_count()
+ * Description: Puts channel 0 in one-shot mode and loads a count, which starts it.
+ * Inputs: uint32_t count (PIT input cycles, at most PIT_MAX_COUNT)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Restarts channel 0.
+ */
+static void pit_load_count(uint32_t count) {
     /* 
      * Table for Mode and Command register
      * Bits      Usage
@@ -42,15 +61,112 @@ void pit_init() {
      *           1 1 1 = Mode 3 (square wave generator, same as 011b)
      * 0         BCD/Binary mode: 0 = 16-bit binary, 1 = four-digit BCD
      */
-    outb(0x34, MODE_CMD_REGISTER); //we use channel 0, lobyte/hibyte, and mode 2, that is 0x34
-    outb(lobyte, CHANNEL_0);
-    outb(hibyte, CHANNEL_0);
+    outb(PIT_ONESHOT_CMD, MODE_CMD_REGISTER); //we use channel 0, lobyte/hibyte, and mode 0, that is 0x30
+    //PIT only accepts 8 bit value, we divide them into low bytes and high bytes
+    outb(count & 0x00FF, CHANNEL_0); //we mask it wih 00FF to get lower bytes.
+    outb((count >> 2*BYTE) & 0x00FF, CHANNEL_0); //counting starts once the high byte is in
+}
+
+/* void pit_busy_wait()
+ * Description: Spins until channel 0 has counted down the given number of input cycles. Other
+ *              clocks are calibrated by reading them before and after.
+ * Inputs: uint32_t count (PIT input cycles, below PIT_MAX_COUNT)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Restarts channel 0, which then keeps counting.
+ */
+void pit_busy_wait(uint32_t count) {
+    pit_load_count(PIT_MAX_COUNT);
+    while (pit_read_count() > PIT_MAX_COUNT - count) {
+    }
+}
+
+/* void pit_init()
+ * Description: Measures the TSC rate against channel 0, then leaves the channel stopped.
+ *              Ticks are requested one at a time with pit_set_oneshot().
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Busy-waits PIT_CALIBRATE_MS. Enables the PIT IRQ.
+ */
+void pit_init() {
+    uint32_t start;
+    uint32_t end;
+    start = (uint32_t)rdtsc(); /* The calibration is short enough for the low half */
+    pit_busy_wait(PIT_CALIBRATE_COUNT);
+    end = (uint32_t)rdtsc();
+    tsc_khz = (end - start) / PIT_CALIBRATE_MS;
+    pit_stop();
     enable_irq(PIT_IRQ);
 
     return;
 }
 
+/* void pit_set_oneshot()
+ * Description: Asks for one timer interrupt after the given number of PIT input cycles,
+ *              replacing any that is pending. Longer delays fire early at PIT_MAX_COUNT,
+ *              the handler's caller re-arms for the rest.
+ * Inputs: uint32_t count (PIT input cycles)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Restarts channel 0.
+ */
+void pit_set_oneshot(uint32_t count) {
+    if (count > PIT_MAX_COUNT) {
+        count = PIT_MAX_COUNT;
+    }
+    if (count == 0) { /* A count of 0 would mean 65536 */
+        count = 1;
+    }
+    pit_armed = 1;
+    pit_load_count(count);
+}
+
+/* void pit_stop()
+ * Description: Cancels the pending timer interrupt, if any.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Channel 0 holds until the next count is loaded.
+ */
+void pit_stop() {
+    pit_armed = 0;
+    outb(PIT_ONESHOT_CMD, MODE_CMD_REGISTER); /* A new mode word stops the count */
+}
+
+/* void pit_arm_before()
+ * Description: Makes sure a timer interrupt comes within the given number of PIT input cycles,
+ *              keeping a pending one that comes sooner.
+ * Inputs: uint32_t count (PIT input cycles)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: May restart channel 0. Called with interrupts off.
+ */
+void pit_arm_before(uint32_t count) {
+    if (!pit_armed || count < pit_read_count()) {
+        pit_set_oneshot(count);
+    }
+}
+
+/* uint32_t pit_is_armed()
+ * Description: Tells whether a timer interrupt is pending.
+ * Inputs: None
+ * Output: None
+ * Returned Value: 1 if a one-shot is counting down, 0 otherwise
+ * Side Effects: None
+ */
+uint32_t pit_is_armed() {
+    return pit_armed;
+}
+
 void pit_handler() {
+    uint32_t prev_mode; /* Accounting mode of the interrupted task */
+    lock_kernel();
+    prev_mode = account_mode(ACCT_IRQ);
+    send_eoi(PIT_IRQ); /* Acknowledge first, scheduler() may not return to this task for a while */
+    pit_armed = 0; /* One-shot: nothing more comes until the scheduler asks again */
+    irq_call(run_timers); /* Timer callbacks run on the interrupt stack, the switch on the task's */
+    account_mode(prev_mode); /* The switch itself is charged as the task's own time */
     scheduler();
+    unlock_kernel();
 }
-
@@ -7,9 +7,24 @@
 #define MODE_CMD_REGISTER 0x43
 #define CHANNEL_0 0x40
 #define PIT_IRQ 0x00
-#define PIT_FREQ 100
+#define PIT_LATCH_CMD 0x00 /* Latch channel 0's count for reading */
+#define PIT_ONESHOT_CMD 0x30 /* Channel 0, lobyte/hibyte, mode 0 (interrupt on terminal count) */
+#define PIT_MAX_COUNT 0xFFFF /* Longest one-shot, about 55ms */
+#define PIT_COUNTS_PER_MS (BASE_FREQUENCY / 1000)
+#define PIT_CALIBRATE_MS 10 /* How long pit_init() measures the TSC */
+#define PIT_CALIBRATE_COUNT (PIT_CALIBRATE_MS * PIT_COUNTS_PER_MS)
+
+extern uint32_t tsc_khz;
+extern tick_jump_table_t pit_tick_jmptable;
 
 extern void pit_init(void);
 extern void pit_handler(void);
+/* Spins for a number of PIT input cycles */
+extern void pit_busy_wait(uint32_t count);
+/* One-shot timer interrupts */
+extern void pit_set_oneshot(uint32_t count);
+extern void pit_arm_before(uint32_t count);
+extern void pit_stop(void);
+extern uint32_t pit_is_armed(void);
 
 #endif
@@ -1,4 +1,5 @@
 #include "rtc.h"
+#include "scheduler.h"
 #include "lib.h"
 
 /* Jump table for fs abstraction when dealing rtc */
@@ -9,6 +10,9 @@ fs_jump_table_t rtc_jmptable = {
     .write = rtc_write
 };
 
+static wait_queue_t rtc_queue; /* Tasks in rtc_read waiting for the next interrupt */
+static spinlock_t rtc_lock = SPIN_LOCK_UNLOCKED("rtc"); /* CMOS index port and the interrupt flag */
+
 /*
  * rtc_init()
  * Description: Initialize RTC and turn on real time clock interrupt 
@@ -28,16 +32,34 @@ void rtc_init() {
 }
 
 /*
- * RTC_INTERRUPT()
- * DESCRIPTION: RTC interrupt handler
+ * rtc_interrupt()
+ * DESCRIPTION: body of the RTC interrupt handler, run on the interrupt stack
  * INPUT: NONE
  * OUTPUT: NONE
  */
-void rtc_handler(void) {
+static void rtc_interrupt(void) {
+    spin_lock(&rtc_lock); /* Interrupts are off already */
     outb(REGISTER_C_NMI, RTC_PORT);
     inb(CMOS_PORT);
     //set interrupt occured flag. record that interrupt happened
     rtc_interrupt_occured = 1;
+    wake_up(&rtc_queue);
+    spin_unlock(&rtc_lock);
+}
+
+/*
+ * RTC_INTERRUPT()
+ * DESCRIPTION: RTC interrupt handler
+ * INPUT: NONE
+ * OUTPUT: NONE
+ */
+void rtc_handler(void) {
+    uint32_t prev_mode; /* Accounting mode of the interrupted task */
+    lock_kernel();
+    prev_mode = account_mode(ACCT_IRQ);
+    irq_call(rtc_interrupt);
+    account_mode(prev_mode);
+    unlock_kernel();
     return;
 }
 
@@ -46,17 +68,23 @@ void rtc_handler(void) {
 * description: read from rtc register and process the datas.
 * input: fd, buf, nbytes
 * output: none
-* return value: 0 when success
+* return value: 0 when success, -1 when the thread was killed while waiting
 * side effect: wait for interrupt change to one
 */
 int32_t rtc_read(int32_t* fd, uint32_t* offset,  char* buf, uint32_t nbytes) {
-
+    uint32_t flags;     //saved EFLAGS
+    spin_lock_irqsave(&rtc_lock, flags);
     rtc_interrupt_occured = 0;  //set flag to 0, this means no interrupt occur
     //use while loop to wait until interrupt handler sets the flag
-    sti();
-    while (!rtc_interrupt_occured){}
-    cli();
+    while (!rtc_interrupt_occured){
+        if (thread_killed()) { /* The process exited, stop waiting */
+            spin_unlock_irqrestore(&rtc_lock, flags);
+            return -1;
+        }
+        sleep_on_locked(&rtc_queue, &rtc_lock); /* The RTC handler wakes us */
+    }
     rtc_interrupt_occured = 0;  //clear the flag back to 0
+    spin_unlock_irqrestore(&rtc_lock, flags);
     return 0;
 }
 
@@ -73,6 +101,7 @@ int32_t rtc_write(int32_t* fd, uint32_t* offset, const char* buf, uint32_t nbyte
     int i;          //loop index
     int rate;       //rate of RTC, freq = 32768 >> (rate - 1)
     char prev;
+    uint32_t flags;     //saved EFLAGS
 
     uint8_t mask_low = 0x01;
     //if buf is null, return -1
@@ -107,11 +136,12 @@ int32_t rtc_write(int32_t* fd, uint32_t* offset, const char* buf, uint32_t nbyte
     rate = 16 - rate;       //get rate for RTC
 
     rate &= LOW_BYTE;			// rate must be above 2 and not over 15
-    cli();
+    spin_lock_irqsave(&rtc_lock, flags);	// the handler selects register C through the same port
     outb(REGISTER_A, RTC_PORT);		// set index to register A, disable NMI
     prev=inb(CMOS_PORT);	// get initial value of register A
     outb(REGISTER_A, RTC_PORT);		// reset index to A
     outb((prev & HIGH_BYTE) | rate, CMOS_PORT); //write only our rate to A. Note, rate is the bottom 4 bits.
+    spin_unlock_irqrestore(&rtc_lock, flags);
 
     return BYTE;
 }
@@ -124,14 +154,16 @@ int32_t rtc_write(int32_t* fd, uint32_t* offset, const char* buf, uint32_t nbyte
 */
 int32_t rtc_open(int32_t* fd, char* filename) {
     int rate, prev;
+    uint32_t flags;     //saved EFLAGS
 
     rate = MAX_RATE;
     rate &= LOW_BYTE;			// rate must be above 2 and not over 15
-    cli();
+    spin_lock_irqsave(&rtc_lock, flags);	// the handler selects register C through the same port
     outb(REGISTER_A, RTC_PORT);		// set index to register A, disable NMI
     prev=inb(CMOS_PORT);	// get initial value of register A
     outb(REGISTER_A, RTC_PORT);		// reset index to A
     outb((prev & HIGH_BYTE) | rate, CMOS_PORT); //write only our rate to A. Note, rate is the bottom 4 bits.
+    spin_unlock_irqrestore(&rtc_lock, flags);
 
     return 0;
 }
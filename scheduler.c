@@ -1,90 +1,891 @@
 #include "scheduler.h"
-/* void scheduler()
- * Description: A function to switch running process periodically.
+#include "task_switch.h"
+#include "kthread.h"
+#include "fpu.h"
+
+/* Each processor has its own idle task and run queue, in cpus[]. Every function here runs
+ * under the big kernel lock, so one processor may look at another's run queue. */
+
+/* Load weight of each nice level, NICE_MIN first. Each level is about 1.25 times the next,
+ * so one nice step moves about 10% of the processor between two competing tasks. */
+static const uint32_t nice_to_weight[SCHED_NUM_PRIO] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+  9548, 7620, 6100, 4904, 3906,
+  3121, 2501, 1991, 1586, 1277,
+  1024, 820, 655, 526, 423,
+  335, 272, 215, 172, 137,
+  110, 87, 70, 56, 45,
+  36, 29, 23, 18, 15
+};
+
+/* pcb_t* current_task()
+ * Description: Finds the task on this processor. No process running means the idle task runs,
+ *              once cpu_idle() has started it.
+ * Inputs: None
+ * Output: None
+ * Returned Value: The running task, or NULL while booting
+ * Side Effects: None
+ */
+pcb_t* current_task() {
+  pcb_t* cur_pcb; /* Running process */
+  cpu_t* cpu; /* This processor */
+  cpu = this_cpu();
+  cur_pcb = get_active_pcb();
+  if (!cur_pcb && cpu -> idle_task.existent) {
+    cur_pcb = &cpu -> idle_task;
+  }
+  return cur_pcb;
+}
+
+/* uint32_t is_idle_task()
+ * Description: Tells whether a task is this processor's idle task.
+ * Inputs: pcb_t* pcb (The task)
+ * Output: None
+ * Returned Value: 1 if it is, 0 otherwise
+ * Side Effects: None
+ */
+static uint32_t is_idle_task(pcb_t* pcb) {
+  return pcb == &this_cpu() -> idle_task;
+}
+
+/* void account_charge()
+ * Description: Charges the cycles since the last accounting event to the running task, as
+ *              user, system or interrupt time depending on what it was doing.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off.
+ */
+static void account_charge() {
+  uint64_t now; /* Current TSC */
+  uint64_t delta; /* Cycles to charge */
+  pcb_t* cur_pcb; /* Running task */
+  cpu_t* cpu; /* This processor */
+  cpu = this_cpu();
+  now = rdtsc();
+  delta = now - cpu -> acct_stamp;
+  cpu -> acct_stamp = now;
+  cur_pcb = current_task();
+  if (!cur_pcb || is_idle_task(cur_pcb)) { /* Idle time is counted apart */
+    return;
+  }
+  if (cur_pcb -> acct_mode == ACCT_USER) {
+    cur_pcb -> utime += delta;
+  } else if (cur_pcb -> acct_mode == ACCT_IRQ) {
+    cur_pcb -> irqtime += delta;
+  } else {
+    cur_pcb -> stime += delta;
+  }
+}
+
+/* uint32_t account_mode()
+ * Description: Records a kernel entry or exit: charges the time so far in the old mode and
+ *              switches the running task to the new one. Called by syscall_wrapper, the
+ *              fault wrapper, user_entry and the interrupt handlers; the value returned on
+ *              entry is passed back on exit, so nested entries unwind correctly.
+ * Inputs: uint32_t mode (ACCT_USER, ACCT_SYSTEM or ACCT_IRQ)
+ * Output: None
+ * Returned Value: The previous mode
+ * Side Effects: None
+ */
+uint32_t account_mode(uint32_t mode) {
+  uint32_t flags; /* Saved EFLAGS */
+  uint32_t prev_mode; /* Mode before */
+  pcb_t* cur_pcb; /* Running task */
+  cli_and_save(flags);
+  account_charge();
+  prev_mode = ACCT_SYSTEM;
+  cur_pcb = current_task();
+  if (cur_pcb) {
+    prev_mode = cur_pcb -> acct_mode;
+    cur_pcb -> acct_mode = mode;
+  }
+  restore_flags(flags);
+  return prev_mode;
+}
+
+/* void get_task_stat()
+ * Description: Reports a task's CPU time and switch counts, up to date for the running task.
+ * Inputs: pcb_t* pcb (The task), task_stat_t* stat (Filled in)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+void get_task_stat(pcb_t* pcb, task_stat_t* stat) {
+  uint32_t flags; /* Saved EFLAGS */
+  cli_and_save(flags);
+  account_charge();
+  stat -> tsc_khz = tsc_khz;
+  stat -> nvcsw = pcb -> nvcsw;
+  stat -> nivcsw = pcb -> nivcsw;
+  stat -> min_flt = pcb -> min_flt;
+  stat -> maj_flt = pcb -> maj_flt;
+  stat -> utime = pcb -> utime;
+  stat -> stime = pcb -> stime;
+  stat -> irqtime = pcb -> irqtime;
+  restore_flags(flags);
+}
+
+/* void end_halt()
+ * Description: Adds the time since the idle task halted to the idle cycle count.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off.
+ */
+static void end_halt() {
+  cpu_t* cpu; /* This processor */
+  cpu = this_cpu();
+  if (cpu -> halt_start) {
+    cpu -> idle_cycles += rdtsc() - cpu -> halt_start;
+    cpu -> halt_start = 0;
+  }
+}
+
+/* uint32_t task_weight()
+ * Description: Looks up a task's load weight from its nice value.
+ * Inputs: pcb_t* pcb (The task)
+ * Output: None
+ * Returned Value: Weight, NICE_0_WEIGHT at nice 0
+ * Side Effects: None
+ */
+static uint32_t task_weight(pcb_t* pcb) {
+  return nice_to_weight[pcb -> nice - NICE_MIN];
+}
+
+/* void update_min_vruntime()
+ * Description: Moves min_vruntime up to the smallest vruntime among the running task and the
+ *              queued ones. It never moves back, so it can place waking tasks.
+ * Inputs: pcb_t* cur_pcb (Running task)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off.
+ */
+static void update_min_vruntime(pcb_t* cur_pcb) {
+  uint64_t vruntime; /* Smallest vruntime around */
+  uint32_t running; /* Whether cur_pcb counts */
+  cpu_t* cpu; /* This processor */
+  cpu = this_cpu();
+  running = (!is_idle_task(cur_pcb) && cur_pcb -> state == TASK_RUNNABLE);
+  if (cpu -> nr_queued) {
+    vruntime = cpu -> run_heap[0] -> vruntime;
+    if (running && cur_pcb -> vruntime < vruntime) {
+      vruntime = cur_pcb -> vruntime;
+    }
+  } else if (running) {
+    vruntime = cur_pcb -> vruntime;
+  } else {
+    return;
+  }
+  if (vruntime > cpu -> min_vruntime) {
+    cpu -> min_vruntime = vruntime;
+  }
+}
+
+/* void update_curr()
+ * Description: Charges the running task for the cycles since it was last charged. Its vruntime
+ *              grows by the cycles scaled by NICE_0_WEIGHT over its weight, so heavier tasks
+ *              age slower and get a bigger share.
+ * Inputs: pcb_t* cur_pcb (Running task)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off.
+ */
+static void update_curr(pcb_t* cur_pcb) {
+  uint64_t now; /* Current TSC */
+  uint32_t delta; /* Cycles to charge */
+  now = rdtsc();
+  if (is_idle_task(cur_pcb)) { /* Idle time is counted apart */
+    return;
+  }
+  delta = (now - cur_pcb -> exec_start > SCHED_MAX_DELTA) ? SCHED_MAX_DELTA : (uint32_t)(now - cur_pcb -> exec_start);
+  cur_pcb -> exec_start = now;
+  cur_pcb -> sum_exec += delta;
+  if (task_weight(cur_pcb) == NICE_0_WEIGHT) {
+    cur_pcb -> vruntime += delta;
+  } else {
+    cur_pcb -> vruntime += div_u64_u32((uint64_t)delta * NICE_0_WEIGHT, task_weight(cur_pcb));
+  }
+  update_min_vruntime(cur_pcb);
+}
+
+/* uint32_t task_slice()
+ * Description: Length of a task's time slice: its weight's share of SCHED_LATENCY_COUNT among
+ *              itself and the tasks queued on this processor, at least SCHED_MIN_GRAN_COUNT.
+ * Inputs: pcb_t* pcb (The task)
+ * Output: None
+ * Returned Value: Slice in PIT input cycles
+ * Side Effects: None
+ */
+static uint32_t task_slice(pcb_t* pcb) {
+  uint32_t slice; /* Share of the latency */
+  slice = SCHED_LATENCY_COUNT * task_weight(pcb) / (this_cpu() -> queued_weight + task_weight(pcb));
+  return (slice < SCHED_MIN_GRAN_COUNT) ? SCHED_MIN_GRAN_COUNT : slice;
+}
+
+/* void program_next_tick()
+ * Description: Tickless operation: a timer interrupt is only needed to end the running task's
+ *              time slice when another task waits for the processor, or when a kernel timer
+ *              is due. Otherwise the timer stays off.
+ * Inputs: pcb_t* next_pcb (Task about to run)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Reprograms the tick device. Called with interrupts off.
+ */
+static void program_next_tick(pcb_t* next_pcb) {
+  uint32_t count; /* PIT input cycles until the next interrupt, 0 for none */
+  uint32_t timer_count; /* Same, for the timer wheel */
+  count = this_cpu() -> nr_queued ? task_slice(next_pcb) : 0; /* A fresh slice for whoever runs next */
+  timer_count = timer_next_count();
+  if (timer_count && (!count || timer_count < count)) {
+    count = timer_count;
+  }
+  if (count) {
+    tick_device -> set_oneshot(count);
+  } else if (tick_device -> is_armed()) {
+    tick_device -> stop();
+  }
+}
+
+/* void heap_push()
+ * Description: Adds a task to a processor's run queue, a binary min-heap ordered by vruntime.
+ * Inputs: cpu_t* cpu (Processor), pcb_t* pcb (Task to queue; must not be running or queued already)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Updates the run queue. Called with interrupts off.
+ */
+static void heap_push(cpu_t* cpu, pcb_t* pcb) {
+  uint32_t idx; /* Hole being moved up */
+  uint32_t parent; /* Its parent */
+  pcb -> state = TASK_RUNNABLE;
+  pcb -> cpu = cpu -> id;
+  idx = cpu -> nr_queued++;
+  while (idx > 0) { /* Sift up */
+    parent = (idx - 1) / 2;
+    if (cpu -> run_heap[parent] -> vruntime <= pcb -> vruntime) {
+      break;
+    }
+    cpu -> run_heap[idx] = cpu -> run_heap[parent];
+    idx = parent;
+  }
+  cpu -> run_heap[idx] = pcb;
+  cpu -> queued_weight += task_weight(pcb);
+}
+
+/* pcb_t* heap_pop()
+ * Description: Takes the task with the smallest vruntime off a processor's run queue.
+ * Inputs: cpu_t* cpu (Processor)
+ * Output: None
+ * Returned Value: The task, or NULL when the run queue is empty
+ * Side Effects: Updates the run queue. Called with interrupts off.
+ */
+static pcb_t* heap_pop(cpu_t* cpu) {
+  pcb_t* pcb; /* Task taken */
+  pcb_t* last; /* Task moved into the hole */
+  uint32_t idx; /* Hole being moved down */
+  uint32_t child; /* Smaller child of the hole */
+  pcb_t** heap; /* The processor's run queue */
+  if (!cpu -> nr_queued) {
+    return NULL;
+  }
+  heap = cpu -> run_heap;
+  pcb = heap[0];
+  last = heap[--cpu -> nr_queued];
+  idx = 0;
+  while ((child = 2 * idx + 1) < cpu -> nr_queued) { /* Sift down */
+    if (child + 1 < cpu -> nr_queued && heap[child + 1] -> vruntime < heap[child] -> vruntime) {
+      child++;
+    }
+    if (last -> vruntime <= heap[child] -> vruntime) {
+      break;
+    }
+    heap[idx] = heap[child];
+    idx = child;
+  }
+  heap[idx] = last;
+  cpu -> queued_weight -= task_weight(pcb);
+  return pcb;
+}
+
+/* void migrate_vruntime()
+ * Description: Moves a task's vruntime from the clock of the processor it last ran on to this
+ *              one's, keeping its lead or lag on that processor's min_vruntime. A lag is capped
+ *              at the largest wake-up credit, so a stolen task can't starve the tasks queued here.
+ * Inputs: pcb_t* pcb (Task arriving on this processor)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off.
+ */
+void migrate_vruntime(pcb_t* pcb) {
+  cpu_t* cpu; /* This processor */
+  uint64_t old_min; /* min_vruntime where the task comes from */
+  uint64_t lag; /* How far the task is behind old_min */
+  cpu = this_cpu();
+  if (pcb -> cpu == cpu -> id) {
+    return;
+  }
+  old_min = cpus[pcb -> cpu].min_vruntime;
+  if (pcb -> vruntime >= old_min) {
+    pcb -> vruntime = cpu -> min_vruntime + (pcb -> vruntime - old_min);
+  } else {
+    lag = old_min - pcb -> vruntime;
+    if (lag > (uint64_t)SCHED_MAX_CREDIT_MS * tsc_khz) {
+      lag = (uint64_t)SCHED_MAX_CREDIT_MS * tsc_khz;
+    }
+    pcb -> vruntime = (cpu -> min_vruntime > lag) ? cpu -> min_vruntime - lag : 0;
+  }
+  pcb -> cpu = cpu -> id;
+}
+
+/* void kick_idle_cpu()
+ * Description: Wakes a processor that has nothing to run, so it steals the work just queued here.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: May send a reschedule IPI.
+ */
+static void kick_idle_cpu() {
+  uint32_t idx; /* Processor looked at */
+  cpu_t* cpu; /* This processor */
+  cpu = this_cpu();
+  for (idx = 0; idx < nr_cpus; idx++) {
+    if (&cpus[idx] != cpu && cpus[idx].idle_task.existent &&
+        cpus[idx].running_pid == INVALID_PID && !cpus[idx].nr_queued) {
+      smp_send_resched(&cpus[idx]);
+      return;
+    }
+  }
+}
+
+/* void enqueue_woken()
+ * Description: Queues a task that was not runnable on this processor. Its vruntime is brought
+ *              up to within a wake-up credit of min_vruntime, so a long sleep doesn't buy a long
+ *              run. If it is then clearly behind the running task, the running task gets
+ *              preempted; otherwise an idle processor is asked to take it.
+ * Inputs: pcb_t* pcb (Task to queue; must not be running or queued already),
+ *         uint32_t credit_ms (How far behind min_vruntime it may start)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Updates the run queue. May reprogram the tick device or send an IPI.
+ */
+static void enqueue_woken(pcb_t* pcb, uint32_t credit_ms) {
+  uint32_t flags; /* Saved EFLAGS */
+  pcb_t* cur_pcb; /* Running task */
+  uint64_t floor; /* Smallest vruntime the task may start with */
+  cpu_t* cpu; /* This processor, whose queue the task joins */
+  cli_and_save(flags);
+  cpu = this_cpu();
+  migrate_vruntime(pcb);
+  floor = cpu -> min_vruntime - (uint64_t)credit_ms * tsc_khz;
+  if (floor > cpu -> min_vruntime) { /* Early on, min_vruntime is smaller than the credit */
+    floor = 0;
+  }
+  if (pcb -> vruntime < floor) {
+    pcb -> vruntime = floor;
+  }
+  heap_push(cpu, pcb);
+  cur_pcb = current_task();
+  if (cur_pcb) {
+    update_curr(cur_pcb);
+  }
+  if ((cur_pcb && is_idle_task(cur_pcb)) || (cur_pcb && cur_pcb != pcb &&
+      pcb -> vruntime + (uint64_t)SCHED_WAKEUP_GRAN_MS * tsc_khz < cur_pcb -> vruntime)) {
+    tick_device -> set_oneshot(1); /* Preempt as soon as we can */
+  } else if (cur_pcb) { /* The running task may have had the processor to itself, start its slice now */
+    tick_device -> arm_before(task_slice(cur_pcb));
+    kick_idle_cpu(); /* Busy here, maybe another processor can take it */
+  }
+  restore_flags(flags);
+}
+
+/* void enqueue_task()
+ * Description: Makes a task runnable and puts it on the run queue.
+ * Inputs: pcb_t* pcb (Task to queue; must not be running or queued already)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Updates the run queue. May reprogram the tick device.
+ */
+void enqueue_task(pcb_t* pcb) {
+  enqueue_woken(pcb, SCHED_WAKE_CREDIT_MS);
+}
+
+/* void sched_fork()
+ * Description: Starts a new task's accounting. It begins at min_vruntime, level with the tasks
+ *              already running.
+ * Inputs: pcb_t* pcb (The new task)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+void sched_fork(pcb_t* pcb) {
+  pcb -> vruntime = this_cpu() -> min_vruntime;
+  pcb -> cpu = this_cpu() -> id;
+  pcb -> lock_depth = 1; /* Holds the kernel lock until user_entry irets */
+  pcb -> sum_exec = 0;
+  pcb -> exec_start = rdtsc();
+  pcb -> acct_mode = ACCT_SYSTEM; /* Until user_entry irets to user mode */
+  pcb -> utime = 0;
+  pcb -> stime = 0;
+  pcb -> irqtime = 0;
+  pcb -> nvcsw = 0;
+  pcb -> nivcsw = 0;
+}
+
+/* pcb_t* steal_task()
+ * Description: Takes the most deserving task from the processor with the longest run queue.
+ * Inputs: None
+ * Output: None
+ * Returned Value: The task, or NULL when no processor has one queued
+ * Side Effects: Moves the task to this processor. Called with interrupts off.
+ */
+static pcb_t* steal_task() {
+  uint32_t idx; /* Processor looked at */
+  cpu_t* busiest; /* Longest run queue so far */
+  pcb_t* pcb; /* Task taken */
+  busiest = NULL;
+  for (idx = 0; idx < nr_cpus; idx++) {
+    if (cpus[idx].nr_queued && (!busiest || cpus[idx].nr_queued > busiest -> nr_queued)) {
+      busiest = &cpus[idx];
+    }
+  }
+  if (!busiest) {
+    return NULL;
+  }
+  pcb = heap_pop(busiest);
+  migrate_vruntime(pcb);
+  return pcb;
+}
+
+/* pcb_t* pick_next_task()
+ * Description: Takes the next task to run from this processor's run queue. When it is empty
+ *              a task is stolen from another processor, and when every task sleeps or runs
+ *              elsewhere the idle task runs.
  * Inputs: None
- * Output: Switches running process every 15 ms
+ * Output: None
+ * Returned Value: The task to run
+ * Side Effects: Called with interrupts off.
+ */
+static pcb_t* pick_next_task() {
+  pcb_t* next_pcb; /* Task to run */
+  next_pcb = heap_pop(this_cpu());
+  if (!next_pcb) {
+    next_pcb = steal_task();
+  }
+  if (!next_pcb) {
+    next_pcb = &this_cpu() -> idle_task;
+  }
+  return next_pcb;
+}
+
+/* void switch_to_task()
+ * Description: Makes next_pcb the running task on this processor: points the processor's TSS
+ *              at its kernel stack, arms its time slice and calls switch_to(), which swaps the
+ *              address space and the registers. Each terminal has its own vidmap page table,
+ *              so nothing needs remapping.
+ * Inputs: pcb_t* prev_pcb (Task giving up the processor), pcb_t* next_pcb
+ * Output: None
+ * Returned Value: None (returns when prev_pcb is switched back to)
+ * Side Effects: Changes running_process_id and running_terminal.
+ */
+static void switch_to_task(pcb_t* prev_pcb, pcb_t* next_pcb) {
+  cpu_t* cpu; /* This processor */
+  cpu = this_cpu();
+  end_halt(); /* The idle task may be leaving from inside its hlt */
+  account_charge(); /* prev_pcb's time up to the switch */
+  if (next_pcb == &cpu -> idle_task) { /* Kernel only: keep the terminal and the loaded address space */
+    running_process_id = INVALID_PID;
+  } else {
+    running_process_id = next_pcb -> cur_pid; /* Update running pid */
+    running_terminal = next_pcb -> terminal_id; /* The terminal follows the task, not the other way round */
+    cpu -> tss -> esp0 = next_pcb -> context.esp0;
+    next_pcb -> exec_start = rdtsc();
+  }
+  program_next_tick(next_pcb);
+  fpu_switch_out(prev_pcb); /* next_pcb starts with TS set and loads its registers on first use */
+  prev_pcb = switch_to(prev_pcb, next_pcb);
+  finish_task_switch(prev_pcb); /* prev_pcb is now whoever ran right before us */
+}
+
+/* void finish_task_switch()
+ * Description: Runs on the new task right after every switch. A task that halted can't free
+ *              its own kernel stack and address space while still on them, so it is freed here.
+ * Inputs: pcb_t* prev_pcb (Task switched away from)
+ * Output: None
  * Returned Value: None
- * Side Effects: Performs periodical running process switch
+ * Side Effects: May free a pid. Called with interrupts off, also from user_entry.
  */
+void finish_task_switch(pcb_t* prev_pcb) {
+  if (prev_pcb -> state == TASK_DEAD) {
+    prev_pcb -> state = TASK_RUNNABLE;
+    free_pid(prev_pcb -> cur_pid);
+  }
+}
 
+/* void scheduler()
+ * Description: Charges the running task, then switches to the queued task with the smallest
+ *              vruntime. A preempted running task goes back on the queue and keeps running if
+ *              it is still the furthest behind. A sleeping task stays off the queue. The idle
+ *              task runs when nothing else can and is never queued. Does nothing until
+ *              cpu_idle() starts. Preemption waits while the processor holds a spinlock.
+ *              A thread killed by its process's exit ends here when preempted or yielding,
+ *              before or after waiting for its turn.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Performs the running process switch. Called with interrupts off.
+ */
 void scheduler() {
   pcb_t* cur_pcb; /* PCB of current process */
-  pcb_t* next_pcb; /* PCB in next terminal */
-  //pcb_t tmp_pcb; /* Temporary pcb */
-  uint32_t esp;
-  uint32_t ebp;
-  uint32_t dir_idx; /* Index in page directory */
-  cur_pcb = term[running_terminal].pcb; /* Retrieve current PID */
-  uint32_t kernel_stack_start_address; /* The starting address of the kernel stack */
-  uint32_t kmode_stack; /* Process's kernel-mode stack address */
-  uint32_t vm_idx; /* Vid. Mem. index */
-
-  /*-------------------------------step 1: get current esp and ebp----------------------------------*/
-  asm volatile ( /* Get current esp */
-    "movl %%esp, %0     ;"
-    : "=r" (esp) /* Output : esp. No inputs. Not clobbering */
-  );
-  cur_pcb -> cur_esp = esp; /* Load esp */
-  asm volatile ( /* Get current ebp */
-    "movl %%ebp, %0     ;"
-    : "=r" (ebp) /* Output : ebp. No inputs. Not clobbering */
-  );
-  cur_pcb -> cur_ebp = ebp; /* Load ebp */
-
-
-  /*---------------------------step 2: deal with base terminal condition------------------------------*/
-  running_terminal = (running_terminal + 1) % TERM_NUM; /* Round Robin running terminal switch */
-  if (!(term[running_terminal].pcb)) { /* See if new terminal has no process. If so, wait until next interrupt */
-    switch_terminal(running_terminal); /* Switch to running terminal for process initialization */
-    send_eoi(PIT_IRQ); /* Function in reality doesn't return after execute process */
-    running_process_id = INVALID_PID;
-    execute((uint8_t *)"shell"); /* Start a new shell program */
-  }
-
-
-  /*-----------------------------------step 3: deal with paging---------------------------------------*/
-  running_process_id = term[running_terminal].pcb -> cur_pid; /* Update running pid */
-  next_pcb = term[running_terminal].pcb; /* Get next pcb */
-  /* Remap Video Memory */
-  dir_idx = (uint32_t) PROGRAM_IMG_ADDRESS >> DIR_OFFSET; /* Get the current page_dir entry */
-  page_directory[dir_idx].present_4mb = 1; /* Mark Presense */
-  page_directory[dir_idx].read_write_4mb = 1; /* Read and write */
-  page_directory[dir_idx].user_supervisor_4mb = 1; /* Mark User-Accessible */
-  page_directory[dir_idx].page_size_4mb = 1; /* 4 MB page */
-  page_directory[dir_idx].page_start_add_4mb = PROCESS_BASE_ADDRESS + running_process_id; /* Physical address */
-  vm_idx = ((VID_MEM_ADD & MASK_21_12) >> TBL_OFFSET); /* Get video memory index */
-  if (visible_terminal == running_terminal) {/* Process is on screen */
-    page_table[vm_idx].page_start_add = vm_idx;
-    user_vidmap_page_table[vm_idx].page_start_add = vm_idx; /* Load page address */
-    user_vidmap_page_table[vm_idx].present = 1; /* Mark presense */
-  } else { /* Process not on screen */
-    page_table[vm_idx].page_start_add = vm_idx + 1 + next_pcb -> terminal_id; /* Put it in subsequent mem. */
-    user_vidmap_page_table[vm_idx].page_start_add = vm_idx + 1 + next_pcb -> terminal_id; /* Update user video mapping PT */
-    user_vidmap_page_table[vm_idx].present = 1; /* Mark Presense */
-  }
-  asm volatile ( /* Flush the TLB by writing to register cr3 */
-    "movl %%cr3, %%eax     ;"
-    "movl %%eax, %%cr3     ;"
-    : /* No outputs */
-    : /* No inputs */
-    : "eax", "cc"  /* Clobbers */
-    );
-
-
-  /*------------------------------------step 4: context switch--------------------------------------*/
-  tss.ss0 = KERNEL_DS;
-  kernel_stack_start_address = KERNEL_START_ADD + KERNEL_PAGE_SIZE; /* place the first task's kernel stak at the bottom of the 4 MB kernel page */
-  kmode_stack = kernel_stack_start_address - (next_pcb -> cur_pid) * PCB_STACK_SIZE; /* Stack add. */
-  tss.esp0 = kmode_stack - FOUR_BYTES; /* Modify esp0 of task state segment */
-  send_eoi(PIT_IRQ); /* Not literally returning, send eoi now */
-  asm volatile ( /* Switch to next process */
-    "movl %0, %%esp     ;"
-    "movl %1, %%ebp     ;"
-    : /* No Outputs */
-    : "r" (next_pcb -> cur_esp), "r" (next_pcb -> cur_ebp) /* Inputs : esp and ebp */
-    : "esp", "ebp" /* Clobbers */
-  );
-  return;
+  pcb_t* next_pcb; /* PCB of the next process */
+  cpu_t* cpu; /* This processor */
+  uint32_t preempted; /* Set when cur_pcb gives up the processor still runnable */
+  cpu = this_cpu();
+  cur_pcb = current_task();
+  if (!cur_pcb) { /* Still booting, there is no context to switch from */
+    return;
+  }
+  update_curr(cur_pcb);
+  if (cpu -> preempt_count && cur_pcb -> state == TASK_RUNNABLE && !cpu -> yield_pending) {
+    cpu -> need_resched = 1; /* A spinlock is held, preempt_enable() asks again */
+    return;
+  }
+  preempted = (cur_pcb -> state == TASK_RUNNABLE);
+  if (preempted) {
+    thread_exit_if_killed();
+  }
+  if (!is_idle_task(cur_pcb) && cur_pcb -> state == TASK_RUNNABLE) { /* Preempted, wait for another turn */
+    if (!cpu -> nr_queued) { /* Nobody else here wants the processor */
+      cpu -> yield_pending = 0;
+      program_next_tick(cur_pcb);
+      return;
+    }
+    heap_push(cpu, cur_pcb);
+  }
+  next_pcb = pick_next_task();
+  if (next_pcb == cur_pcb) { /* The idle task, with still nothing to run */
+    cpu -> yield_pending = 0;
+    program_next_tick(cur_pcb);
+    return;
+  }
+  if (is_idle_task(cur_pcb)) { /* Not a task anyone asks about */
+  } else if (cur_pcb -> state == TASK_RUNNABLE && !cpu -> yield_pending) {
+    cur_pcb -> nivcsw++;
+  } else {
+    cur_pcb -> nvcsw++;
+  }
+  cpu -> yield_pending = 0;
+  switch_to_task(cur_pcb, next_pcb);
+  if (preempted) { /* Killed while it waited for the processor */
+    thread_exit_if_killed();
+  }
 }
 
+/* void sched_yield()
+ * Description: Gives up the rest of the running task's slice. Its vruntime is moved just past the
+ *              most urgent queued task, so that task runs next, and the task gets back on the
+ *              queue in fair order. Called outside any interrupt, so there is no EOI to send.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Switches to another task if one is runnable.
+ */
+void sched_yield() {
+  uint32_t flags; /* Saved EFLAGS */
+  pcb_t* cur_pcb; /* Yielding task */
+  cpu_t* cpu; /* This processor */
+  cli_and_save(flags);
+  cpu = this_cpu();
+  cur_pcb = get_active_pcb();
+  update_curr(cur_pcb);
+  if (cpu -> nr_queued && cur_pcb -> vruntime <= cpu -> run_heap[0] -> vruntime) {
+    cur_pcb -> vruntime = cpu -> run_heap[0] -> vruntime + 1;
+  }
+  cpu -> yield_pending = 1; /* Counts as a voluntary switch */
+  scheduler();
+  restore_flags(flags);
+}
+
+/* void scheduler_exit()
+ * Description: Switches away from a halting task, never to return. The next task frees a dead
+ *              task; a zombie is left for thread_join() to reap.
+ * Inputs: uint32_t state (TASK_DEAD or TASK_ZOMBIE)
+ * Output: None
+ * Returned Value: None (does not return)
+ * Side Effects: Performs the running process switch. Called with interrupts off.
+ */
+void scheduler_exit(uint32_t state) {
+  pcb_t* cur_pcb; /* Halting task */
+  cur_pcb = get_active_pcb();
+  update_curr(cur_pcb);
+  cur_pcb -> state = state;
+  this_cpu() -> yield_pending = 0; /* A killed thread may exit from sched_yield() */
+  switch_to_task(cur_pcb, pick_next_task());
+}
+
+/* void prepare_user_entry()
+ * Description: Builds the first kernel context of a new task: switch_to() resumes it in
+ *              user_entry, on top of an iret frame into the program's entry point.
+ * Inputs: pcb_t* pcb (The new task), uint32_t entry_point (First user instruction),
+ *         uint32_t user_esp (Its user stack pointer)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Writes to the task's kernel stack and sets its context.
+ */
+void prepare_user_entry(pcb_t* pcb, uint32_t entry_point, uint32_t user_esp) {
+  uint32_t* sp; /* Top of the frame being built */
+  sp = (uint32_t*)(pcb -> kernel_stack - FOUR_BYTES); /* Same top as tss.esp0 */
+  *(--sp) = USER_DS; /* iret frame: ss */
+  *(--sp) = user_esp; /* esp */
+  *(--sp) = USER_EFLAGS; /* eflags, interrupts on */
+  *(--sp) = USER_CS; /* cs */
+  *(--sp) = entry_point; /* eip */
+  memset(&pcb -> context, 0, sizeof(task_context_t)); /* Callee-saved registers start at 0 */
+  pcb -> context.esp = (uint32_t)sp;
+  pcb -> context.eip = (uint32_t)user_entry;
+  pcb -> context.eflags = KERNEL_EFLAGS;
+  pcb -> context.cr3 = pcb -> page_dir;
+  pcb -> context.esp0 = pcb -> kernel_stack - FOUR_BYTES;
+}
 
+/* void prepare_kthread_entry()
+ * Description: Builds the first kernel context of a kernel thread: switch_to() resumes it in
+ *              kthread_entry, which calls fn(data) with kthread_exit as the return address.
+ * Inputs: pcb_t* pcb (The new thread), void (*fn)(uint32_t) (Its body), uint32_t data (Argument)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Writes to the thread's kernel stack and sets its context.
+ */
+void prepare_kthread_entry(pcb_t* pcb, void (*fn)(uint32_t), uint32_t data) {
+  uint32_t* sp; /* Top of the frame being built */
+  sp = (uint32_t*)(pcb -> kernel_stack - FOUR_BYTES);
+  *(--sp) = data; /* fn's argument */
+  *(--sp) = (uint32_t)kthread_exit; /* fn's return address */
+  *(--sp) = (uint32_t)fn; /* Popped by kthread_entry's ret */
+  memset(&pcb -> context, 0, sizeof(task_context_t));
+  pcb -> context.esp = (uint32_t)sp;
+  pcb -> context.eip = (uint32_t)kthread_entry;
+  pcb -> context.eflags = KERNEL_EFLAGS;
+  pcb -> context.cr3 = (uint32_t)page_directory; /* Kernel half only */
+  pcb -> context.esp0 = 0; /* Never enters user mode */
+}
+
+/* void add_sleeper()
+ * Description: Marks the running task asleep and appends it to a wait queue, so sleepers are
+ *              woken in arrival order. It keeps running until it calls scheduler().
+ * Inputs: wait_queue_t* queue (Queue to wait on)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off.
+ */
+static void add_sleeper(wait_queue_t* queue) {
+  pcb_t* cur_pcb; /* Task going to sleep */
+  cur_pcb = get_active_pcb();
+  cur_pcb -> state = TASK_SLEEPING;
+  cur_pcb -> wait_next = NULL;
+  cur_pcb -> wait_queue = queue;
+  if (queue -> tail) {
+    queue -> tail -> wait_next = cur_pcb;
+  } else {
+    queue -> head = cur_pcb;
+  }
+  queue -> tail = cur_pcb;
+}
+
+/* void sleep_on()
+ * Description: Blocks the running task on a wait queue until wake_up() is called on it.
+ *              Callers re-check their condition in a loop with interrupts off.
+ * Inputs: wait_queue_t* queue (Queue to wait on)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Switches to another task; the sleeper stays off the run queue until woken.
+ */
+void sleep_on(wait_queue_t* queue) {
+  uint32_t flags; /* Saved EFLAGS */
+  cli_and_save(flags);
+  add_sleeper(queue);
+  scheduler(); /* Returns once we are woken and picked again */
+  restore_flags(flags);
+}
+
+/* void sleep_on_locked()
+ * Description: Same as sleep_on(), for a condition guarded by a spinlock. The task is on the
+ *              queue before the lock is dropped, so a waker that takes the lock to change the
+ *              condition finds it there. The lock is held again on return.
+ * Inputs: wait_queue_t* queue (Queue to wait on), spinlock_t* lock (Held, with interrupts off)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Switches to another task; the sleeper stays off the run queue until woken.
+ */
+void sleep_on_locked(wait_queue_t* queue, spinlock_t* lock) {
+  add_sleeper(queue);
+  spin_unlock(lock);
+  scheduler(); /* Returns once we are woken and picked again */
+  spin_lock(lock);
+}
+
+/* void wake_queue()
+ * Description: Puts every task sleeping on a wait queue back on the run queue. Tasks on the
+ *              visible terminal always get at least SCHED_VISIBLE_CREDIT_MS of wake-up credit,
+ *              so what the user looks at stays responsive.
+ * Inputs: wait_queue_t* queue (Queue to wake), uint32_t credit_ms (Wake-up credit)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Empties the queue.
+ */
+static void wake_queue(wait_queue_t* queue, uint32_t credit_ms) {
+  uint32_t flags; /* Saved EFLAGS */
+  pcb_t* waiter; /* Task being woken */
+  pcb_t* next; /* Following task */
+  uint32_t waiter_credit; /* Credit this waiter gets */
+  cli_and_save(flags);
+  waiter = queue -> head;
+  while (waiter) {
+    next = waiter -> wait_next;
+    waiter -> wait_next = NULL;
+    waiter -> wait_queue = NULL;
+    waiter_credit = credit_ms;
+    if (waiter -> terminal_id == visible_terminal && waiter_credit < SCHED_VISIBLE_CREDIT_MS) {
+      waiter_credit = SCHED_VISIBLE_CREDIT_MS;
+    }
+    enqueue_woken(waiter, waiter_credit);
+    waiter = next;
+  }
+  queue -> head = NULL;
+  queue -> tail = NULL;
+  restore_flags(flags);
+}
+
+/* void cpu_idle()
+ * Description: Turns the processor's boot context into its idle task. It clears frames for the
+ *              zero pool while there are some to clear and halts until the next interrupt
+ *              otherwise, handing the processor over whenever a task is runnable here or can
+ *              be stolen. The kernel lock is dropped while halted.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None (does not return)
+ * Side Effects: Starts scheduling. Counts the time spent halted.
+ */
+void cpu_idle() {
+  cpu_t* cpu; /* This processor */
+  uint32_t idx; /* Processor looked at */
+  uint32_t queued; /* Tasks waiting anywhere */
+  cli();
+  cpu = this_cpu();
+  cpu -> idle_task.cur_pid = INVALID_PID;
+  cpu -> idle_task.cpu = cpu -> id;
+  running_process_id = INVALID_PID;
+  cpu -> idle_task.existent = 1; /* From now on the scheduler has a context to switch from */
+  if (!cpu -> idle_task.lock_depth) { /* The boot processor holds it since smp_init() */
+    lock_kernel();
+  }
+  cpu -> sched_start = rdtsc();
+  while (1) {
+    queued = 0;
+    for (idx = 0; idx < nr_cpus; idx++) {
+      queued += cpus[idx].nr_queued;
+    }
+    if (queued) {
+      scheduler();
+    } else if (!refill_zero_pool()) { /* Nothing to clear either, halt */
+      unlock_kernel();
+      cpu -> halt_start = rdtsc();
+      asm volatile ("sti; hlt; cli" : : : "memory"); /* A wake-up can't slip in before the hlt */
+      end_halt();
+      lock_kernel();
+      continue;
+    }
+    unlock_kernel();
+    sti(); /* Let interrupts and the other processors in between rounds */
+    cli();
+    lock_kernel();
+  }
+}
+
+/* void get_idle_stat()
+ * Description: Reports how much of the time the processors had nothing to run, summed over
+ *              the processors online.
+ * Inputs: idle_stat_t* stat (Filled in)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+void get_idle_stat(idle_stat_t* stat) {
+  uint32_t flags; /* Saved EFLAGS */
+  uint32_t idx; /* Processor looked at */
+  uint64_t now; /* Current TSC */
+  cli_and_save(flags);
+  now = rdtsc();
+  stat -> tsc_khz = tsc_khz;
+  stat -> total_cycles = 0;
+  stat -> idle_cycles = 0;
+  for (idx = 0; idx < nr_cpus; idx++) {
+    if (cpus[idx].sched_start) {
+      stat -> total_cycles += now - cpus[idx].sched_start;
+    }
+    stat -> idle_cycles += cpus[idx].idle_cycles;
+  }
+  restore_flags(flags);
+}
+
+/* void wake_up()
+ * Description: Puts every task sleeping on a wait queue back on the run queue. Safe to call
+ *              from interrupt handlers.
+ * Inputs: wait_queue_t* queue (Queue to wake)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Empties the queue.
+ */
+void wake_up(wait_queue_t* queue) {
+  wake_queue(queue, SCHED_WAKE_CREDIT_MS);
+}
+
+/* void wake_task()
+ * Description: Wakes one task, whatever queue it sleeps on, without waking the others there.
+ *              Its sleep loop finds its condition unchanged: only loops that check why the
+ *              task was woken, such as for a kill, leave.
+ * Inputs: pcb_t* pcb (Task to wake)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Takes the task off its wait queue. Does nothing if it doesn't sleep.
+ */
+void wake_task(pcb_t* pcb) {
+  uint32_t flags; /* Saved EFLAGS */
+  wait_queue_t* queue; /* Queue it sleeps on */
+  pcb_t* prev; /* Sleeper before it, NULL at the head */
+  pcb_t* waiter; /* Sleeper being looked at */
+  cli_and_save(flags);
+  queue = pcb -> wait_queue;
+  if (pcb -> state == TASK_SLEEPING && queue) {
+    prev = NULL;
+    for (waiter = queue -> head; waiter && waiter != pcb; waiter = waiter -> wait_next) {
+      prev = waiter;
+    }
+    if (waiter) {
+      if (prev) {
+        prev -> wait_next = pcb -> wait_next;
+      } else {
+        queue -> head = pcb -> wait_next;
+      }
+      if (queue -> tail == pcb) {
+        queue -> tail = prev;
+      }
+      pcb -> wait_next = NULL;
+      pcb -> wait_queue = NULL;
+      enqueue_woken(pcb, SCHED_WAKE_CREDIT_MS);
+    }
+  }
+  restore_flags(flags);
+}
+
+/* void wake_up_input()
+ * Description: Same as wake_up(), for tasks waiting on the user: they get SCHED_INPUT_CREDIT_MS
+ *              so they run ahead of CPU-bound tasks and echo keystrokes right away.
+ * Inputs: wait_queue_t* queue (Queue to wake)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Empties the queue.
+ */
+void wake_up_input(wait_queue_t* queue) {
+  wake_queue(queue, SCHED_INPUT_CREDIT_MS);
+}
@@ -12,8 +12,43 @@
 #include "terminal.h"
 #include "keyboard.h"
 #include "paging.h"
+#include "timer.h"
+
+#define USER_EFLAGS 0x202 /* EFLAGS a new task starts with: IF and the always-set bit 1 */
+#define NICE_0_WEIGHT 1024 /* Load weight of a nice 0 task */
+#define SCHED_LATENCY_MS 20 /* Every runnable task gets a turn within this period */
+#define SCHED_LATENCY_COUNT (SCHED_LATENCY_MS * PIT_COUNTS_PER_MS) /* Same, in PIT input cycles */
+#define SCHED_MIN_GRAN_COUNT PIT_COUNTS_PER_MS /* Shortest slice, 1ms */
+#define SCHED_WAKEUP_GRAN_MS 1 /* A woken task preempts when this far behind the running one */
+#define SCHED_MAX_DELTA 0xFFFFFFFF /* Most cycles charged at once */
+#define SCHED_WAKE_CREDIT_MS (SCHED_LATENCY_MS / 2) /* How far behind min_vruntime a woken task may start */
+#define SCHED_VISIBLE_CREDIT_MS SCHED_LATENCY_MS /* Same, for tasks of the visible terminal */
+#define SCHED_INPUT_CREDIT_MS (2 * SCHED_LATENCY_MS) /* Same, for tasks woken by keyboard input */
+#define SCHED_MAX_CREDIT_MS SCHED_INPUT_CREDIT_MS /* Largest credit, and the most lag a task takes to another processor */
 
 extern void scheduler();
+extern void scheduler_exit(uint32_t state);
+extern void sched_yield();
+extern void finish_task_switch(pcb_t* prev_pcb);
+extern pcb_t* current_task();
+/* CPU time accounting */
+extern uint32_t account_mode(uint32_t mode);
+extern void get_task_stat(pcb_t* pcb, task_stat_t* stat);
+/* Idle task */
+extern void cpu_idle();
+extern void get_idle_stat(idle_stat_t* stat);
+/* Functions to manage the run queue */
+extern void enqueue_task(pcb_t* pcb);
+extern void migrate_vruntime(pcb_t* pcb);
+extern void sched_fork(pcb_t* pcb);
+extern void prepare_user_entry(pcb_t* pcb, uint32_t entry_point, uint32_t user_esp);
+extern void prepare_kthread_entry(pcb_t* pcb, void (*fn)(uint32_t), uint32_t data);
+/* Functions to block on and signal events */
+extern void sleep_on(wait_queue_t* queue);
+extern void sleep_on_locked(wait_queue_t* queue, spinlock_t* lock);
+extern void wake_up(wait_queue_t* queue);
+extern void wake_up_input(wait_queue_t* queue);
+extern void wake_task(pcb_t* pcb);
 
 #endif
 
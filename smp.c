@@ -0,0 +1,285 @@
+#include "smp.h"
+#include "apic.h"
+#include "ioapic.h"
+#include "scheduler.h"
+#include "paging.h"
+#include "task_switch.h"
+#include "fpu.h"
+
+cpu_t cpus[MAX_CPUS]; /* State of each processor, the boot one first */
+uint32_t nr_cpus = 1; /* Processors online */
+uint32_t ap_boot_stack; /* Stack top the processor being started switches to, read by ap_entry */
+
+static tss_t ap_tss[MAX_CPUS - 1]; /* TSS of each application processor */
+static uint8_t ap_stacks[MAX_CPUS - 1][AP_STACK_SIZE] __attribute__((aligned (AP_STACK_SIZE)));
+static uint8_t irq_stacks[MAX_CPUS][IRQ_STACK_SIZE] __attribute__((aligned (IRQ_STACK_SIZE)));
+static volatile uint32_t ap_booting; /* Index in cpus[] of the processor being started */
+static volatile uint32_t kernel_flag; /* The big kernel lock, 1 while a processor holds it */
+
+/* void bkl_acquire()
+ * Description: Spins until this processor owns the big kernel lock. The wait only reads the
+ *              flag, so waiting processors don't keep pulling its cache line around.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off.
+ */
+static void bkl_acquire() {
+    while (xchg(&kernel_flag, 1)) {
+        while (kernel_flag) {
+            pause();
+        }
+    }
+}
+
+/* void bkl_release()
+ * Description: Gives up the big kernel lock.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off.
+ */
+static void bkl_release() {
+    xchg(&kernel_flag, 0); /* Also a barrier: our writes are seen before the lock is */
+}
+
+/* void lock_kernel()
+ * Description: Enters the kernel. The kernel was written for one processor and relies on cli
+ *              for mutual exclusion, so only one processor runs kernel code at a time. The
+ *              lock is counted per task: an interrupt or nested entry only bumps the count,
+ *              and a task switch hands the lock over with the processor. Every syscall,
+ *              fault and IRQ entry takes it, also where a spinlock guards the data as well.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: May spin. Does nothing while booting, when smp_init() holds the lock.
+ */
+void lock_kernel() {
+    uint32_t flags; /* Saved EFLAGS */
+    pcb_t* cur_pcb; /* Task entering the kernel */
+    cli_and_save(flags);
+    cur_pcb = current_task();
+    if (cur_pcb && cur_pcb -> lock_depth++ == 0) {
+        bkl_acquire();
+    }
+    restore_flags(flags);
+}
+
+/* void unlock_kernel()
+ * Description: Leaves the kernel, releasing the lock when the outermost entry returns.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+void unlock_kernel() {
+    uint32_t flags; /* Saved EFLAGS */
+    pcb_t* cur_pcb; /* Task leaving the kernel */
+    cli_and_save(flags);
+    cur_pcb = current_task();
+    if (cur_pcb && cur_pcb -> lock_depth && --cur_pcb -> lock_depth == 0) {
+        bkl_release();
+    }
+    restore_flags(flags);
+}
+
+/* int32_t start_ap()
+ * Description: Starts one application processor: gives it a TSS and a stack, then sends the
+ *              INIT-STARTUP-STARTUP sequence and waits for it to come online.
+ * Inputs: uint32_t idx (Its index in cpus[]), uint32_t lapic_id (Its local APIC id)
+ * Output: None
+ * Returned Value: 0 upon success, -1 if it never came online
+ * Side Effects: Writes its TSS descriptor into the GDT. Busy-waits about 10ms.
+ */
+static int32_t start_ap(uint32_t idx, uint32_t lapic_id) {
+    cpu_t* cpu; /* The processor's state */
+    seg_desc_t the_tss_desc; /* Its GDT entry */
+    uint64_t deadline; /* TSC to give up at */
+    uint32_t sipi; /* STARTUP IPIs sent */
+    cpu = &cpus[idx];
+    cpu -> id = idx;
+    cpu -> apic_id = lapic_id;
+    cpu -> running_pid = INVALID_PID;
+    cpu -> tss = &ap_tss[idx - 1];
+    cpu -> irq_stack = (uint32_t)irq_stacks[idx] + IRQ_STACK_SIZE;
+
+    /* Same TSS entry as the boot processor's, see entry() */
+    the_tss_desc.granularity   = 0x0;
+    the_tss_desc.opsize        = 0x0;
+    the_tss_desc.reserved      = 0x0;
+    the_tss_desc.avail         = 0x0;
+    the_tss_desc.present       = 0x1;
+    the_tss_desc.dpl           = 0x0;
+    the_tss_desc.sys           = 0x0;
+    the_tss_desc.type          = 0x9;
+    SET_TSS_PARAMS(the_tss_desc, cpu -> tss, tss_size);
+    ap_tss_desc_ptr[idx - 1] = the_tss_desc;
+    cpu -> tss -> ldt_segment_selector = KERNEL_LDT;
+    cpu -> tss -> ss0 = KERNEL_DS;
+
+    ap_booting = idx;
+    ap_boot_stack = (uint32_t)ap_stacks[idx - 1] + AP_STACK_SIZE;
+    apic_send_ipi(lapic_id, APIC_DM_INIT | APIC_LEVEL_ASSERT);
+    pit_busy_wait(AP_INIT_DELAY_MS * PIT_COUNTS_PER_MS);
+    for (sipi = 0; sipi < 2 && !cpu -> online; sipi++) { /* The second one covers a missed first */
+        apic_send_ipi(lapic_id, APIC_DM_STARTUP | AP_TRAMPOLINE_PAGE);
+        pit_busy_wait(AP_SIPI_DELAY_COUNT);
+    }
+    deadline = rdtsc() + (uint64_t)AP_STARTUP_TIMEOUT_MS * tsc_khz;
+    while (!cpu -> online && rdtsc() < deadline) {
+        pause();
+    }
+    return cpu -> online ? 0 : -1;
+}
+
+/* void smp_init()
+ * Description: Sets up the boot processor's state, then starts every other processor the
+ *              MADT lists, up to MAX_CPUS. Each one runs its own idle task and run queue.
+ *              Without a local APIC or MADT the boot processor runs alone.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Takes the big kernel lock for the boot processor; cpu_idle() releases it.
+ *               Copies the start-up code below 1MB.
+ */
+void smp_init() {
+    acpi_madt_t* madt; /* Table listing the processors */
+    uint8_t* pos; /* Entry being read */
+    uint8_t* end; /* End of the table */
+    madt_lapic_t* lapic; /* Processor entry */
+    uint8_t* trampoline; /* Kernel pointer to AP_TRAMPOLINE */
+    cpus[0].tss = &tss;
+    cpus[0].irq_stack = (uint32_t)irq_stacks[0] + IRQ_STACK_SIZE;
+    cpus[0].online = 1;
+    cpus[0].idle_task.lock_depth = 1; /* The boot context becomes the idle task */
+    bkl_acquire();
+    if (tick_device != &apic_tick_jmptable) { /* No local APIC, no IPIs */
+        return;
+    }
+    cpus[0].apic_id = apic_id();
+    madt = acpi_find_madt();
+    if (!madt) {
+        return;
+    }
+    trampoline = PHYS_TO_VIRT(AP_TRAMPOLINE);
+    memcpy(trampoline, ap_trampoline, ap_trampoline_end - ap_trampoline);
+    /* The processors switch to our GDT before they can reach the kernel */
+    asm volatile ("sgdt (%0)" : : "r"(trampoline + (ap_trampoline_gdtr - ap_trampoline)) : "memory");
+
+    pos = (uint8_t*)(madt + 1);
+    end = (uint8_t*)madt + madt -> header.length;
+    while (pos + 2 <= end && pos[1] >= 2 && nr_cpus < MAX_CPUS) { /* Same walk as parse_madt() */
+        lapic = (madt_lapic_t*)pos;
+        if (lapic -> type == MADT_LAPIC && (lapic -> flags & MADT_LAPIC_ENABLED) &&
+            lapic -> apic_id != cpus[0].apic_id) {
+            if (start_ap(nr_cpus, lapic -> apic_id) == 0) {
+                nr_cpus++;
+            }
+        }
+        pos += pos[1];
+    }
+}
+
+/* void ap_main()
+ * Description: First C code of an application processor, called by ap_entry on its boot
+ *              stack with paging on. Loads its TSS, enables its local APIC and becomes its
+ *              idle task.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None (does not return)
+ * Side Effects: Marks the processor online.
+ */
+void ap_main() {
+    uint32_t idx; /* Our index in cpus[] */
+    idx = ap_booting;
+    ltr(TSS_SELECTOR(idx)); /* From now on this_cpu() finds us */
+    lldt(KERNEL_LDT);
+    apic_ap_init();
+    fpu_init();
+    cpus[idx].online = 1;
+    cpu_idle();
+}
+
+/* void smp_send_resched()
+ * Description: Asks another processor to run its scheduler, so an idle one looks for work.
+ * Inputs: cpu_t* cpu (Target)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Sends an IPI.
+ */
+void smp_send_resched(cpu_t* cpu) {
+    apic_send_ipi(cpu -> apic_id, APIC_DM_FIXED | RESCHED_INDEX);
+}
+
+/* void flush_tlb_all()
+ * Description: Drops stale user translations on every processor after a user page table
+ *              changed. It does not wait for the others: one of them may be spinning on the
+ *              kernel lock with interrupts off, and it flushes before its next user access.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Reloads cr3. Sends an IPI when other processors are online.
+ */
+void flush_tlb_all() {
+    uint32_t cur_dir; /* Page directory loaded in cr3 */
+    asm volatile ("movl %%cr3, %0" : "=r" (cur_dir));
+    load_page_dir(cur_dir);
+    if (nr_cpus > 1) {
+        apic_send_ipi_others(TLB_FLUSH_INDEX);
+    }
+}
+
+/* void irq_call()
+ * Description: Runs the body of an interrupt handler on this processor's interrupt stack, so
+ *              interrupts don't pile up on the 8KB kernel stack of whatever task they hit. A
+ *              nested interrupt is already on it and just calls fn. No task switch can happen
+ *              meanwhile: the stack belongs to the processor, not to the task. A handler that
+ *              wants to switch calls scheduler() after irq_call() returns.
+ * Inputs: void (*fn)(void) (Body of the handler)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off. Preemption asked for by fn happens right after.
+ */
+void irq_call(void (*fn)(void)) {
+    cpu_t* cpu; /* This processor */
+    cpu = this_cpu();
+    preempt_disable();
+    if (cpu -> irq_depth++ == 0 && cpu -> irq_stack) {
+        call_on_stack(fn, cpu -> irq_stack);
+    } else { /* Nested, or still booting */
+        fn();
+    }
+    cpu -> irq_depth--;
+    preempt_enable();
+}
+
+/* void resched_handler()
+ * Description: Handles a reschedule IPI: another processor queued work this one may take.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: May switch tasks. Takes the big kernel lock.
+ */
+void resched_handler() {
+    uint32_t prev_mode; /* Accounting mode of the interrupted task */
+    lock_kernel();
+    prev_mode = account_mode(ACCT_IRQ);
+    apic_eoi();
+    account_mode(prev_mode);
+    scheduler();
+    unlock_kernel();
+}
+
+/* void tlb_flush_handler()
+ * Description: Handles a TLB flush IPI. Touches nothing shared, so it runs without the lock.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Reloads cr3.
+ */
+void tlb_flush_handler() {
+    uint32_t cur_dir; /* Page directory loaded in cr3 */
+    asm volatile ("movl %%cr3, %0" : "=r" (cur_dir));
+    load_page_dir(cur_dir);
+    apic_eoi();
+}
@@ -0,0 +1,70 @@
+/*
+ * Header File for Multiprocessor Support
+ */
+
+#ifndef _SMP_H
+#define _SMP_H
+
+#include "types.h"
+
+#define AP_TRAMPOLINE 0x8000 /* Page below 1MB the application processors start in, real mode */
+#define AP_TRAMPOLINE_PAGE (AP_TRAMPOLINE >> 12) /* Same, as the STARTUP IPI vector */
+
+#ifndef ASM
+
+#include "lib.h"
+#include "x86_desc.h"
+
+#define AP_STACK_SIZE 0x2000 /* Boot and idle stack of an application processor */
+#define IRQ_STACK_SIZE 0x2000 /* Stack interrupt handlers run on, one per processor */
+#define AP_INIT_DELAY_MS 10 /* Wait after INIT before the first STARTUP */
+#define AP_SIPI_DELAY_COUNT (PIT_COUNTS_PER_MS / 5) /* Wait after each STARTUP, 200us */
+#define AP_STARTUP_TIMEOUT_MS 100 /* How long a processor gets to come online */
+
+extern cpu_t cpus[MAX_CPUS];
+extern uint32_t nr_cpus;
+extern uint32_t ap_boot_stack;
+
+/* Real mode start-up code in ap_boot.S, copied to AP_TRAMPOLINE */
+extern uint8_t ap_trampoline[];
+extern uint8_t ap_trampoline_gdtr[];
+extern uint8_t ap_trampoline_end[];
+
+/* cpu_t* this_cpu()
+ * Description: Finds the state of the processor running the caller. Every processor loads its
+ *              own TSS selector, so the task register tells them apart.
+ * Inputs: None
+ * Output: None
+ * Returned Value: The processor's entry in cpus[]
+ * Side Effects: None
+ */
+static inline cpu_t* this_cpu(void) {
+    uint16_t sel; /* Task register */
+    asm volatile ("str %0" : "=r"(sel));
+    if (sel < AP_TSS_BASE) { /* KERNEL_TSS, the double fault task, or none loaded yet while booting */
+        return &cpus[0];
+    }
+    return &cpus[((sel - AP_TSS_BASE) >> 3) + 1];
+}
+
+#define running_process_id (this_cpu() -> running_pid) /* Pid of the process running on this processor */
+#define running_terminal (this_cpu() -> running_term) /* Terminal of the process running on this processor */
+
+/* Starts the other processors */
+extern void smp_init(void);
+extern void ap_main(void);
+/* Big kernel lock, held by a processor while it runs kernel code */
+extern void lock_kernel(void);
+extern void unlock_kernel(void);
+/* Cross-processor requests */
+extern void smp_send_resched(cpu_t* cpu);
+extern void flush_tlb_all(void);
+/* Runs the body of an interrupt handler on this processor's interrupt stack */
+extern void irq_call(void (*fn)(void));
+/* Interrupt handlers */
+extern void resched_handler(void);
+extern void tlb_flush_handler(void);
+
+#endif /* ASM */
+
+#endif
@@ -0,0 +1,104 @@
+#include "softirq.h"
+#include "smp.h"
+#include "workqueue.h"
+
+/* Bottom halves. An interrupt handler only does what can't wait, such as reading the device
+ * and sending the EOI, and raises a softirq for the rest. irq_exit() then runs the pending
+ * softirqs with interrupts on, so other interrupts, the timer first of all, are not held up
+ * behind the slow part. Softirqs don't nest: an interrupt that comes in while they run only
+ * raises its own and leaves it to the running do_softirq(). */
+static void (*softirq_vec[NR_SOFTIRQS])(void); /* Bottom half of each softirq */
+static volatile uint32_t softirq_pending; /* Bit set marks a raised softirq, on any processor */
+static void softirq_work_func(work_struct_t* work);
+static work_struct_t softirq_work = { NULL, softirq_work_func, 0 }; /* Runs what is left after MAX_SOFTIRQ_RESTART rounds */
+
+/* void open_softirq()
+ * Description: Registers the bottom half of a softirq.
+ * Inputs: uint32_t nr (Softirq number), void (*action)(void) (Its bottom half)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+void open_softirq(uint32_t nr, void (*action)(void)) {
+    if (nr < NR_SOFTIRQS) {
+        softirq_vec[nr] = action;
+    }
+}
+
+/* void raise_softirq()
+ * Description: Marks a softirq pending. It runs at the next irq_exit() on any processor.
+ * Inputs: uint32_t nr (Softirq number)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+void raise_softirq(uint32_t nr) {
+    asm volatile ("lock orl %1, %0" : "+m"(softirq_pending) : "r"(1 << nr) : "memory");
+}
+
+/* void softirq_work_func()
+ * Description: Runs the softirqs do_softirq() gave up on, from the "events" thread.
+ * Inputs: work_struct_t* work (softirq_work)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+static void softirq_work_func(work_struct_t* work) {
+    uint32_t flags; /* Saved EFLAGS */
+    cli_and_save(flags);
+    do_softirq();
+    restore_flags(flags);
+}
+
+/* void do_softirq()
+ * Description: Runs the pending softirqs with interrupts on. Softirqs raised meanwhile are
+ *              picked up in further rounds; after MAX_SOFTIRQ_RESTART of them the rest is
+ *              handed to the "events" thread, so an interrupt storm can't starve the tasks.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off, returns with them off. Takes the kernel lock.
+ *               The running task can't be preempted meanwhile.
+ */
+void do_softirq() {
+    cpu_t* cpu; /* This processor */
+    uint32_t pending; /* Softirqs taken for this round */
+    uint32_t restart; /* Rounds run */
+    uint32_t nr; /* Softirq being run */
+    cpu = this_cpu();
+    if (cpu -> in_softirq || !softirq_pending) {
+        return;
+    }
+    cpu -> in_softirq = 1;
+    preempt_disable(); /* Keeps us on this processor with interrupts on */
+    lock_kernel();
+    for (restart = 0; restart < MAX_SOFTIRQ_RESTART && softirq_pending; restart++) {
+        pending = xchg(&softirq_pending, 0);
+        sti();
+        for (nr = 0; nr < NR_SOFTIRQS; nr++) {
+            if ((pending & (1 << nr)) && softirq_vec[nr]) {
+                softirq_vec[nr]();
+            }
+        }
+        cli();
+    }
+    if (softirq_pending) {
+        schedule_work(&softirq_work);
+    }
+    unlock_kernel();
+    cpu -> in_softirq = 0;
+    preempt_enable();
+}
+
+/* void irq_exit()
+ * Description: Ends an interrupt handler: runs the softirqs it or earlier ones raised.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off, after the EOI.
+ */
+void irq_exit() {
+    if (softirq_pending) {
+        do_softirq();
+    }
+}
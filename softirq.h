@@ -0,0 +1,23 @@
+/*
+ * Header File for Deferred Interrupt Work (softirqs)
+ */
+
+#ifndef _SOFTIRQ_H
+#define _SOFTIRQ_H
+
+#include "types.h"
+#include "lib.h"
+
+#define KEYBOARD_SOFTIRQ 0 /* Decodes and echoes the scancodes keyboard_handler() queued */
+#define NR_SOFTIRQS 1
+#define MAX_SOFTIRQ_RESTART 10 /* Rounds run at one interrupt exit before the rest goes to a thread */
+
+/* Registers the bottom half run for a softirq */
+extern void open_softirq(uint32_t nr, void (*action)(void));
+/* Marks a softirq pending, from an interrupt handler */
+extern void raise_softirq(uint32_t nr);
+/* Runs the pending softirqs, at the end of an interrupt handler */
+extern void irq_exit(void);
+extern void do_softirq(void);
+
+#endif
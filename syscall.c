@@ -1,5 +1,17 @@
 #include "syscall.h"
+#include "scheduler.h"
 
+static pcb_t pcb_table[MAX_NUM_PROCESSES]; /* The process table */
+static idmap_t pid_map; /* Bit set marks a pid as taken */
+static volatile uint32_t exec_queue_head; /* Ticket currently allowed to take a pid */
+static volatile uint32_t exec_queue_tail; /* Next ticket handed to a queued execute */
+static wait_queue_t pid_queue; /* Queued executes sleep here until a pid is freed */
+static spinlock_t pid_lock = SPIN_LOCK_UNLOCKED("pid"); /* pid_map and the execute queue tickets */
+static uint32_t pids_freed; /* Bumped by free_pid() under pid_lock */
+static wait_queue_t child_queue; /* Parents sleep here until their foreground child halts */
+static wait_queue_t thread_queue; /* Joiners sleep here until a thread exits */
+
+static int32_t launch_program (const uint8_t* command, int32_t terminal_id, uint32_t spawn);
 
 
 /* pcb_t* get_active_pcb()
@@ -22,74 +34,241 @@
  */
 pcb_t* get_pcb(int32_t pid) {
   if (pid >= 0 && pid < MAX_NUM_PROCESSES) { /* Prereq: the pid input is valid */
-    uint32_t kernel_stack_start_address; /* The starting address of the kernel stack */
-    uint32_t cur_pcb_address; /* Address of current pcb */
-    kernel_stack_start_address = KERNEL_START_ADD + KERNEL_PAGE_SIZE; /* place the first task's kernel stak at the bottom of the 4 MB kernel page */
-    cur_pcb_address = kernel_stack_start_address - pid * PCB_STACK_SIZE - PCB_STACK_SIZE; /* Stack grows upwards */
-    return (pcb_t*)cur_pcb_address; /* Cast the address to a pcb pointer and return the pointer */
+    return &pcb_table[pid]; /* PCBs live in the process table, not at the bottom of the kernel stacks */
   }
   return NULL; /* Prereqs not met, return NULL pointer */
  }
 
- /* int32_t get_avaialable_pid()
-  * Description: A function to get a the next available pid.
-  * Inputs: None
+ /* int32_t alloc_pid()
+  * Description: A function to get a the next available pid. The pid bitmap is searched with two bit scans,
+  *              so allocation takes the same time however full the process table is.
+  * Inputs: uint32_t own_space (Set to give the pcb a page directory of its own)
   * Output: Returns an integer as the available pid. Mark corr. pcb as existent
-  * Returned Value: Int - avaialable pid
-  * Side Effects: Mark corr. pcb as existent
+  * Returned Value: Int - avaialable pid, or INVALID_PID when the table or user memory is exhausted
+  * Side Effects: Mark corr. pcb as existent, reserves a kernel stack and maybe a page directory
+  */
+  static int32_t alloc_pid(uint32_t own_space) {
+    int32_t pid_tmp; /* Allocated pid */
+    pcb_t* pcb_tmp; /* Corr. pcb */
+    uint32_t flags; /* Saved EFLAGS */
+    spin_lock_irqsave(&pid_lock, flags);
+    pid_tmp = idmap_alloc(&pid_map); /* Take the lowest free pid */
+    spin_unlock_irqrestore(&pid_lock, flags);
+    if (pid_tmp < 0) {
+      return INVALID_PID; /* No avaialble seats. Return an invalid pid */
+    }
+    pcb_tmp = get_pcb(pid_tmp); /* Ours alone from here on, the bit is taken */
+    pcb_tmp -> page_dir = own_space ? create_page_dir() : NO_FRAME; /* Every process needs its own address space */
+    if (own_space && pcb_tmp -> page_dir == NO_FRAME) {
+      spin_lock_irqsave(&pid_lock, flags);
+      idmap_free(&pid_map, pid_tmp);
+      spin_unlock_irqrestore(&pid_lock, flags);
+      return INVALID_PID; /* Out of memory counts as a full table */
+    }
+    pcb_tmp -> brk = USER_HEAP_START; /* Heap starts empty */
+    pcb_tmp -> min_flt = 0;
+    pcb_tmp -> maj_flt = 0;
+    pcb_tmp -> state = TASK_RUNNABLE;
+    pcb_tmp -> nice = 0;
+    sched_fork(pcb_tmp);
+    pcb_tmp -> child_pid = INVALID_PID;
+    pcb_tmp -> wait_next = NULL;
+    pcb_tmp -> wait_queue = NULL;
+    pcb_tmp -> leader = pcb_tmp; /* A process of its own until thread_create() says otherwise */
+    pcb_tmp -> nr_threads = 0;
+    pcb_tmp -> exit_status = 0;
+    pcb_tmp -> killed = 0;
+    pcb_tmp -> used_math = 0; /* Gets a clean FPU on its first FPU instruction */
+    pcb_tmp -> existent = TRUE_; /* We'll take it as the new-allocated pcb. Now existent */
+    pcb_tmp -> cur_pid = pid_tmp;
+    pcb_tmp -> shell_flag = 0;
+    pcb_tmp -> kernel_stack = KSTACK_MEM_ADD + KSTACK_MEM_SIZE - pid_tmp * PCB_STACK_SIZE; /* Stacks grow down from 12MB */
+    return pid_tmp; /* Return the pid */
+  }
+
+ /* int32_t get_available_pid()
+  * Description: Allocates a pid for a new process, with an empty address space of its own.
+  * Inputs: None
+  * Output: Mark corr. pcb as existent
+  * Returned Value: Int - avaialable pid, or INVALID_PID when the table or user memory is exhausted
+  * Side Effects: Reserves a kernel stack and a page directory
   */
   int32_t get_available_pid() {
-    int32_t pid_tmp; /* Possibole pid for looping */
-    pid_tmp = 0; /* Start at the very first possible pid */
-    while (pid_tmp != MAX_NUM_PROCESSES) { /* Loop until reaching max. # processes */
-      pcb_t* pcb_tmp = get_pcb(pid_tmp); /* Get corr. pcb */
-      if (pcb_tmp -> existent == FALSE_) { /* Check if pcb is already existing */
-        pcb_tmp -> existent = TRUE_; /* We'll take it as the new-allocated pcb. Now existent */
-        return pid_tmp; /* Return the pid */
+    return alloc_pid(TRUE_);
+  }
+
+ /* int32_t get_available_tid()
+  * Description: Allocates a pid for a task that runs in an address space it doesn't own: a thread,
+  *              which borrows its process's, or a kernel thread, which uses the boot one. Its
+  *              page_dir is NO_FRAME until the caller sets it.
+  * Inputs: None
+  * Output: Mark corr. pcb as existent
+  * Returned Value: Int - avaialable pid, or INVALID_PID when the table is full
+  * Side Effects: Reserves a kernel stack
+  */
+  int32_t get_available_tid() {
+    return alloc_pid(FALSE_);
+  }
+
+ /* void free_pid()
+  * Description: A function to release a pid and everything reserved with it.
+  * Inputs: int32_t pid (The pid to release)
+  * Output: None
+  * Returned Value: None
+  * Side Effects: Marks the pcb as inexistent, frees its address space unless it is a thread's and
+  *               its bit in the pid bitmap
+  */
+  void free_pid(int32_t pid) {
+    pcb_t* pcb_tmp; /* Corr. pcb */
+    uint32_t flags; /* Saved EFLAGS */
+    pcb_tmp = get_pcb(pid);
+    if (pcb_tmp == NULL || pcb_tmp -> existent == FALSE_) {
+      return; /* Nothing to release */
+    }
+    if (pcb_tmp -> leader == pcb_tmp) { /* Threads only borrow their process's */
+      destroy_page_dir(pcb_tmp -> page_dir); /* Frees every frame the process touched */
+    }
+    pcb_tmp -> page_dir = NO_FRAME;
+    pcb_tmp -> existent = FALSE_;
+    spin_lock_irqsave(&pid_lock, flags);
+    idmap_free(&pid_map, pid);
+    pids_freed++;
+    spin_unlock_irqrestore(&pid_lock, flags);
+    wake_up(&pid_queue); /* Queued executes may take it */
+  }
+
+ /* int32_t wait_for_available_pid()
+  * Description: Queues an execute request until a process slot frees up. Requests are served
+  *              in arrival order through a ticket counter.
+  * Inputs: None
+  * Output: Returns an allocated pid
+  * Returned Value: Int - allocated pid
+  * Side Effects: Sleeps on the pid wait queue so other processes can run and halt
+  */
+  int32_t wait_for_available_pid() {
+    uint32_t ticket; /* Our place in line */
+    int32_t pid_tmp; /* Allocated pid */
+    uint32_t flags; /* Saved EFLAGS */
+    uint32_t freed; /* pids_freed before we tried */
+    spin_lock_irqsave(&pid_lock, flags);
+    ticket = exec_queue_tail++; /* Take a ticket */
+    while (TRUE_) {
+      if (ticket == exec_queue_head) { /* Our turn */
+        freed = pids_freed;
+        spin_unlock(&pid_lock); /* get_available_pid() takes it */
+        pid_tmp = get_available_pid();
+        spin_lock(&pid_lock);
+        if (pid_tmp != INVALID_PID) {
+          exec_queue_head++; /* Let the next request in line try */
+          spin_unlock_irqrestore(&pid_lock, flags);
+          wake_up(&pid_queue);
+          return pid_tmp;
+        }
+        if (pids_freed != freed) {
+          continue; /* Freed while the lock was dropped, its wake-up came before we slept */
+        }
       }
-      pid_tmp++;
+      sleep_on_locked(&pid_queue, &pid_lock); /* Let the scheduler run other processes until one halts */
     }
-    return INVALID_PID; /* No avaialble seats. Return an invalid pid */
   }
 
 
 /* pcb_t* file_desc_array_init()
  * Description: A function to initialize the fd array in pcb.
  * Inputs: pcb_t* cur_pcb (Pointer to the referenced pcb)
- * Output: Returns a pointer to the pcb with cur_process -> file_desc_array initialized.
- * Returned Value: A pointer to the pcb with cur_process -> file_desc_array initialized.
- * Side Effects: Initialize the cur_process -> file_desc_array in specified pcb.
+ * Output: Returns a pointer to the pcb with cur_process -> file_desc_table initialized.
+ * Returned Value: A pointer to the pcb with cur_process -> file_desc_table initialized.
+ * Side Effects: Initialize the cur_process -> file_desc_table in specified pcb.
  */
  pcb_t* file_desc_array_init(pcb_t* cur_pcb) {
-   if (fs_abs_init(cur_pcb -> file_desc_array) == FS_ABSTRACTION_FAILURE) {
+   if (fs_abs_init(&cur_pcb -> file_desc_table) == FS_ABSTRACTION_FAILURE) {
      return NULL;  /* Initialize the file descriptor array of current pcb. If fails, return nullptr */
    }
-   return cur_pcb; /* If succeed, just return the pcb with cur_process -> file_desc_array initialized */
+   return cur_pcb; /* If succeed, just return the pcb with cur_process -> file_desc_table initialized */
  }
  
+/* uint32_t get_image_end()
+ * Description: Finds where the program image ends once bss is included, from the ELF
+ *              program headers. Falls back to the file length if they can't be read.
+ * Inputs: uint32_t inode, uint32_t len (Inode and length of the executable)
+ * Output: None
+ * Returned Value: First user address past the image, page aligned
+ * Side Effects: None
+ */
+static uint32_t get_image_end(uint32_t inode, uint32_t len) {
+  uint32_t phoff; /* Offset of the program header table */
+  uint16_t phnum; /* Number of program headers */
+  uint32_t phdr[ELF_PHDR_SIZE / FOUR_BYTES]; /* Current program header: type, offset, vaddr, paddr, filesz, memsz ... */
+  uint32_t end; /* Running maximum */
+  uint32_t idx; /* Index of program header */
+  end = PROGRAM_IMG_ADDRESS + len;
+  phoff = 0;
+  phnum = 0;
+  read_data(inode, ELF_PHOFF_OFFSET, (char*)&phoff, sizeof(phoff));
+  read_data(inode, ELF_PHNUM_OFFSET, (char*)&phnum, sizeof(phnum));
+  for (idx = 0; idx < phnum; idx++) {
+    if (read_data(inode, phoff + idx * ELF_PHDR_SIZE, (char*)phdr, ELF_PHDR_SIZE) != ELF_PHDR_SIZE) {
+      break; /* Truncated table, keep what we have */
+    }
+    if (phdr[0] == ELF_PT_LOAD && phdr[2] + phdr[5] > end && phdr[2] + phdr[5] <= USER_STACK_LIMIT) {
+      end = phdr[2] + phdr[5]; /* vaddr + memsz */
+    }
+  }
+  return (end + PAGE_SIZE_4KB - 1) & ~(PAGE_SIZE_4KB - 1);
+}
+
  /* int32_t execute()
   * Description: A syscall that attempts to load and exeute a new program, handing off the
   *               processor to the new program until it terminates.
   * Inputs: const uint8_t* command (command of the syscall)
   * Output: modifies data structures related to syscall. Returned integer signifies success/failure
-  * Returned Value: An integer to signify success or failure
+  * Returned Value: The program's exit status (256 if it died in an exception), -1 upon failure
   * Side Effects: Loads and executes programs, handing off processor to such new programs
   */
   int32_t execute(const uint8_t* command) {
     int32_t result; /* Store the returned value of helper func */
-    cli(); /* During the process starting routine, no interrupts are allowed */
+    sti(); /* The load runs with interrupts on: the process table and the terminals have their own locks */
     result = execute_helper(command);
     return result;
   }
  /* int32_t execute_helper()
   * Description: A helper to the syscall that attempts to load and exeute a new program, handing off the
-  *               processor to the new program until it terminates.
+  *               processor to the new program until it terminates. A command ending in " &" starts a
+  *               background job instead, and returns right away.
   * Inputs: const uint8_t* command (command of the syscall)
   * Output: modifies data structures related to syscall. Returned integer signifies success/failure
   * Returned Value: An integer to signify success or failure
   * Side Effects: Loads and executes programs, handing off processor to such new programs
   */
   int32_t execute_helper (const uint8_t* command) {
+    return launch_program(command, running_terminal, FALSE_);
+  }
+
+ /* void multiterminal_init()
+  * Description: Queues the base shells of every terminal. They run once kernel.c hands the
+  *               processor over to the scheduler with cpu_idle().
+  * Inputs: None
+  * Output: None
+  * Returned Value: None
+  * Side Effects: Takes pids and puts the shells on the run queue
+  */
+  void multiterminal_init() {
+    int32_t terminal_id; /* Terminal getting a shell */
+    for (terminal_id = 0; terminal_id < TERM_NUM; terminal_id++) {
+      launch_program((uint8_t*)"shell", terminal_id, TRUE_);
+    }
+  }
+
+ /* int32_t launch_program()
+  * Description: Loads a program and either hands the processor to it, or puts it on the run queue
+  *               when it is a background job ("&") or a base shell being spawned.
+  * Inputs: const uint8_t* command, int32_t terminal_id (Terminal the program runs on),
+  *         uint32_t spawn (Set to queue the program as the terminal's base shell)
+  * Output: modifies data structures related to syscall. Returned integer signifies success/failure
+  * Returned Value: An integer to signify success or failure
+  * Side Effects: Loads and executes programs
+  */
+  static int32_t launch_program (const uint8_t* command, int32_t terminal_id, uint32_t spawn) {
     uint8_t filename[MAX_FILENAME_LENGTH + 1]; /* The filename buffer */
     uint8_t argument[MAX_ARG_LENGTH + 1]; /* The argument buffer */
     int name_parse_idx; /* Index for filename parsing */
@@ -100,15 +279,12 @@ pcb_t* get_pcb(int32_t pid) {
     char buf[FILE_HEADER_LENGTH]; /* The buf to read file header */
     int unmatched_magic; /* Boolean to check if unmatched magic numbers presented */
     int buf_idx; /* Index in buf */
-    uint32_t dir_idx; /* The entry in page directory for input */
-    uint32_t esp; /* Current esp */
-    uint32_t ebp; /* Current ebp */
-    uint32_t kernel_stack_start_address; /* The starting address of the kernel stack */
     uint32_t entry_point; /* Bytes 24-27 of the executable */
-    uint32_t kmode_stack; /* Process's kernel-mode stack address */
     int32_t cur_pid; /* The pid allocated for current process */
     pcb_t* cur_process; /* The pointer to the pcb of current process */
-    uint32_t vm_idx; /* Video memory index in page tables */
+    uint32_t flags; /* Saved EFLAGS */
+    pcb_t* parent_process; /* The pcb of the process waiting for it */
+    uint32_t background; /* Set when the command ends in "&" */
     /* Step 0: Sanity Check */
     if (command == NULL || command[0] == '\0') { /* Check if command is valid */
       printf("Error: System Call - execute(): Command is Empty or Null");
@@ -149,34 +325,49 @@ pcb_t* get_pcb(int32_t pid) {
         arg_parse_idx++; /* Increment Indices */
       }
     }
+    background = FALSE_;
+    arg_idx = strlen((int8_t*)argument);
+    while (arg_idx > 0 && argument[arg_idx - 1] == ' ') { /* Disregard trailing spaces */
+      arg_idx--;
+    }
+    if (arg_idx > 0 && argument[arg_idx - 1] == '&') { /* Trailing "&" asks for a background job */
+      background = TRUE_;
+      arg_idx--;
+      while (arg_idx > 0 && argument[arg_idx - 1] == ' ') {
+        arg_idx--;
+      }
+      memset(argument + arg_idx, 0, MAX_ARG_LENGTH + 1 - arg_idx); /* Strip it from the arguments */
+    }
 
     /*-----------------------------------Step 2: Check if Prereqs are Met for EXE-------------------------------------------*/
     cur_pid = get_available_pid(); /* Allocate the pid for cur. process */
+    if (cur_pid == INVALID_PID && EXECUTE_QUEUE_ON_LIMIT && running_process_id != INVALID_PID) {
+      cur_pid = wait_for_available_pid(); /* A running process asked, so queue it until a slot frees */
+    }
     if (cur_pid == INVALID_PID) { /* Check if no more pid are avaialble for allocation */
       printf("Error: System Call - execute(): Reached Maximum Number of Running Process %s\n", filename);
       return SYSCALL_TOO_MANY_PROCESSES;
     }
     cur_process = get_pcb(cur_pid); /* Get the pcb of current process */
-    cur_process -> cur_pid = cur_pid; /* Store pid */
-    if (fs_abs_init(cur_process -> file_desc_array) == FS_ABSTRACTION_FAILURE) { /* Initialize file sys abstraction */
+    if (fs_abs_init(&cur_process -> file_desc_table) == FS_ABSTRACTION_FAILURE) { /* Initialize file sys abstraction */
       printf("Error: System Call - execute(): FS Abstraction Failed to Initialize");
-      get_pcb(cur_pid) -> existent = FALSE_;
+      free_pid(cur_pid);
       return SYSCALL_FAILURE; /* Return failure if unable to initialize */
     }
-    fd = fs_abs_open(cur_process -> file_desc_array, (char*)filename); /* Open the file, fd stores desc. # */
+    fd = fs_abs_open(&cur_process -> file_desc_table, (char*)filename); /* Open the file, fd stores desc. # */
     if (fd == FS_ABSTRACTION_FAILURE) { /* Check if file is opened correctly */
       printf("Error: System Call - execute(): Opening File Failed %s\n", filename);
-      get_pcb(cur_pid) -> existent = FALSE_;
+      free_pid(cur_pid);
       return SYSCALL_FAILURE; /* If not, return failure */
     }
-    if (fs_abs_read(cur_process -> file_desc_array, fd, buf, FILE_HEADER_LENGTH) == FS_ABSTRACTION_FAILURE) { /* Read header to buf */
+    if (fs_abs_read(&cur_process -> file_desc_table, fd, buf, FILE_HEADER_LENGTH) == FS_ABSTRACTION_FAILURE) { /* Read header to buf */
       printf("Error: System Call - execute(): Reading File Header Failed %s\n", filename);
-      get_pcb(cur_pid) -> existent = FALSE_;
+      free_pid(cur_pid);
       return SYSCALL_FAILURE; /* Return failure if unable to read header */
     }
-    if (cur_process -> file_desc_array[fd].file_position != FILE_HEADER_LENGTH) { /* Check if header length is correct */
+    if (fs_abs_get(&cur_process -> file_desc_table, fd) -> file_position != FILE_HEADER_LENGTH) { /* Check if header length is correct */
       printf("Error: System Call - execute(): File Header Length is Incorrect %s\n", filename);
-      get_pcb(cur_pid) -> existent = FALSE_;
+      free_pid(cur_pid);
       return SYSCALL_FAILURE;
     }
     buf_idx = 0; /* Start at the very first byte of buf */
@@ -205,94 +396,60 @@ pcb_t* get_pcb(int32_t pid) {
     }
     if (unmatched_magic == TRUE_) { /* If true, file is not executable */
       printf("Error: System Call - execute(): File is not Executable\n", filename);
-      get_pcb(cur_pid) -> existent = FALSE_;
+      free_pid(cur_pid);
       return SYSCALL_FAILURE;
     }
-    cur_process -> parent_pid = running_process_id; /* Current running proc. becomes parent */
-    cur_process -> terminal_id = running_terminal;
-    term[running_terminal].running_process = cur_pid;
+    cur_process -> parent_pid = spawn ? INVALID_PID : running_process_id; /* Current running proc. becomes parent */
+    cur_process -> terminal_id = terminal_id;
+    cur_process -> background = background;
+    if (cur_process -> parent_pid != INVALID_PID) { /* Children inherit the parent's nice value */
+      cur_process -> nice = get_active_pcb() -> nice;
+    }
 
     /*----------------------------------------------Step 3: Deal with Paging----------------------------------------------*/
-    dir_idx = (uint32_t) PROGRAM_IMG_ADDRESS >> DIR_OFFSET; /* Get the current page_dir entry */
-    page_directory[dir_idx].present_4mb = 1; /* Mark Presense */
-    page_directory[dir_idx].read_write_4mb = 1; /* Read and write */
-    page_directory[dir_idx].user_supervisor_4mb = 1; /* Mark User-Accessible */
-    page_directory[dir_idx].write_through_4mb = 0; /* Write-through Caching Disabled */
-    page_directory[dir_idx].cache_disabled_4mb = 0; /* Page is cached */
-    page_directory[dir_idx].accessed_4mb = 0; /* Not read/ written to */
-    page_directory[dir_idx].dirty_4mb = 0; /* Not dirty */
-    page_directory[dir_idx].page_size_4mb = 1; /* 4 MB page */
-    page_directory[dir_idx].global_page_4mb = 0; /* Page is local */
-    page_directory[dir_idx].avail_4mb = 0; /* Free bits not initialized */
-    page_directory[dir_idx].pat_memory_type_4mb = 0; /* Not modified */
-    page_directory[dir_idx].reserved_4mb = 0; /* Not modified */
-    page_directory[dir_idx].page_start_add_4mb = PROCESS_BASE_ADDRESS + cur_pid; /* Physical address */
-    vm_idx = ((VID_MEM_ADD & MASK_21_12) >> TBL_OFFSET);
-    if (running_terminal == visible_terminal) { /* When process is displayed */
-      page_table[vm_idx].page_start_add = vm_idx; /* Put it on vid. mem. */
-    } else { /* When process is running in another terminal */
-      page_table[vm_idx].page_start_add = vm_idx + 1 + cur_process -> terminal_id; /* Put it in subsequent mem. */
-    }
-    asm volatile ( /* Flush the TLB by writing to register cr3 */
-      "movl %%cr3, %%eax     ;"
-      "movl %%eax, %%cr3     ;"
-      : /* No outputs */
-      : /* No inputs */
-      : "eax", "cc"  /* Clobbers */
-      );
+    if (map_zeroed_page(cur_process -> page_dir, USER_STACK_ADDRESS - FOUR_BYTES) == -1) { /* One stack page, the rest grows on demand */
+      printf("Error: System Call - execute(): Out of Memory %s\n", filename);
+      free_pid(cur_pid);
+      return SYSCALL_FAILURE;
+    }
 
     /*-----------------------------------------Step 4: User Level Program Loader--------------------------------------------*/
-    cur_process -> file_desc_array[fd].file_position = 0; /* Reset starting position to 0 to read the whole file */
-    if (fs_abs_read(cur_process -> file_desc_array, fd, (char*) PROGRAM_IMG_ADDRESS, REF_EXE_FILE_LEN) == FS_ABSTRACTION_FAILURE) { /* Read to prog. img. */
-      printf("Error: System Call - execute(): Load File to Memory Failed\n", filename);
-      get_pcb(cur_pid) -> existent = FALSE_;
-      return SYSCALL_FAILURE; /* Failed to load file to memory */
-    }
-    if (fs_abs_close(cur_process -> file_desc_array, fd) == FS_ABSTRACTION_FAILURE) { /* Close the file */
+    /* Nothing is copied here: image pages are read from the file by the page-fault handler on first touch */
+    cur_process -> image_inode = fs_abs_get(&cur_process -> file_desc_table, fd) -> inode;
+    cur_process -> image_len = fs_inode_length(cur_process -> image_inode);
+    cur_process -> image_end = get_image_end(cur_process -> image_inode, cur_process -> image_len);
+    if (fs_abs_close(&cur_process -> file_desc_table, fd) == FS_ABSTRACTION_FAILURE) { /* Close the file */
       printf("Error: System Call - execute(): Closing File Failed\n", filename);
-      get_pcb(cur_pid) -> existent = FALSE_;
+      free_pid(cur_pid);
       return SYSCALL_FAILURE; /* Failed to Close File */
     }
 
     /*-----------------------------------------------Step 5: Create pcb-------------------------------------------------------*/
-    term[running_terminal].pcb = cur_process;
     if (strncmp("shell", (int8_t*)filename, 5) == 0) {
-      term[running_terminal].pcb->shell_flag = 1;
+      cur_process -> shell_flag = 1;
     }
-    asm volatile ( /* Get current esp */
-      "movl %%esp, %0     ;"
-      : "=r" (esp) /* Output : esp. No inputs. Not clobbering */
-      );
-    cur_process -> parent_esp = esp; /* Load esp */
-    asm volatile ( /* Get current ebp */
-      "movl %%ebp, %0     ;"
-      : "=r" (ebp) /* Output : ebp. No inputs. Not clobbering */
-      );
-    cur_process -> parent_ebp = ebp; /* Load ebp */
-    kernel_stack_start_address = KERNEL_START_ADD + KERNEL_PAGE_SIZE; /* place the first task's kernel stak at the bottom of the 4 MB kernel page */
     memcpy(cur_process -> arg, argument, MAX_ARG_LENGTH + 1); /* Store current argument in pcb */
-    /* Step 6: Context Switch */
-    running_process_id = cur_pid; /* Initialized process becomes cur. running process */
-    entry_point = *((uint32_t*)(PROGRAM_IMG_ADDRESS + ENTRY_PT_OFFSET));
-    kmode_stack = kernel_stack_start_address - cur_pid * PCB_STACK_SIZE; /* Stack add. */
-    tss.esp0 = kmode_stack - FOUR_BYTES; /* Modify esp0 of task state segment */
-    tss.ss0 = KERNEL_DS;
-    asm volatile ( /* Set up stack and set DS to point to entry in GDT for user data segment */
-      "andl    $0x00FF, %%ebx    ;"
-      "pushl   %%ebx             ;"
-      "pushl   %%edx             ;"
-      "pushfl                    ;"
-      "popl    %%edx             ;"
-      "orl     $0x200, %%edx     ;"
-      "pushl   %%edx             ;"
-      "pushl   %%ecx             ;"
-      "pushl   %%eax             ;"
-      "iret                      ;"
-      : /* No outputs */
-      : "a"(entry_point), "b"(USER_DS), "c"(USER_CS), "d"(USER_STACK_ADDRESS-FOUR_BYTES) /* Inputs */
-      : "cc","memory"  /* Clobbers */
-      );
-    return SYSCALL_SUCCESS; /* Finished all tasks and return success */
+    entry_point = *((uint32_t*)(buf + ENTRY_PT_OFFSET)); /* Taken from the header, the image isn't loaded yet */
+    if (!background) { /* The program takes over its terminal */
+      spin_lock_irqsave(&term[terminal_id].lock, flags);
+      term[terminal_id].pcb = cur_process;
+      term[terminal_id].running_process = cur_pid;
+      spin_unlock_irqrestore(&term[terminal_id].lock, flags);
+    }
+    prepare_user_entry(cur_process, entry_point, USER_STACK_ADDRESS - FOUR_BYTES); /* Runs when the scheduler picks it, starting at entry_point */
+    if (spawn || background) {
+      enqueue_task(cur_process);
+      return SYSCALL_SUCCESS;
+    }
+    /* Step 6: Hand the processor to the child and wait for its halt() */
+    parent_process = get_active_pcb();
+    cli(); /* The child may halt as soon as it is queued, its wake-up must find us asleep */
+    parent_process -> child_pid = cur_pid;
+    enqueue_task(cur_process);
+    while (parent_process -> child_pid != INVALID_PID) {
+      sleep_on(&child_queue);
+    }
+    return parent_process -> child_status; /* The child's exit status */
 
   }
 
@@ -305,7 +462,7 @@ pcb_t* get_pcb(int32_t pid) {
  */
 int32_t open (const uint8_t* filename) {
   pcb_t* cur_pcb = get_active_pcb();
-  return fs_abs_open(cur_pcb -> file_desc_array, (const char*)filename);
+  return fs_abs_open(&cur_pcb -> leader -> file_desc_table, (const char*)filename);
 }
 
 /* int32_t close()
@@ -317,7 +474,7 @@ int32_t open (const uint8_t* filename) {
  */
 int32_t close (int32_t fd) {
   pcb_t* cur_pcb = get_active_pcb();
-  return fs_abs_close(cur_pcb -> file_desc_array, fd);
+  return fs_abs_close(&cur_pcb -> leader -> file_desc_table, fd);
 }
 
 /* int32_t read()
@@ -329,7 +486,7 @@ int32_t close (int32_t fd) {
  */
 int32_t read (int32_t fd, void* buf, int32_t nbytes) {
   pcb_t* cur_pcb = get_active_pcb();
-  return fs_abs_read(cur_pcb -> file_desc_array, fd, buf, nbytes);
+  return fs_abs_read(&cur_pcb -> leader -> file_desc_table, fd, buf, nbytes);
 }
 
 /* int32_t write()
@@ -341,7 +498,7 @@ int32_t read (int32_t fd, void* buf, int32_t nbytes) {
  */
 int32_t write (int32_t fd, const void* buf, int32_t nbytes) {
   pcb_t* cur_pcb = get_active_pcb();
-  return fs_abs_write(cur_pcb -> file_desc_array, fd, buf, nbytes);
+  return fs_abs_write(&cur_pcb -> leader -> file_desc_table, fd, buf, nbytes);
 }
 
 /* int32_t halt()
@@ -358,15 +515,87 @@ int32_t write (int32_t fd, const void* buf, int32_t nbytes) {
    return result;
  }
 
+/* void reap_thread()
+ * Description: Releases an exited thread once its exit status has been collected.
+ * Inputs: pcb_t* thread (A TASK_ZOMBIE thread)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Frees its pid and kernel stack. Called with interrupts off.
+ */
+static void reap_thread(pcb_t* thread) {
+  thread -> state = TASK_RUNNABLE; /* Same as finish_task_switch() does for a dead task */
+  free_pid(thread -> cur_pid);
+}
+
+/* void kill_thread()
+ * Description: Makes another thread of an exiting process exit. It can't be stopped wherever it
+ *              is, so it is flagged and brought to a point where it holds nothing: a sleeping
+ *              one is woken and its sleep loop gives up, one running in user mode on another
+ *              processor is sent into scheduler(), and a queued one exits once it runs.
+ * Inputs: pcb_t* thread (Thread to kill)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: May send a reschedule IPI. Called with interrupts off.
+ */
+static void kill_thread(pcb_t* thread) {
+  uint32_t idx; /* Processor looked at */
+  thread -> killed = 1;
+  if (thread -> state == TASK_SLEEPING) {
+    wake_task(thread);
+    return;
+  }
+  for (idx = 0; idx < nr_cpus; idx++) {
+    if (&cpus[idx] != this_cpu() && cpus[idx].running_pid == thread -> cur_pid) {
+      smp_send_resched(&cpus[idx]);
+    }
+  }
+}
+
+/* uint32_t thread_killed()
+ * Description: Tells whether the running task was killed by its process's exit. Sleep loops the
+ *              task may be in give up when it was, so it gets back to a point where it can exit.
+ * Inputs: None
+ * Output: None
+ * Returned Value: 1 if it was, 0 otherwise
+ * Side Effects: None
+ */
+uint32_t thread_killed() {
+  pcb_t* cur_pcb; /* Running task */
+  cur_pcb = get_active_pcb();
+  return cur_pcb && cur_pcb -> killed;
+}
+
+/* void thread_exit_if_killed()
+ * Description: Ends the running thread if its process exited. Only does so where the thread holds
+ *              nothing but the kernel lock of its one kernel entry: on its way back to user mode
+ *              from a syscall or from its start, and when preempted in user mode or yielding.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None, or does not return
+ * Side Effects: May switch away for good.
+ */
+void thread_exit_if_killed() {
+  pcb_t* cur_pcb; /* Running task */
+  cur_pcb = get_active_pcb();
+  if (cur_pcb && cur_pcb -> killed && cur_pcb -> lock_depth == 1) {
+    thread_exit(EXCEPTION_IDX);
+  }
+}
+
 /* int32_t halt_helper()
- * Description: A helper to the syscall that attempts to halt.
+ * Description: A helper to the syscall that attempts to halt. From a thread other than the main
+ *              one it only ends that thread. The main thread kills the others instead of waiting
+ *              for them, which could take forever. Since they run in its address space, it stays
+ *              a zombie until the last one has exited and freed it.
  * Inputs: uint8_t status (Process Status)
  * Output: Halts a process
- * Returned Value: Integer to signify success/failure. Shall always succeed.
- * Side Effects: Halts a process.
+ * Returned Value: None, the process never runs again
+ * Side Effects: Hands the status to the parent's execute() and switches away for good.
  */
 int32_t halt_helper (uint8_t status) {
    uint32_t status_augmented;
+   int32_t pid; /* Index in the process table */
+   pcb_t* thread; /* Thread being reaped */
    status_augmented = status;
    if (halt_flag) {
      status_augmented = EXCEPTION_IDX;
@@ -374,70 +603,180 @@ int32_t halt_helper (uint8_t status) {
    }
    pcb_t* cur_pcb; /* Current pcb */
    pcb_t* parent_pcb; /* Parent pcb */
-   int fd_array_idx; /* The index in file descriptor array */
-   uint32_t ref_parent_pid; /* Parent pid of current process */
-   uint32_t kernel_stack_start_address; /* The starting address of the kernel stack */
-   uint32_t dir_idx; /* Directory index */
-   uint32_t vm_idx; /* Video memory index in page tables */
    cur_pcb = get_active_pcb(); /* Refer to the active process */
-   for (fd_array_idx = 0; fd_array_idx < MAX_OPENED_FILES; fd_array_idx++) {
-     fs_abs_close(cur_pcb -> file_desc_array, fd_array_idx); /* Close every file */
+   if (cur_pcb -> leader != cur_pcb) {
+     return thread_exit(status_augmented);
    }
-   if (cur_pcb -> parent_pid == INVALID_PID) { /* If it is the only process */
-     cur_pcb -> existent = FALSE_; /* Current process marked as inexistent */
-     running_process_id = INVALID_PID; /* No current running process at this moment */
-     term[running_terminal].running_process = INVALID_PID; /* Running terminal has no process now */
-     execute_helper((uint8_t*)"shell"); /* Creates a new shell */
-     return SYSCALL_SUCCESS;
+   for (pid = 0; pid < MAX_NUM_PROCESSES; pid++) { /* Interrupts are off since halt(), no exit can slip in */
+     thread = get_pcb(pid);
+     if (thread -> existent && thread != cur_pcb && thread -> leader == cur_pcb) {
+       if (thread -> state == TASK_ZOMBIE) { /* Nobody is left to join it */
+         reap_thread(thread);
+       } else {
+         kill_thread(thread);
+       }
+     }
    }
-   /* Default situation: process has a parent process */
-   cur_pcb -> existent = FALSE_; /* Current process marked as inexistent */
-   kernel_stack_start_address = KERNEL_START_ADD + KERNEL_PAGE_SIZE; /* place the first task's kernel stak at the bottom of the 4 MB kernel page */
-   tss.esp0 = kernel_stack_start_address - (cur_pcb->parent_pid) * PCB_STACK_SIZE; /* Stack segment*/
-   ref_parent_pid = cur_pcb -> parent_pid; /* Load parent pid */
-   parent_pcb = get_pcb(ref_parent_pid); /* Load parent pcb */
-   dir_idx = (uint32_t) PROGRAM_IMG_ADDRESS >> DIR_OFFSET; /* Get the current page_dir entry */
-   page_directory[dir_idx].present_4mb = 1; /* Mark Presense */
-   page_directory[dir_idx].read_write_4mb = 1; /* Read and write */
-   page_directory[dir_idx].user_supervisor_4mb = 1; /* Mark User-Accessible */
-   page_directory[dir_idx].write_through_4mb = 0; /* Write-through Caching Disabled */
-   page_directory[dir_idx].cache_disabled_4mb = 0; /* Page is cached */
-   page_directory[dir_idx].accessed_4mb = 0; /* Not read/ written to */
-   page_directory[dir_idx].dirty_4mb = 0; /* Not dirty */
-   page_directory[dir_idx].page_size_4mb = 1; /* 4 MB page */
-   page_directory[dir_idx].global_page_4mb = 0; /* Page is local */
-   page_directory[dir_idx].avail_4mb = 0; /* Free bits not initialized */
-   page_directory[dir_idx].pat_memory_type_4mb = 0; /* Not modified */
-   page_directory[dir_idx].reserved_4mb = 0; /* Not modified */
-   page_directory[dir_idx].page_start_add_4mb = PROCESS_BASE_ADDRESS + ref_parent_pid; /* Physical add*/
-   vm_idx = ((VID_MEM_ADD & MASK_21_12) >> TBL_OFFSET);
-   if (running_terminal == visible_terminal) { /* When process is displayed */
-     page_table[vm_idx].page_start_add = vm_idx; /* Put it on vid. mem. */
-   } else { /* When process is running in another terminal */
-     page_table[vm_idx].page_start_add = vm_idx + 1 + parent_pcb -> terminal_id; /* Put it in subsequent mem. */
+   fs_abs_destroy(&cur_pcb -> file_desc_table); /* Close every file and return grown chunks */
+   if (cur_pcb -> background) {
+     /* Nobody waits for a background job */
+   } else if (cur_pcb -> parent_pid == INVALID_PID) { /* A base shell: start a new one on its terminal */
+     launch_program((uint8_t*)"shell", cur_pcb -> terminal_id, TRUE_);
+   } else { /* Default situation: the parent sleeps in execute() until we are done */
+     parent_pcb = get_pcb(cur_pcb -> parent_pid); /* Load parent pcb */
+     parent_pcb -> child_status = status_augmented;
+     parent_pcb -> child_pid = INVALID_PID;
+     spin_lock(&term[cur_pcb -> terminal_id].lock); /* Interrupts are off since halt() */
+     term[cur_pcb -> terminal_id].running_process = parent_pcb -> cur_pid; /* Update terminal array */
+     term[cur_pcb -> terminal_id].pcb = parent_pcb;
+     spin_unlock(&term[cur_pcb -> terminal_id].lock);
+     wake_up(&child_queue);
    }
-   asm volatile ( /* Flush the TLB by writing to register cr3 */
-      "movl %%cr3, %%eax     ;"
-      "movl %%eax, %%cr3     ;"
-      : /* No outputs */
-      : /* No inputs */
-      : "eax", "cc"  /* Clobbers */
-      );
-   running_process_id = ref_parent_pid; /* PID of running process becomes that of the parent */
-   term[running_terminal].running_process = ref_parent_pid; /* Update terminal array */
-   term[running_terminal].pcb=get_pcb(ref_parent_pid);
-   asm volatile ( /* Store status in register eax */
-      "movl %%ecx, %%esp     ;"
-      "movl %%edx, %%ebp     ;"
-      "movl %%ebx, %%eax     ;"
-      "leave                 ;"
-      "ret                   ;"
-      : /* No outputs */
-      : "b"(status_augmented), "c"(cur_pcb->parent_esp), "d"(cur_pcb->parent_ebp)/* Inputs */
-      );
-   return SYSCALL_SUCCESS; /* Just function custom */
+   if (cur_pcb -> nr_threads) {
+     scheduler_exit(TASK_ZOMBIE); /* The last thread to exit frees our pid, kernel stack and address space */
+   }
+   scheduler_exit(TASK_DEAD); /* Whoever runs next frees our pid, kernel stack and address space */
+   return SYSCALL_SUCCESS; /* Not reached */
  }
 
+/* int32_t user_range_served()
+ * Description: Tells whether a range of user memory lies in one of the regions the page fault
+ *              handler serves, so the kernel can touch it without faulting for good.
+ * Inputs: pcb_t* proc (Main thread of the process), uint32_t start, uint32_t end (Range, end excluded)
+ * Output: None
+ * Returned Value: 1 if served, 0 otherwise
+ * Side Effects: None
+ */
+static int32_t user_range_served(pcb_t* proc, uint32_t start, uint32_t end) {
+  if (end < start) {
+    return 0;
+  }
+  return (start >= PROGRAM_IMG_ADDRESS && end <= proc -> image_end) || /* Image and bss */
+         (start >= USER_STACK_LIMIT && end <= USER_STACK_ADDRESS) || /* Main stack */
+         (start >= USER_HEAP_START && end <= proc -> brk); /* Heap */
+}
+
+/* int32_t thread_create()
+ * Description: A syscall that starts another thread of the calling process. The thread shares
+ *              the address space, heap and open files, and has its own kernel stack and
+ *              schedules on its own, so it may run on another processor. The caller allocates
+ *              the thread's user stack; the thread starts at entry as if called with arg, and
+ *              returning from entry faults, so it ends with thread_exit(). The stack has to
+ *              be in the image and bss, the main stack's range or the heap below the break,
+ *              where page_fault_handler() serves a write that isn't mapped yet.
+ * Inputs: void* entry (First instruction), void* arg (Argument passed to entry),
+ *         void* stack_top (Top of the user stack the thread runs on)
+ * Output: None
+ * Returned Value: Integer. The new thread's id upon success, -1 upon failure
+ * Side Effects: Writes the argument to the top of the new stack. Queues the thread.
+ */
+int32_t thread_create (void* entry, void* arg, void* stack_top) {
+  pcb_t* cur_pcb; /* Calling thread */
+  pcb_t* leader; /* Main thread of the process */
+  pcb_t* thread; /* New thread */
+  int32_t tid; /* Its pid */
+  uint32_t* sp; /* Its initial user stack pointer */
+  uint32_t top; /* stack_top, word aligned */
+  uint32_t flags; /* Saved EFLAGS */
+  cur_pcb = get_active_pcb();
+  leader = cur_pcb -> leader;
+  top = (uint32_t)stack_top & ~(FOUR_BYTES - 1);
+  if ((uint32_t)entry < USER_IMAGE_START || (uint32_t)entry >= USER_HEAP_LIMIT) {
+    return SYSCALL_FAILURE; /* Sanity check: code has to be in the user address range */
+  }
+  if (!user_range_served(leader, top - 2 * FOUR_BYTES, top)) {
+    return SYSCALL_FAILURE; /* The two words pushed below have to be user memory the page fault handler serves */
+  }
+  tid = get_available_tid(); /* Before touching the stack, so a full table changes nothing */
+  if (tid == INVALID_PID) {
+    return SYSCALL_FAILURE;
+  }
+  sp = (uint32_t*)top;
+  *(--sp) = (uint32_t)arg; /* Same address space as ours, so the stack is written right here */
+  *(--sp) = 0; /* Return address: entry must not return */
+  thread = get_pcb(tid);
+  thread -> page_dir = leader -> page_dir; /* It runs in the process's */
+  thread -> leader = leader;
+  thread -> parent_pid = cur_pcb -> cur_pid;
+  thread -> terminal_id = cur_pcb -> terminal_id;
+  thread -> background = TRUE_; /* Never owns the terminal, the main thread does */
+  thread -> nice = cur_pcb -> nice;
+  thread -> killed = cur_pcb -> killed; /* Started by a killed thread, it exits before running */
+  memcpy(thread -> arg, leader -> arg, MAX_ARG_LENGTH + 1);
+  prepare_user_entry(thread, (uint32_t)entry, (uint32_t)sp);
+  cli_and_save(flags);
+  leader -> nr_threads++;
+  enqueue_task(thread);
+  restore_flags(flags);
+  return tid;
+}
+
+/* int32_t thread_exit()
+ * Description: A syscall that ends the calling thread. Its status stays around for
+ *              thread_join(). Called from the main thread it halts the process instead. A
+ *              thread killed by the process's exit has nobody to join it; the last one frees
+ *              the process.
+ * Inputs: int32_t status (Exit status)
+ * Output: None
+ * Returned Value: None, the thread never runs again
+ * Side Effects: Wakes threads waiting to join.
+ */
+int32_t thread_exit (int32_t status) {
+  pcb_t* cur_pcb; /* Exiting thread */
+  pcb_t* leader; /* Main thread of its process */
+  cur_pcb = get_active_pcb();
+  leader = cur_pcb -> leader;
+  if (leader == cur_pcb) {
+    return halt((uint8_t)status);
+  }
+  cli(); /* Joiners must not see the zombie until we are off the processor */
+  cur_pcb -> exit_status = status;
+  leader -> nr_threads--;
+  if (cur_pcb -> killed) {
+    if (!leader -> nr_threads && leader -> state == TASK_ZOMBIE) {
+      free_pid(leader -> cur_pid); /* Also unloads the address space we run on */
+    }
+    scheduler_exit(TASK_DEAD); /* Whoever runs next frees our pid and kernel stack */
+  }
+  wake_up(&thread_queue);
+  scheduler_exit(TASK_ZOMBIE); /* The joiner, or the exiting process, frees our pid and kernel stack */
+  return SYSCALL_SUCCESS; /* Not reached */
+}
+
+/* int32_t thread_join()
+ * Description: A syscall that waits for another thread of the calling process to exit, then
+ *              releases it.
+ * Inputs: int32_t tid (Thread to wait for)
+ * Output: None
+ * Returned Value: Integer. The thread's exit status upon success, -1 upon failure
+ * Side Effects: May block the caller.
+ */
+int32_t thread_join (int32_t tid) {
+  pcb_t* cur_pcb; /* Joining thread */
+  pcb_t* thread; /* Thread waited for */
+  int32_t status; /* Its exit status */
+  uint32_t flags; /* Saved EFLAGS */
+  cur_pcb = get_active_pcb();
+  thread = get_pcb(tid);
+  cli_and_save(flags);
+  if (thread == NULL || thread == cur_pcb || thread -> existent == FALSE_ ||
+      thread -> leader != cur_pcb -> leader || thread == thread -> leader) {
+    restore_flags(flags);
+    return SYSCALL_FAILURE; /* Only threads of our own process, and never the main one */
+  }
+  while (thread -> state != TASK_ZOMBIE) {
+    sleep_on(&thread_queue);
+    if (thread -> existent == FALSE_ || thread -> leader != cur_pcb -> leader || cur_pcb -> killed) {
+      restore_flags(flags);
+      return SYSCALL_FAILURE; /* Another joiner got it first, or the process exited */
+    }
+  }
+  status = thread -> exit_status;
+  reap_thread(thread);
+  restore_flags(flags);
+  return status;
+}
+
 /* int32_t getargs()
  * Description: A syscall that gets the argument of current processing executable. Argument copied to buf
  * Inputs: const uint8_t* buf, int32_t nbytes
@@ -477,8 +816,7 @@ int32_t getargs (uint8_t* buf, int32_t nbytes) {
  */
  int32_t vidmap (uint8_t** screen_start) {
    pcb_t* cur_pcb; /* Current pcb of running process */
-   uint32_t dir_idx; /* Directory index for program (32) */
-   uint32_t vm_idx; /* Index in page table for video memory */
+   pde_instance* page_dir; /* Kernel view of its page directory */
    uint32_t user_video_address; /* Address for user video */
    if (!screen_start) { /* Sanity Check: Input pointer has to be valid */
      return SYSCALL_FAILURE;
@@ -487,22 +825,10 @@ int32_t getargs (uint8_t* buf, int32_t nbytes) {
      return SYSCALL_FAILURE; /* Sanity check: screen_start has to be within the range of user program img */
    }
    cur_pcb = get_active_pcb();
-   dir_idx = (uint32_t) PROGRAM_IMG_ADDRESS >> DIR_OFFSET; /* Get the current page_dir entry */
-   page_directory[dir_idx].present_4mb = 1; /* Mark Presense */
-   page_directory[dir_idx].read_write_4mb = 1; /* Read and write */
-   page_directory[dir_idx].user_supervisor_4mb = 1; /* Mark User-Accessible */
-   page_directory[dir_idx].page_size_4mb = 1; /* 4 MB page */
-   page_directory[dir_idx].page_start_add_4mb = PROCESS_BASE_ADDRESS + running_process_id; /* Physical address */
-   vm_idx = ((VID_MEM_ADD & MASK_21_12) >> TBL_OFFSET); /* Get video memory index */
-   if (visible_terminal == running_terminal) {/* Process is on screen */
-      page_table[vm_idx].page_start_add = vm_idx;
-      user_vidmap_page_table[vm_idx].page_start_add = vm_idx; /* Load page address */
-      user_vidmap_page_table[vm_idx].present = 1; /* Mark presense */
-   } else { /* Process not on screen */
-      page_table[vm_idx].page_start_add = vm_idx + 1 + cur_pcb -> terminal_id; /* Put it in subsequent mem. */
-      user_vidmap_page_table[vm_idx].page_start_add = vm_idx + 1 + cur_pcb -> terminal_id; /* Update user video mapping PT */
-      user_vidmap_page_table[vm_idx].present = 1; /* Mark Presense */
-   }
+   page_dir = PHYS_TO_VIRT(cur_pcb -> page_dir);
+   /* The terminal's own table follows it on and off screen, see switch_terminal() */
+   page_dir[PT_USER_VIDMAP_LOCATION].tbl_start_add_4kb =
+      ((uint32_t)user_vidmap_page_table[cur_pcb -> terminal_id]) >> TBL_OFFSET;
    asm volatile ( /* Flush the TLB by writing to register cr3 */
       "movl %%cr3, %%eax     ;"
       "movl %%eax, %%cr3     ;"
@@ -515,3 +841,206 @@ int32_t getargs (uint8_t* buf, int32_t nbytes) {
    return SYSCALL_SUCCESS; /* Return success upon finish */
  }
 
+/* int32_t set_handler()
+ * Description: Reserved syscall number 9. Signals are not supported.
+ * Inputs: int32_t signum, void* handler_address
+ * Output: None
+ * Returned Value: Integer. Always -1
+ * Side Effects: None
+ */
+int32_t set_handler (int32_t signum, void* handler_address) {
+  return SYSCALL_FAILURE;
+}
+
+/* int32_t sigreturn()
+ * Description: Reserved syscall number 10. Signals are not supported.
+ * Inputs: None
+ * Output: None
+ * Returned Value: Integer. Always -1
+ * Side Effects: None
+ */
+int32_t sigreturn (void) {
+  return SYSCALL_FAILURE;
+}
+
+/* int32_t brk()
+ * Description: A syscall that moves the program break. Growing only reserves address space;
+ *              pages are backed with zero-filled frames by the page-fault handler on first touch.
+ * Inputs: void* addr (New end of the heap)
+ * Output: Updated break in the pcb. Returned integer to signify Success/Failure.
+ * Returned Value: Integer. 0 upon success, -1 upon failure
+ * Side Effects: Shrinking frees the pages above the new break.
+ */
+int32_t brk (void* addr) {
+  pcb_t* cur_pcb; /* Current pcb of running process */
+  cur_pcb = get_active_pcb() -> leader; /* The break belongs to the whole process */
+  if ((uint32_t)addr < USER_HEAP_START || (uint32_t)addr > USER_HEAP_LIMIT) {
+    return SYSCALL_FAILURE; /* Sanity check: the break has to stay in the heap region */
+  }
+  if ((uint32_t)addr < cur_pcb -> brk) { /* Give back whole pages past the new break */
+    unmap_user_range(cur_pcb -> page_dir, (uint32_t)addr, cur_pcb -> brk);
+    if (cur_pcb -> nr_threads) {
+      flush_tlb_all(); /* Its threads may be running on other processors */
+    }
+  }
+  cur_pcb -> brk = (uint32_t)addr;
+  return SYSCALL_SUCCESS;
+}
+
+/* int32_t sbrk()
+ * Description: A syscall that grows or shrinks the heap by a number of bytes.
+ * Inputs: int32_t increment (Bytes to add to the break, may be negative)
+ * Output: Updated break in the pcb.
+ * Returned Value: Integer. Previous break upon success, -1 upon failure
+ * Side Effects: Same as brk()
+ */
+int32_t sbrk (int32_t increment) {
+  uint32_t old_brk; /* Break before the call */
+  old_brk = get_active_pcb() -> leader -> brk;
+  if (brk((void*)(old_brk + increment)) == SYSCALL_FAILURE) {
+    return SYSCALL_FAILURE;
+  }
+  return (int32_t)old_brk; /* Heap lives below 2GB, so the address fits */
+}
+
+/* int32_t idlestat()
+ * Description: A syscall that reports how much of the time the processor had nothing to run.
+ * Inputs: idle_stat_t* buf (User buffer)
+ * Output: Copies the idle task's accounting to buf
+ * Returned Value: Integer. 0 upon success, -1 upon failure
+ * Side Effects: None
+ */
+int32_t idlestat (idle_stat_t* buf) {
+  if ((uint32_t)buf < USER_IMAGE_START || (uint32_t)buf > USER_HEAP_LIMIT - sizeof(idle_stat_t)) {
+    return SYSCALL_FAILURE; /* Sanity check: buffer has to be in the user address range */
+  }
+  get_idle_stat(buf);
+  return SYSCALL_SUCCESS;
+}
+
+/* int32_t nice()
+ * Description: A syscall that changes the running task's nice value, keeping it in range.
+ *              Lower values are scheduled first and get longer slices.
+ * Inputs: int32_t inc (Amount to add to the nice value, may be negative)
+ * Output: Updated nice value in the pcb
+ * Returned Value: Integer. The new nice value
+ * Side Effects: Takes effect the next time the task is queued.
+ */
+int32_t nice (int32_t inc) {
+  pcb_t* cur_pcb; /* Current pcb of running process */
+  int32_t value; /* New nice value */
+  cur_pcb = get_active_pcb();
+  value = cur_pcb -> nice + inc;
+  if (value < NICE_MIN) {
+    value = NICE_MIN;
+  }
+  if (value > NICE_MAX) {
+    value = NICE_MAX;
+  }
+  cur_pcb -> nice = value;
+  return value;
+}
+
+/* int32_t sleep()
+ * Description: A syscall that puts the caller to sleep for a number of seconds.
+ * Inputs: uint32_t seconds
+ * Output: None
+ * Returned Value: Integer. Always 0, there are no signals to cut the sleep short
+ * Side Effects: The caller uses no processor time until it wakes.
+ */
+int32_t sleep (uint32_t seconds) {
+  timer_sleep((seconds > MAX_TIMEOUT / MSEC_PER_SEC) ? MAX_TIMEOUT : seconds * MSEC_PER_SEC / TIMER_TICK_MS);
+  return SYSCALL_SUCCESS;
+}
+
+/* int32_t nanosleep()
+ * Description: A syscall that puts the caller to sleep for a duration, rounded up to jiffies.
+ * Inputs: const timespec_t* req (Duration)
+ * Output: None
+ * Returned Value: Integer. 0 upon success, -1 upon failure
+ * Side Effects: The caller uses no processor time until it wakes.
+ */
+int32_t nanosleep (const timespec_t* req) {
+  uint32_t timeout; /* Jiffies to sleep */
+  if ((uint32_t)req < USER_IMAGE_START || (uint32_t)req > USER_HEAP_LIMIT - sizeof(timespec_t)) {
+    return SYSCALL_FAILURE; /* Sanity check: the duration has to be in the user address range */
+  }
+  if (req -> tv_nsec >= NSEC_PER_MSEC * MSEC_PER_SEC) {
+    return SYSCALL_FAILURE;
+  }
+  timeout = (req -> tv_nsec + NSEC_PER_MSEC * TIMER_TICK_MS - 1) / (NSEC_PER_MSEC * TIMER_TICK_MS);
+  if (req -> tv_sec > (MAX_TIMEOUT - timeout) / MSEC_PER_SEC) {
+    timeout = MAX_TIMEOUT;
+  } else {
+    timeout += req -> tv_sec * MSEC_PER_SEC / TIMER_TICK_MS;
+  }
+  timer_sleep(timeout);
+  return SYSCALL_SUCCESS;
+}
+
+/* int32_t yield()
+ * Description: A syscall that gives the processor to the next runnable task right away instead
+ *              of spinning until the time slice ends.
+ * Inputs: None
+ * Output: None
+ * Returned Value: Integer. Always 0
+ * Side Effects: Switches to another task if one is runnable.
+ */
+int32_t yield (void) {
+  sched_yield();
+  return SYSCALL_SUCCESS;
+}
+
+/* int32_t taskstat()
+ * Description: A syscall that reports the CPU time a task spent in user mode, in the kernel and
+ *              in interrupt handlers, and how often it was switched out.
+ * Inputs: int32_t pid (Task to report, negative for the caller), task_stat_t* buf (User buffer)
+ * Output: Copies the task's accounting to buf
+ * Returned Value: Integer. 0 upon success, -1 upon failure
+ * Side Effects: None
+ */
+int32_t taskstat (int32_t pid, task_stat_t* buf) {
+  pcb_t* pcb; /* Task to report */
+  if ((uint32_t)buf < USER_IMAGE_START || (uint32_t)buf > USER_HEAP_LIMIT - sizeof(task_stat_t)) {
+    return SYSCALL_FAILURE; /* Sanity check: buffer has to be in the user address range */
+  }
+  pcb = (pid < 0) ? get_active_pcb() : get_pcb(pid);
+  if (pcb == NULL || pcb -> existent == FALSE_) {
+    return SYSCALL_FAILURE;
+  }
+  get_task_stat(pcb, buf);
+  return SYSCALL_SUCCESS;
+}
+
+/* int32_t futex()
+ * Description: A syscall that lets user programs sleep on a word of their memory instead of
+ *              spinning on it. FUTEX_WAIT sleeps until a FUTEX_WAKE on the same word, unless
+ *              the word no longer holds val; FUTEX_WAKE wakes up to val sleepers. User locks
+ *              only make this call when they are contended.
+ * Inputs: uint32_t* addr (Aligned user word), int32_t op (FUTEX_WAIT or FUTEX_WAKE),
+ *         uint32_t val (Expected value for a wait, most tasks to wake for a wake)
+ * Output: None
+ * Returned Value: Integer. For a wait 0 once woken, for a wake the number of tasks woken;
+ *                 -1 upon failure or when the word had already changed
+ * Side Effects: A wait blocks the caller.
+ */
+int32_t futex (uint32_t* addr, int32_t op, uint32_t val) {
+  uint32_t key; /* Physical address of the word */
+  if (((uint32_t)addr & (sizeof(uint32_t) - 1)) ||
+      !user_range_served(get_active_pcb() -> leader, (uint32_t)addr, (uint32_t)addr + sizeof(uint32_t))) {
+    return SYSCALL_FAILURE; /* Sanity check: an aligned word of user memory the page fault handler serves */
+  }
+  (void)*(volatile uint32_t*)addr; /* Faults the page in if it was never touched */
+  key = virt_to_phys(get_active_pcb() -> page_dir, (uint32_t)addr);
+  if (key == NO_FRAME) {
+    return SYSCALL_FAILURE;
+  }
+  switch (op) {
+    case FUTEX_WAIT:
+      return futex_wait(key, val);
+    case FUTEX_WAKE:
+      return futex_wake(key, val);
+    default:
+      return SYSCALL_FAILURE;
+  }
+}
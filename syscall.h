@@ -8,12 +8,14 @@
 #include "types.h"
 #include "lib.h"
 #include "x86_desc.h"
+#include "smp.h" /* running_process_id is per processor */
 #include "fs.h"
 #include "fs_abstraction.h" /* Uses file sys abstraction */
 #include "paging.h"
 #include "rtc.h"
 #include "keyboard.h"
 #include "terminal.h"
+#include "futex.h"
 
 #define SYSCALL_SUCCESS 0
 #define SYSCALL_FAILURE -1
@@ -23,7 +25,7 @@
 #define KERNEL_START_ADD 0x400000 /* Kernel starts at 4 MB */
 #define KERNEL_PAGE_SIZE 0x400000 /* A kernal page is 4 MB large */
 #define FOUR_MB  0x400000 /* 4MB has 0x400000 bytes */
-#define PCB_STACK_SIZE 0x2000 /* Each pcb owns a 8 KB stack */
+#define PCB_STACK_SIZE 0x2000 /* Each process owns a 8 KB kernel stack */
 #define FILE_HEADER_LENGTH 40 /* By document, file header is 40 bytes long */
 #define EXE_HEADER_MAGIC_0 0x7F /* Executable file byte 0 magic # */
 #define EXE_HEADER_MAGIC_1 0x45 /* Executable file byte 1 magic # */
@@ -31,12 +33,17 @@
 #define EXE_HEADER_MAGIC_3 0x46 /* Executable file byte 3 magic # */
 #define DIR_OFFSET 22 /* Page directory address has offset 22 */
 #define PROGRAM_IMG_ADDRESS 0x08048000 /* Program image address */
-#define PROCESS_BASE_ADDRESS 2 /* Process page starts at 8MB (2 4MB pages) */
-#define REF_EXE_FILE_LEN 0x2000 /* Referenced file length for reading to userspace */
 #define FOUR_BYTES 0x4 /* 4 bytes used for calculating starting address of stacks */
 #define USER_STACK_ADDRESS 0x08400000 /* Start of user stack */
+#define USER_STACK_MAX_SIZE 0x00100000 /* The user stack can grow down to 1MB */
+#define USER_STACK_LIMIT (USER_STACK_ADDRESS - USER_STACK_MAX_SIZE) /* Lowest address the stack may grow to */
 #define ENTRY_PT_OFFSET 24 /* Entry point starting byte */
-#define MAX_NUM_PROCESSES 6 /* Checkpoint 5 regulates that at most 6 programs running */
+#define ELF_PHOFF_OFFSET 28 /* Program header table offset starting byte */
+#define ELF_PHNUM_OFFSET 44 /* Number of program headers starting byte */
+#define ELF_PHDR_SIZE 32 /* Size of a program header */
+#define ELF_PT_LOAD 1 /* Program header type of a loaded segment */
+#define MAX_NUM_PROCESSES IDMAP_MAX_IDS /* Size of the process table (256 pcbs) */
+#define EXECUTE_QUEUE_ON_LIMIT 1 /* When set, execute waits in line for a free process slot instead of failing */
 #define SYSCALL_TOO_MANY_PROCESSES 2 /* A random number between 1 and 255 */
 #define INVALID_PID -1 /* -1 stands for an invalid allocated pid */
 #define EXCEPTION_IDX 256 /*value of status when halted because of exception */
@@ -55,10 +62,44 @@ int32_t halt (uint8_t status);
 int32_t getargs (uint8_t* buf, int32_t nbytes);
 int32_t vidmap (uint8_t** screen_start);
 
+/* System calls set_handler, sigreturn (reserved, not supported) */
+int32_t set_handler (int32_t signum, void* handler_address);
+int32_t sigreturn (void);
+
+/* System calls brk, sbrk */
+int32_t brk (void* addr);
+int32_t sbrk (int32_t increment);
+
+/* System call idlestat */
+int32_t idlestat (idle_stat_t* buf);
+
+/* System call nice */
+int32_t nice (int32_t inc);
+
+/* System calls sleep, nanosleep */
+int32_t sleep (uint32_t seconds);
+int32_t nanosleep (const timespec_t* req);
+
+/* System call yield */
+int32_t yield (void);
+/* System call taskstat */
+int32_t taskstat (int32_t pid, task_stat_t* buf);
+/* System call futex */
+int32_t futex (uint32_t* addr, int32_t op, uint32_t val);
+/* System calls thread_create, thread_exit, thread_join */
+int32_t thread_create (void* entry, void* arg, void* stack_top);
+int32_t thread_exit (int32_t status);
+int32_t thread_join (int32_t tid);
+
 /* Helper Functions */
 pcb_t* get_active_pcb();
 pcb_t* get_pcb(int32_t pid);
-int32_t get_avaialable_pid();
+int32_t get_available_pid();
+int32_t get_available_tid();
+void free_pid(int32_t pid);
+int32_t wait_for_available_pid();
+uint32_t thread_killed();
+void thread_exit_if_killed();
 pcb_t* file_desc_array_init(pcb_t* cur_pcb);
 void multiterminal_init();
 int32_t execute_helper (const uint8_t* command);
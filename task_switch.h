@@ -0,0 +1,28 @@
+/*
+ * Wrapper file for kernel context switches
+ */
+#ifndef _TASK_SWITCH_H_
+#define _TASK_SWITCH_H_
+
+#include "types.h"
+
+/* Offsets into task_context_t, which starts every pcb */
+#define CTX_EBX 0
+#define CTX_ESI 4
+#define CTX_EDI 8
+#define CTX_EBP 12
+#define CTX_ESP 16
+#define CTX_EIP 20
+#define CTX_EFLAGS 24
+#define CTX_CR3 28
+#define CTX_ESP0 32
+
+#define KERNEL_EFLAGS 0x2 /* EFLAGS a new task starts with in the kernel: interrupts off */
+
+#ifndef ASM
+    extern pcb_t* switch_to(pcb_t* prev, pcb_t* next);
+    extern void user_entry();
+    extern void kthread_entry();
+    extern void call_on_stack(void (*fn)(void), uint32_t stack_top);
+#endif
+#endif
@@ -2,7 +2,7 @@
 
 #include "terminal.h"
 #include "keyboard.h"
-#include "paging.h"
+#include "scheduler.h"
 
 /* Jump table for terminal stdin */
 fs_jump_table_t terminal_stdin_jmptable = {
@@ -39,6 +39,7 @@ void init_terminal(){
         term[i].term_y = 0;
         term[i].buf_idx = 0;
         term[i].enter_flag = 0;
+        spin_lock_init(&term[i].lock, "terminal");
     }
     term[0].vid_mem = TERM0_VIDMEM;
     term[1].vid_mem = TERM1_VIDMEM;
@@ -62,6 +63,8 @@ int32_t terminal_read(int32_t* fd, uint32_t* offset, char* buf, uint32_t nbytes)
     int i; //loop index
     int32_t buff_size;      //temporaly variable to store buffer index, or size
     uint8_t* buf_;
+    int32_t terminal_id;    //terminal of the reading task
+    uint32_t flags;         //saved EFLAGS
     //null check
     if (buf == NULL) {
         return -1;
@@ -76,19 +79,26 @@ int32_t terminal_read(int32_t* fd, uint32_t* offset, char* buf, uint32_t nbytes)
     //cast buf to uint_8
     buf_ = (uint8_t*) buf;
     //return only when enter key is pressed
-    sti();
-    while (term[running_terminal].enter_flag == 0) {}
-    cli();
+    terminal_id = running_terminal;
+    spin_lock_irqsave(&term[terminal_id].lock, flags);
+    while (term[terminal_id].enter_flag == 0) {
+        if (thread_killed()) { /* The process exited, leave the line to whoever reads next */
+            spin_unlock_irqrestore(&term[terminal_id].lock, flags);
+            return -1;
+        }
+        sleep_on_locked(&term[terminal_id].read_queue, &term[terminal_id].lock); /* The keyboard handler wakes us on enter */
+    }
     //copy keyboard buffer to terminal line buffer
-    for (i = 0; i < term[running_terminal].buf_idx + 1; i++) {
-        buf_[i] = term[running_terminal].line_buff[i];
+    for (i = 0; i < term[terminal_id].buf_idx + 1; i++) {
+        buf_[i] = term[terminal_id].line_buff[i];
         buff_size++;
     }
 
     //clear enter flag
-    term[running_terminal].enter_flag = 0;
+    term[terminal_id].enter_flag = 0;
     //clear the keyboard buffer and reset buffer index
-    clear_kayboard_buffer(running_terminal);
+    clear_kayboard_buffer(terminal_id);
+    spin_unlock_irqrestore(&term[terminal_id].lock, flags);
     
     return buff_size;
 }
@@ -104,13 +114,18 @@ int32_t terminal_read(int32_t* fd, uint32_t* offset, char* buf, uint32_t nbytes)
 int32_t terminal_write(int32_t* fd, uint32_t* offset, const char* buf, uint32_t nbytes) {
     int i;  //loop index
     uint8_t* buf_;
+    int32_t terminal_id;    //terminal of the writing task
+    uint32_t flags;         //saved EFLAGS
     if (buf == NULL) {
         return -1;
     }
     buf_ = (uint8_t*) buf;
+    terminal_id = running_terminal;
+    spin_lock_irqsave(&term[terminal_id].lock, flags); /* Keyboard echo moves the same cursor */
     for(i = 0; i < nbytes; i++) {
-        putc(buf_[i], running_terminal);
+        putc(buf_[i], terminal_id);
     }
+    spin_unlock_irqrestore(&term[terminal_id].lock, flags);
     return nbytes;
 
 }
@@ -122,9 +137,12 @@ int32_t terminal_write(int32_t* fd, uint32_t* offset, const char* buf, uint32_t
  * OUTPUT: none
  */ 
 int32_t terminal_open(int32_t* fd, char *filename) {
+    uint32_t flags;         //saved EFLAGS
     clear();
     reset_cursor();
+    spin_lock_irqsave(&term[running_terminal].lock, flags);
     clear_kayboard_buffer(running_terminal);
+    spin_unlock_irqrestore(&term[running_terminal].lock, flags);
     return 0;
 }
 
@@ -146,7 +164,6 @@ int32_t terminal_close(int32_t* fd) {
  */ 
 void switch_terminal(int32_t terminal_id) {
     int32_t term_prev;
-    uint32_t vm_idx; /* Video memory index in page tables */
     /* we check if terminal id is valid over here */
     if (terminal_id < 0) {
         return;
@@ -164,20 +181,14 @@ void switch_terminal(int32_t terminal_id) {
     /*change visible terminal id to the id we are going to change */
     visible_terminal = terminal_id;
 
-    /*restoring the video memory address*/
-    vm_idx = ((VID_MEM_ADD & MASK_21_12) >> TBL_OFFSET);
-    page_table[vm_idx].page_start_add = vm_idx; /* Put it on vid. mem. */
-    asm volatile ( /* Flush the TLB by writing to register cr3 */
-      "movl %%cr3, %%eax     ;"
-      "movl %%eax, %%cr3     ;"
-      : /* No outputs */
-      : /* No inputs */
-      : "eax", "cc"  /* Clobbers */
-      );
-
     /*perform switch by storing current video memory and writing new video memory*/
     memcpy((char*) term[term_prev].vid_mem, (const char*) VID_ADD, VID_MEM_SIZE);
     memcpy((char*) VID_ADD, (const char*) term[visible_terminal].vid_mem, VID_MEM_SIZE);
+
+    /*user vidmap follows once the pages hold the right screens: the old terminal goes to its backing page, the new one on screen*/
+    set_vidmap_target(term_prev, 0);
+    set_vidmap_target(terminal_id, 1);
+    flush_tlb_all(); /* Tasks of both terminals may be running on other processors */
     /*update cursor in needed*/
     update_cursor();
 }
@@ -17,8 +17,6 @@
 
 //visible terminal
 int32_t visible_terminal;
-//running terminal
-int32_t running_terminal;
 
 term_t term[TERM_NUM];
 
@@ -6,6 +6,15 @@
 #include "keyboard.h"
 #include "terminal.h"
 #include "syscall.h"
+#include "fs_abstraction.h"
+#include "scheduler.h"
+#include "workqueue.h"
+#include "softirq.h"
+#include "idt.h"
+#include "task_switch.h"
+#include "fpu.h"
+#include "kthread.h"
+#include "ioapic.h"
 
 #define PASS 1
 #define FAIL 0
@@ -14,9 +23,33 @@
 #define KERNAL_START_ADD   0xB8000
 #define RANDOM_KERNAL_ADD  0xB8567
 #define KERNAL_END_ADD     0xBFFFF
+#define PID_TEST_COUNT     16      /* Fewer free pids than this means memory ran out early */
+#define FD_TEST_COUNT      20
+#define FD_TEST_REUSED     5
 #define VIDEO_MEM_START    0x400000
 #define RANDOM_VIDEO_MEM   0x567890
 #define VIDEO_MEM_END      0x7FFFFF
+#define IF_FLAG            0x200   /* EFLAGS interrupt enable bit */
+#define TASK_TEST_TIMEOUT  1000    /* Jiffies a task test waits for other tasks before failing */
+#define IDLE_TEST_MS       50      /* Milliseconds idle_stat_test sleeps */
+#define WQ_TEST_TASKS      3       /* Sleepers started by wait_queue_test */
+#define PICK_TEST_TASKS    4       /* Tasks queued by pick_order_test */
+#define NICE_TEST_TASKS    3       /* Spinners started by nice_weight_test, one per nice level */
+#define BOOST_TEST_TASKS   2       /* Sleepers woken together by wake_boost_test, one on the visible terminal */
+#define SLEEPER_TASKS_MAX  4       /* Most kernel threads start_sleepers() runs at once */
+#define YIELD_TEST_PEERS   2       /* Tasks queued behind yield_test before it yields */
+#define ACCT_TEST_MS       2       /* Milliseconds task_stat_test spins in the kernel */
+#define ACCT_TEST_THREADS  (MAX_CPUS + 1) /* User threads task_stat_test starts, more than there are processors */
+#define ACCT_TEST_SPIN_MS  (4 * SCHED_LATENCY_MS) /* Milliseconds each one spins, long enough to be preempted */
+#define FPU_TEST_TASKS     2       /* Kernel threads fpu_switch_test runs against each other */
+#define FPU_TEST_ROUNDS    8       /* Times each one sleeps and checks its registers */
+#define FPU_TEST_VALUE     1000    /* Value the first one loads, the next loads one more */
+#define DEMAND_TEST_BYTES  64      /* Bytes of "ls" demand_paging_test compares */
+#define DEMAND_TEST_MAGIC  0x391   /* Value it stores on a grown stack page */
+#define THREAD_TEST_COUNT  2       /* User threads started by thread_test */
+#define THREAD_KILL_SLEEP_S 10     /* Seconds thread_kill_test's thread sleeps unless killed */
+#define SCAN_A             0x1E    /* Scancode softirq_test queues, the A key */
+#define SCAN_BACKSPACE     0x0E    /* Scancode it queues to take the key back */
 
 /* format these macros as you see fit */
 #define TEST_HEADER 	\
@@ -672,10 +705,1675 @@ int test_garbage_open() {
 /* Checkpoint 4 tests */
 /* Checkpoint 5 tests */
 
+/* Process table tests */
+
+/* int pid_allocator_test()
+ * Description: Takes pids until the table (or memory) runs out and checks the next request
+ *              gets INVALID_PID, that every pid is distinct with its own kernel stack, and
+ *              that a freed pid is handed out again, the lowest first
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Temporarily takes every free pid and a page directory for each
+ * Expected outcome: Pass
+ */
+int pid_allocator_test() {
+	TEST_HEADER;
+	static int32_t pids[MAX_NUM_PROCESSES]; /* Pids taken by the test */
+	int32_t num_taken; /* How many pids were handed out */
+	int32_t i;
+	int32_t result = PASS;
+	for (num_taken = 0; num_taken < MAX_NUM_PROCESSES; num_taken++) {
+		pids[num_taken] = get_available_pid();
+		if (pids[num_taken] == INVALID_PID) { /* Memory may run out before the table does */
+			break;
+		}
+	}
+	if (num_taken < PID_TEST_COUNT || get_available_pid() != INVALID_PID) { /* Exhausted stays exhausted */
+		result = FAIL;
+	}
+	for (i = 1; i < num_taken; i++) {
+		if (pids[i] <= pids[i - 1] || get_pcb(pids[i])->kernel_stack == get_pcb(pids[i - 1])->kernel_stack) {
+			result = FAIL;
+		}
+	}
+	if (num_taken > PID_TEST_COUNT) { /* A pid freed in the middle is the only one left */
+		free_pid(pids[PID_TEST_COUNT]);
+		if (get_available_pid() != pids[PID_TEST_COUNT]) {
+			result = FAIL;
+		}
+	}
+	for (i = 0; i < num_taken; i++) {
+		free_pid(pids[i]);
+	}
+	if (num_taken > 0 && get_available_pid() != pids[0]) { /* Lowest pid must come back first */
+		result = FAIL;
+	}
+	if (num_taken > 0) {
+		free_pid(pids[0]);
+	}
+	return result;
+}
+
+/* int idmap_boundary_test()
+ * Description: Fills a bitmap and checks it reports full, that ids on either side of a
+ *              word boundary come back after a free, lowest first, and that ids past the
+ *              limit are never handed out
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  None
+ * Expected outcome: Pass
+ */
+int idmap_boundary_test() {
+	TEST_HEADER;
+	idmap_t map; /* Bitmap under test */
+	int32_t id;
+	int32_t result = PASS;
+	idmap_init(&map, IDMAP_MAX_IDS);
+	for (id = 0; id < IDMAP_MAX_IDS; id++) {
+		if (idmap_alloc(&map) != id) {
+			result = FAIL;
+		}
+	}
+	if (idmap_alloc(&map) != -1 || !idmap_test(&map, IDMAP_MAX_IDS - 1)) {
+		result = FAIL;
+	}
+	idmap_free(&map, IDMAP_WORD_BITS); /* First id of the second word */
+	idmap_free(&map, IDMAP_WORD_BITS - 1); /* Last id of the first word */
+	if (idmap_alloc(&map) != IDMAP_WORD_BITS - 1 || idmap_alloc(&map) != IDMAP_WORD_BITS ||
+	    idmap_alloc(&map) != -1) {
+		result = FAIL;
+	}
+	idmap_init(&map, IDMAP_WORD_BITS + 1); /* Limit one id into the second word */
+	for (id = 0; id <= IDMAP_WORD_BITS; id++) {
+		idmap_alloc(&map);
+	}
+	if (idmap_alloc(&map) != -1) {
+		result = FAIL;
+	}
+	return result;
+}
+
+/* int fd_table_grow_test()
+ * Description: Opens more files than the old eight-slot array held, closes one in the
+ *              middle and checks the lowest free descriptor is handed out again
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Temporarily takes chunks from the fd chunk pool
+ * Expected outcome: Pass
+ */
+int fd_table_grow_test() {
+	TEST_HEADER;
+	fd_table_t table; /* Table owned by the test */
+	int32_t i;
+	int32_t result = PASS;
+	fs_abs_init(&table);
+	for (i = 0; i < FD_TEST_COUNT; i++) {
+		if (fs_abs_open(&table, ".") != STDOUT_IDX + 1 + i) { /* Descriptors come out in order after stdout */
+			result = FAIL;
+		}
+	}
+	if (fs_abs_close(&table, FD_TEST_REUSED) != FS_ABSTRACTION_SUCCESS ||
+	    fs_abs_get(&table, FD_TEST_REUSED) != NULL) {
+		result = FAIL;
+	}
+	if (fs_abs_open(&table, ".") != FD_TEST_REUSED) { /* Lowest hole is reused first */
+		result = FAIL;
+	}
+	if (fs_abs_close(&table, STDIN_IDX) != FS_ABSTRACTION_FAILURE) { /* Terminal stays bound */
+		result = FAIL;
+	}
+	fs_abs_destroy(&table);
+	return result;
+}
+
+
+/* int frame_allocator_test()
+ * Description: Takes two frames, checks they are distinct, page aligned and zeroed,
+ *              then frees one and checks it is handed out again first
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  May carve a 4MB user page into frames
+ * Expected outcome: Pass
+ */
+int frame_allocator_test() {
+	TEST_HEADER;
+	uint32_t first; /* First frame taken */
+	uint32_t second; /* Second frame taken */
+	int32_t result = PASS;
+	first = alloc_zeroed_frame();
+	second = alloc_zeroed_frame();
+	if (first == NO_FRAME || second == NO_FRAME || first == second ||
+	    (first & (PAGE_SIZE_4KB - 1)) || *(uint32_t*)PHYS_TO_VIRT(second) != 0) {
+		result = FAIL;
+	}
+	free_frame(first);
+	if (alloc_frame() != first) { /* Freed frames are reused first */
+		result = FAIL;
+	}
+	free_frame(first);
+	free_frame(second);
+	return result;
+}
+
+/* int tick_device_test()
+ * Description: Checks the timer interrupt source, PIT or APIC, reports a one-shot as pending
+ *              once armed and no longer once stopped
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Leaves the tick device stopped
+ * Expected outcome: Pass
+ */
+int tick_device_test() {
+	TEST_HEADER;
+	uint32_t flags; /* Saved EFLAGS */
+	int32_t result = PASS;
+	cli_and_save(flags);
+	tick_device -> set_oneshot(PIT_MAX_COUNT);
+	if (!tick_device -> is_armed()) {
+		result = FAIL;
+	}
+	tick_device -> stop();
+	if (tick_device -> is_armed()) {
+		result = FAIL;
+	}
+	restore_flags(flags);
+	return result;
+}
+
+/* int ioapic_redir_test()
+ * Description: With the IOAPIC in use, reads back the keyboard's redirection entry: the vector
+ *              the 8259s gave it, unmasked and aimed at the boot processor. disable_irq() and
+ *              enable_irq() must then mask and unmask it. Passes trivially on the 8259s
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  The keyboard IRQ is masked for a moment
+ * Expected outcome: Pass
+ */
+int ioapic_redir_test() {
+	TEST_HEADER;
+	uint32_t low; /* Vector, flags and mask */
+	uint32_t high; /* Destination */
+	uint32_t flags; /* Saved EFLAGS */
+	int32_t result = PASS;
+	if (irq_chip != &ioapic_irq_jmptable) {
+		return PASS;
+	}
+	cli_and_save(flags);
+	if (ioapic_get_redir(KEYBOARD_IRQ, &low, &high) == -1 ||
+	    (low & REDIR_VECTOR_MASK) != ICW2_MASTER + KEYBOARD_IRQ || (low & REDIR_MASKED) ||
+	    (high >> REDIR_DEST_SHIFT) != apic_id()) {
+		result = FAIL;
+	}
+	disable_irq(KEYBOARD_IRQ);
+	if (ioapic_get_redir(KEYBOARD_IRQ, &low, &high) == -1 || !(low & REDIR_MASKED) ||
+	    (low & REDIR_VECTOR_MASK) != ICW2_MASTER + KEYBOARD_IRQ) {
+		result = FAIL;
+	}
+	enable_irq(KEYBOARD_IRQ);
+	if (ioapic_get_redir(KEYBOARD_IRQ, &low, &high) == -1 || (low & REDIR_MASKED)) {
+		result = FAIL;
+	}
+	if (ioapic_get_redir(ISA_IRQS, &low, &high) != -1) {
+		result = FAIL;
+	}
+	restore_flags(flags);
+	return result;
+}
+
+/* int smp_test()
+ * Description: Checks that the tests run on the boot processor, that every processor online
+ *              has its own TSS and that none is left marked offline
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  None
+ * Expected outcome: Pass
+ */
+int smp_test() {
+	TEST_HEADER;
+	uint32_t idx; /* Processor checked */
+	int32_t result = PASS;
+	if (this_cpu() != &cpus[0] || nr_cpus < 1 || nr_cpus > MAX_CPUS) {
+		return FAIL;
+	}
+	for (idx = 0; idx < nr_cpus; idx++) {
+		if (!cpus[idx].online || !cpus[idx].tss || cpus[idx].id != idx) {
+			result = FAIL;
+		}
+		if (idx && cpus[idx].tss == cpus[0].tss) {
+			result = FAIL;
+		}
+	}
+	return result;
+}
+
+/* int migrate_vruntime_test()
+ * Description: Checks that a task moved to this processor keeps its lead on the old
+ *              processor's min_vruntime, and that a lag comes along capped at the largest
+ *              wake-up credit instead of sending it to the front of the run queue
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  None, both processors' min_vruntime are put back
+ * Expected outcome: Pass
+ */
+int migrate_vruntime_test() {
+	TEST_HEADER;
+	pcb_t task; /* Fake task, never queued */
+	cpu_t* cpu; /* This processor */
+	cpu_t* other; /* Processor the task comes from */
+	uint64_t cpu_min; /* Their min_vruntime, put back at the end */
+	uint64_t other_min;
+	uint64_t credit; /* SCHED_MAX_CREDIT_MS in vruntime */
+	uint32_t flags; /* Saved EFLAGS */
+	int32_t result = PASS;
+	memset(&task, 0, sizeof(task));
+	credit = (uint64_t)SCHED_MAX_CREDIT_MS * tsc_khz;
+	cli_and_save(flags);
+	cpu = this_cpu();
+	other = &cpus[(cpu -> id + 1) % MAX_CPUS];
+	cpu_min = cpu -> min_vruntime;
+	other_min = other -> min_vruntime;
+	cpu -> min_vruntime = 10 * credit; /* Both well past the credit, on different clocks */
+	other -> min_vruntime = 20 * credit;
+	task.cpu = other -> id;
+	task.vruntime = other -> min_vruntime + credit / 2; /* Ahead */
+	migrate_vruntime(&task);
+	if (task.cpu != cpu -> id || task.vruntime != cpu -> min_vruntime + credit / 2) {
+		result = FAIL;
+	}
+	task.cpu = other -> id;
+	task.vruntime = other -> min_vruntime - credit / 2; /* Behind, within the credit */
+	migrate_vruntime(&task);
+	if (task.vruntime != cpu -> min_vruntime - credit / 2) {
+		result = FAIL;
+	}
+	task.cpu = other -> id;
+	task.vruntime = other -> min_vruntime - 5 * credit; /* Far behind, like after a long sleep */
+	migrate_vruntime(&task);
+	if (task.vruntime < cpu -> min_vruntime - credit) {
+		result = FAIL;
+	}
+	cpu -> min_vruntime = cpu_min;
+	other -> min_vruntime = other_min;
+	restore_flags(flags);
+	return result;
+}
+
+/* int spinlock_test()
+ * Description: Checks that a held spinlock can't be taken again, that it counts its
+ *              acquisitions and that holding it keeps preemption off until it is released,
+ *              then prints the statistics of every lock
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Prints to the screen
+ * Expected outcome: Pass
+ */
+int spinlock_test() {
+	TEST_HEADER;
+	static spinlock_t lock; /* Lock under test, static since it joins the statistics list */
+	uint32_t flags; /* Saved EFLAGS */
+	uint32_t depth; /* preempt_count before taking it */
+	int32_t result = PASS;
+	cli_and_save(flags);
+	depth = this_cpu() -> preempt_count;
+	spin_lock_init(&lock, "test");
+	if (!spin_trylock(&lock) || this_cpu() -> preempt_count != depth + 1) {
+		result = FAIL;
+	} else {
+		if (spin_trylock(&lock)) {
+			result = FAIL;
+		}
+		spin_unlock(&lock);
+	}
+	spin_lock(&lock);
+	spin_unlock(&lock);
+	if (lock.locked || lock.acquired != 2 || lock.contended || !lock.registered ||
+	    this_cpu() -> preempt_count != depth) {
+		result = FAIL;
+	}
+	restore_flags(flags);
+	print_lock_stats(); /* Lists "test", "lock_list" and every lock the kernel took so far */
+	return result;
+}
+
+/* int futex_test()
+ * Description: Checks that a word is found through the page tables, that a wait on a word
+ *              that changed returns at once and that a wake with nobody waiting wakes nobody
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  None
+ * Expected outcome: Pass
+ */
+int futex_test() {
+	TEST_HEADER;
+	static uint32_t word = 1; /* Word waited on, in the identity-mapped kernel image */
+	uint32_t key; /* Its physical address */
+	int32_t result = PASS;
+	key = virt_to_phys((uint32_t)page_directory, (uint32_t)&word);
+	if (key != (uint32_t)&word) {
+		result = FAIL;
+	} else if (futex_wait(key, 0) != -1 || futex_wake(key, 1) != 0) {
+		result = FAIL;
+	}
+	return result;
+}
+
+/* int fpu_test()
+ * Description: Checks that saved FPU areas are aligned for fxsave, that SSE is on when the
+ *              processor has it, and that TS is set while nobody owns the registers
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  None
+ * Expected outcome: Pass
+ */
+int fpu_test() {
+	TEST_HEADER;
+	uint32_t regs[4]; /* cpuid leaf 1 */
+	uint32_t cr0;
+	uint32_t cr4;
+	int32_t result = PASS;
+	cpuid(1, regs);
+	asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+	asm volatile ("movl %%cr4, %0" : "=r"(cr4));
+	if (((uint32_t)&get_pcb(1) -> fpu_state & (FXSAVE_ALIGN - 1))) {
+		result = FAIL;
+	}
+	if ((regs[3] & CPUID_EDX_SSE) && (regs[3] & CPUID_EDX_FXSR) && !(cr4 & CR4_OSFXSR)) {
+		result = FAIL;
+	}
+	if (this_cpu() -> fpu_owner == NULL && !(cr0 & CR0_TS)) {
+		result = FAIL;
+	}
+	return result;
+}
+
+/* int softirq_test()
+ * Description: Queues a scancode the way the keyboard top half does and runs the raised
+ *              softirq from irq_exit(). Checks that the key reaches the visible terminal's
+ *              line buffer and that irq_exit() comes back with interrupts off and
+ *              preemption as it was
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Types "a" on the visible terminal, then backspaces over it
+ * Expected outcome: Pass
+ */
+int softirq_test() {
+	TEST_HEADER;
+	uint32_t flags; /* Saved EFLAGS */
+	uint32_t eflags; /* EFLAGS after irq_exit() */
+	uint32_t depth; /* preempt_count before */
+	int32_t idx; /* Line buffer index before the key */
+	term_t* t; /* Visible terminal */
+	int32_t result = PASS;
+	cli_and_save(flags);
+	t = &term[visible_terminal];
+	idx = t -> buf_idx;
+	depth = this_cpu() -> preempt_count;
+	if (idx >= MAX_BUF - 1 || keyboard_queue(SCAN_A)) {
+		restore_flags(flags);
+		return FAIL; /* No room for the key */
+	}
+	raise_softirq(KEYBOARD_SOFTIRQ);
+	irq_exit();
+	asm volatile ("pushfl; popl %0" : "=r"(eflags));
+	if ((eflags & IF_FLAG) || this_cpu() -> in_softirq || this_cpu() -> preempt_count != depth) {
+		result = FAIL;
+	}
+	if (t -> buf_idx != idx + 1 || (t -> line_buff[idx] | 0x20) != 'a' || t -> line_buff[idx + 1] != NEW_LINE) {
+		result = FAIL;
+	}
+	if (t -> buf_idx > idx && !keyboard_queue(SCAN_BACKSPACE)) {
+		raise_softirq(KEYBOARD_SOFTIRQ);
+		irq_exit();
+	}
+	if (t -> buf_idx != idx) {
+		result = FAIL;
+	}
+	restore_flags(flags);
+	return result;
+}
+
+static uint32_t irq_stack_test_esp; /* Stack pointer irq_stack_test_func() ran with */
+
+/* void irq_stack_test_func()
+ * Description: Handler body of irq_stack_test, records its stack pointer
+ * Inputs: None
+ * Outputs: None
+ * Returned Value: None
+ * Side Effect:  Sets irq_stack_test_esp
+ */
+static void irq_stack_test_func(void) {
+	asm volatile ("movl %%esp, %0" : "=r"(irq_stack_test_esp));
+}
+
+/* int irq_stack_test()
+ * Description: Checks that handler bodies run on the processor's interrupt stack and that
+ *              double faults go through a task gate to their own TSS
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  None
+ * Expected outcome: Pass
+ */
+int irq_stack_test() {
+	TEST_HEADER;
+	uint32_t flags; /* Saved EFLAGS */
+	cpu_t* cpu; /* This processor */
+	int32_t result = PASS;
+	cli_and_save(flags);
+	cpu = this_cpu();
+	irq_call(irq_stack_test_func);
+	if (!cpu -> irq_stack || cpu -> irq_depth ||
+	    irq_stack_test_esp >= cpu -> irq_stack || irq_stack_test_esp < cpu -> irq_stack - IRQ_STACK_SIZE) {
+		result = FAIL;
+	}
+	restore_flags(flags);
+	if (idt[DOUBLE_FAULT_INDEX].seg_selector != DOUBLE_FAULT_TSS || !idt[DOUBLE_FAULT_INDEX].present ||
+	    idt[DOUBLE_FAULT_INDEX].size || !idt[DOUBLE_FAULT_INDEX].reserved3) { /* Task gate, not interrupt gate */
+		result = FAIL;
+	}
+	return result;
+}
+
+/* int div_u64_test()
+ * Description: Checks the 64-bit by 32-bit division used for vruntime, with a quotient
+ *              that needs both halves and one that fits in the low half
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  None
+ * Expected outcome: Pass
+ */
+int div_u64_test() {
+	TEST_HEADER;
+	int32_t result = PASS;
+	if (div_u64_u32(0x300000006ULL, 3) != 0x100000002ULL ||
+	    div_u64_u32((uint64_t)0xFFFFFFFF * NICE_0_WEIGHT, 15) != 0x4444444400ULL) {
+		result = FAIL;
+	}
+	return result;
+}
+
+#define SWITCH_BENCH_ROUNDS 1000 /* Round trips timed by switch_bench_test */
+#define SWITCH_BENCH_STACK 256 /* Words of stack for the benchmark partner */
+
+static pcb_t bench_main; /* Context of the test while switched out */
+static pcb_t bench_partner; /* Kernel-only task that switches straight back */
+static uint32_t bench_stack[SWITCH_BENCH_STACK]; /* Its stack */
+static volatile uint32_t bench_visits; /* Times the partner ran */
+
+/* void bench_partner_loop()
+ * Description: Body of the benchmark partner: counts a visit and switches back, forever
+ * Inputs: None
+ * Outputs: None
+ * Side Effect:  Increments bench_visits
+ */
+static void bench_partner_loop() {
+	while (1) {
+		bench_visits++;
+		switch_to(&bench_partner, &bench_main);
+	}
+}
+
+/* int switch_bench_test()
+ * Description: Times round trips through switch_to() against a kernel-only partner task
+ *              that keeps the address space and the TSS, and prints the cycles per round trip
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Prints the cost of a round trip
+ * Expected outcome: Pass
+ */
+int switch_bench_test() {
+	TEST_HEADER;
+	uint32_t flags; /* Saved EFLAGS */
+	uint32_t round; /* Round trips done */
+	uint64_t start; /* TSC before the first round trip */
+	uint32_t cycles; /* TSC cycles for all of them */
+	cli_and_save(flags);
+	bench_visits = 0;
+	memset(&bench_partner.context, 0, sizeof(task_context_t)); /* cr3 and esp0 0: keep both */
+	bench_stack[SWITCH_BENCH_STACK - 1] = 0; /* Return address bench_partner_loop never uses */
+	bench_partner.context.esp = (uint32_t)&bench_stack[SWITCH_BENCH_STACK - 1];
+	bench_partner.context.eip = (uint32_t)bench_partner_loop;
+	bench_partner.context.eflags = KERNEL_EFLAGS;
+	start = rdtsc();
+	for (round = 0; round < SWITCH_BENCH_ROUNDS; round++) {
+		switch_to(&bench_main, &bench_partner);
+	}
+	cycles = (uint32_t)(rdtsc() - start);
+	restore_flags(flags);
+	printf("switch_to round trip: %u cycles\n", cycles / SWITCH_BENCH_ROUNDS);
+	return (bench_visits == SWITCH_BENCH_ROUNDS) ? PASS : FAIL;
+}
+
+static volatile uint32_t timer_test_fired; /* Times timer_test_function ran */
+
+/* void timer_test_function()
+ * Description: Timer function for timer_wheel_test: counts its calls
+ * Inputs: uint32_t data (Unused)
+ * Outputs: None
+ * Side Effect:  Increments timer_test_fired
+ */
+static void timer_test_function(uint32_t data) {
+	timer_test_fired++;
+}
+
+/* int timer_wheel_test()
+ * Description: Arms timers on the first level and on two higher levels, cancels the far ones,
+ *              and checks a timer that is already due fires on the next run_timers()
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Reprograms the PIT
+ * Expected outcome: Pass
+ */
+int timer_wheel_test() {
+	TEST_HEADER;
+	timer_list_t due; /* Fires right away */
+	timer_list_t near; /* Second level */
+	timer_list_t far; /* Third level */
+	uint32_t flags; /* Saved EFLAGS */
+	int32_t result = PASS;
+	timer_test_fired = 0;
+	init_timer(&due, timer_test_function, 0);
+	init_timer(&near, timer_test_function, 0);
+	init_timer(&far, timer_test_function, 0);
+	add_timer(&due, 0);
+	add_timer(&near, TVR_SIZE * 2);
+	add_timer(&far, TVR_SIZE * TVN_SIZE * 2);
+	if (!timer_pending(&due) || !timer_pending(&near) || !timer_pending(&far)) {
+		result = FAIL;
+	}
+	del_timer(&near);
+	del_timer(&far);
+	if (timer_pending(&near) || timer_pending(&far)) {
+		result = FAIL;
+	}
+	cli_and_save(flags);
+	run_timers();
+	restore_flags(flags);
+	if (timer_pending(&due) || timer_test_fired != 1) {
+		result = FAIL;
+	}
+	del_timer(&due);
+	return result;
+}
+
+
+/* Tests that need the scheduler. They block, or wait for other tasks to run, so they run in
+ * the "tests" kernel thread once cpu_idle() has started scheduling */
+
+/* int wait_for_count()
+ * Description: Sleeps a jiffy at a time until a counter the tasks under test bump reaches
+ *              a target. Sleeping, not yielding, lets the other processors run them too
+ * Inputs: volatile uint32_t* count (Counter), uint32_t target (Value waited for)
+ * Outputs: None
+ * Returned Value: PASS once reached, FAIL after TASK_TEST_TIMEOUT jiffies
+ * Side Effect:  Blocks the caller
+ */
+static int wait_for_count(volatile uint32_t* count, uint32_t target) {
+	uint32_t waited; /* Jiffies slept so far */
+	for (waited = 0; *count < target; waited++) {
+		if (waited == TASK_TEST_TIMEOUT) {
+			return FAIL;
+		}
+		timer_sleep(1);
+	}
+	return PASS;
+}
+
+static wait_queue_t sleeper_queue; /* Queue start_sleepers()'s kernel threads block on */
+static pcb_t* sleeper_tasks[SLEEPER_TASKS_MAX]; /* The sleepers, by index */
+static uint32_t sleeper_order[SLEEPER_TASKS_MAX]; /* Their indices, in the order they went to sleep */
+static void (*sleeper_prepare)(uint32_t idx); /* Run by each sleeper before it sleeps, or NULL */
+static void (*sleeper_woken)(uint32_t idx); /* Run by each sleeper once woken, or NULL */
+static volatile uint32_t sleepers_asleep; /* Sleepers that reached sleep_on() */
+static volatile uint32_t sleepers_go; /* Condition the sleepers wait for */
+static volatile uint32_t sleepers_done; /* Sleepers that saw the condition and finished */
+
+/* void test_sleeper()
+ * Description: Kernel thread started by start_sleepers(). Runs sleeper_prepare, records its
+ *              place in line and sleeps until sleepers_go is set, re-checking it with
+ *              interrupts off like every sleeper does, then runs sleeper_woken
+ * Inputs: uint32_t data (Its index)
+ * Outputs: None
+ * Returned Value: None
+ * Side Effect:  Exits when done
+ */
+static void test_sleeper(uint32_t data) {
+	uint32_t flags; /* Saved EFLAGS */
+	cli_and_save(flags);
+	sleeper_tasks[data] = get_active_pcb();
+	if (sleeper_prepare) {
+		sleeper_prepare(data);
+	}
+	sleeper_order[sleepers_asleep++] = data;
+	while (!sleepers_go) {
+		sleep_on(&sleeper_queue);
+	}
+	if (sleeper_woken) {
+		sleeper_woken(data);
+	}
+	sleepers_done++;
+	restore_flags(flags);
+}
+
+/* int start_sleepers()
+ * Description: Starts kernel threads that sleep on sleeper_queue until release_sleepers(),
+ *              and waits until every one is asleep
+ * Inputs: uint32_t count (Threads, at most SLEEPER_TASKS_MAX), void (*prepare)(uint32_t),
+ *         void (*woken)(uint32_t) (Hooks run by each thread, or NULL), const char* name
+ * Outputs: None
+ * Returned Value: PASS once they all sleep, FAIL otherwise
+ * Side Effect:  Starts kernel threads. Blocks the caller
+ */
+static int start_sleepers(uint32_t count, void (*prepare)(uint32_t), void (*woken)(uint32_t), const char* name) {
+	uint32_t idx;
+	sleepers_asleep = 0;
+	sleepers_go = 0;
+	sleepers_done = 0;
+	sleeper_prepare = prepare;
+	sleeper_woken = woken;
+	for (idx = 0; idx < count; idx++) {
+		if (kthread_create(test_sleeper, idx, name) == -1) {
+			return FAIL;
+		}
+	}
+	return wait_for_count(&sleepers_asleep, count); /* On a failure they stay asleep for good */
+}
+
+/* void release_sleepers()
+ * Description: Sets the condition start_sleepers()'s threads wait for and wakes them
+ * Inputs: None
+ * Outputs: None
+ * Returned Value: None
+ * Side Effect:  Makes the sleepers runnable. Called with interrupts off
+ */
+static void release_sleepers() {
+	sleepers_go = 1;
+	wake_up(&sleeper_queue);
+}
+
+/* int wait_queue_test()
+ * Description: Puts kernel threads to sleep on a wait queue and checks that they sit on it in
+ *              the order they went to sleep, that wake_up() empties it and makes every one
+ *              runnable, and that every one then runs past its sleep
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Starts and waits for WQ_TEST_TASKS kernel threads
+ * Expected outcome: Pass
+ */
+int wait_queue_test() {
+	TEST_HEADER;
+	pcb_t* sleeper; /* Entry of the queue being checked */
+	uint32_t idx;
+	uint32_t flags; /* Saved EFLAGS */
+	int32_t result = PASS;
+	if (start_sleepers(WQ_TEST_TASKS, NULL, NULL, "wq_test") == FAIL) {
+		return FAIL;
+	}
+	cli_and_save(flags);
+	sleeper = sleeper_queue.head;
+	for (idx = 0; idx < WQ_TEST_TASKS; idx++) {
+		if (sleeper != sleeper_tasks[sleeper_order[idx]] || sleeper -> state != TASK_SLEEPING) {
+			result = FAIL;
+			break;
+		}
+		sleeper = sleeper -> wait_next;
+	}
+	if (sleeper_queue.tail != sleeper_tasks[sleeper_order[WQ_TEST_TASKS - 1]]) {
+		result = FAIL;
+	}
+	release_sleepers();
+	if (sleeper_queue.head != NULL || sleeper_queue.tail != NULL) {
+		result = FAIL;
+	}
+	for (idx = 0; idx < WQ_TEST_TASKS; idx++) {
+		if (sleeper_tasks[idx] -> state != TASK_RUNNABLE) {
+			result = FAIL;
+		}
+	}
+	restore_flags(flags);
+	if (wait_for_count(&sleepers_done, WQ_TEST_TASKS) == FAIL) {
+		result = FAIL;
+	}
+	return result;
+}
+
+static uint32_t pick_test_order[PICK_TEST_TASKS]; /* Indices of pick_order_test's tasks, in the order they ran */
+
+/* void pick_test_woken()
+ * Description: Woken hook of pick_order_test's sleepers, records that the task ran
+ * Inputs: uint32_t data (Its index)
+ * Outputs: None
+ * Returned Value: None
+ * Side Effect:  Fills pick_test_order
+ */
+static void pick_test_woken(uint32_t data) {
+	pick_test_order[sleepers_done] = data;
+}
+
+/* int pick_order_test()
+ * Description: Gives sleeping kernel threads vruntimes a millisecond apart, in an order
+ *              unrelated to their queueing order, wakes them together and checks that they
+ *              run smallest vruntime first
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Starts and waits for PICK_TEST_TASKS kernel threads
+ * Expected outcome: Pass
+ */
+int pick_order_test() {
+	TEST_HEADER;
+	static const uint32_t rank[PICK_TEST_TASKS] = {2, 0, 3, 1}; /* Place of each task in the vruntime order */
+	uint64_t base; /* vruntime of the first task to run */
+	uint32_t idx;
+	uint32_t flags; /* Saved EFLAGS */
+	int32_t result = PASS;
+	if (start_sleepers(PICK_TEST_TASKS, NULL, pick_test_woken, "pick_test") == FAIL) {
+		return FAIL;
+	}
+	cli_and_save(flags);
+	base = this_cpu() -> min_vruntime + (uint64_t)SCHED_LATENCY_MS * tsc_khz; /* Clear of the wake-up floor */
+	for (idx = 0; idx < PICK_TEST_TASKS; idx++) {
+		sleeper_tasks[idx] -> cpu = this_cpu() -> id; /* Queued here, so no migration rebases it */
+		sleeper_tasks[idx] -> vruntime = base + (uint64_t)rank[idx] * tsc_khz;
+	}
+	release_sleepers();
+	restore_flags(flags);
+	if (wait_for_count(&sleepers_done, PICK_TEST_TASKS) == FAIL) {
+		return FAIL;
+	}
+	for (idx = 0; idx < PICK_TEST_TASKS; idx++) {
+		if (rank[pick_test_order[idx]] != idx) {
+			result = FAIL;
+		}
+	}
+	return result;
+}
+
+static uint64_t nice_test_vruntime[NICE_TEST_TASKS]; /* vruntime of nice_weight_test's spinners before spinning */
+static uint64_t nice_test_sum_exec[NICE_TEST_TASKS]; /* Their sum_exec before spinning */
+
+/* void nice_test_spin()
+ * Description: Prepare hook of nice_weight_test's sleepers. Takes the task's nice value,
+ *              records its vruntime and sum_exec and spins a millisecond with interrupts off,
+ *              so sleep_on() charges the whole spin in one update
+ * Inputs: uint32_t data (Its index)
+ * Outputs: None
+ * Returned Value: None
+ * Side Effect:  Changes the task's nice value
+ */
+static void nice_test_spin(uint32_t data) {
+	static const int32_t nice_level[NICE_TEST_TASKS] = {-5, 0, 5}; /* Nice value of each spinner */
+	uint64_t start; /* TSC when the spin began */
+	nice(nice_level[data]);
+	nice_test_vruntime[data] = sleeper_tasks[data] -> vruntime;
+	nice_test_sum_exec[data] = sleeper_tasks[data] -> sum_exec;
+	start = rdtsc();
+	while (rdtsc() - start < tsc_khz);
+}
+
+/* int nice_weight_test()
+ * Description: Runs spinners at nice -5, 0 and 5 and checks that each one's vruntime grew by
+ *              its run time scaled by NICE_0_WEIGHT over its weight: the same at nice 0,
+ *              slower at nice -5 and faster at nice 5
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Starts and waits for NICE_TEST_TASKS kernel threads
+ * Expected outcome: Pass
+ */
+int nice_weight_test() {
+	TEST_HEADER;
+	static const uint32_t weight[NICE_TEST_TASKS] = {3121, NICE_0_WEIGHT, 335}; /* Weights of nice -5, 0 and 5 */
+	uint64_t ran; /* Cycles a spinner was charged */
+	uint64_t aged; /* vruntime it gained */
+	uint32_t idx;
+	uint32_t flags; /* Saved EFLAGS */
+	int32_t result = PASS;
+	if (start_sleepers(NICE_TEST_TASKS, nice_test_spin, NULL, "nice_test") == FAIL) {
+		return FAIL;
+	}
+	cli_and_save(flags);
+	for (idx = 0; idx < NICE_TEST_TASKS; idx++) {
+		ran = sleeper_tasks[idx] -> sum_exec - nice_test_sum_exec[idx];
+		aged = sleeper_tasks[idx] -> vruntime - nice_test_vruntime[idx];
+		if (sleeper_tasks[idx] -> state != TASK_SLEEPING || ran < tsc_khz ||
+		    aged != div_u64_u32(ran * NICE_0_WEIGHT, weight[idx])) {
+			result = FAIL;
+		}
+		if ((weight[idx] > NICE_0_WEIGHT && aged >= ran) || (weight[idx] < NICE_0_WEIGHT && aged <= ran)) {
+			result = FAIL;
+		}
+	}
+	release_sleepers();
+	restore_flags(flags);
+	if (wait_for_count(&sleepers_done, NICE_TEST_TASKS) == FAIL) {
+		result = FAIL;
+	}
+	return result;
+}
+
+/* int wake_boost_test()
+ * Description: Wakes kernel threads that slept long enough to be far behind and checks how
+ *              far behind min_vruntime each one starts: SCHED_WAKE_CREDIT_MS for a
+ *              background terminal, SCHED_VISIBLE_CREDIT_MS for the visible one and
+ *              SCHED_INPUT_CREDIT_MS when woken by input
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Starts and waits for BOOST_TEST_TASKS + 1 kernel threads. May move min_vruntime forward
+ * Expected outcome: Pass
+ */
+int wake_boost_test() {
+	TEST_HEADER;
+	uint64_t min; /* min_vruntime the credits are taken from */
+	uint32_t idx;
+	uint32_t flags; /* Saved EFLAGS */
+	int32_t result = PASS;
+	if (start_sleepers(BOOST_TEST_TASKS, NULL, NULL, "boost_test") == FAIL) {
+		return FAIL;
+	}
+	cli_and_save(flags);
+	min = (uint64_t)2 * SCHED_INPUT_CREDIT_MS * tsc_khz;
+	if (this_cpu() -> min_vruntime < min) { /* Early on, every credit would reach back to 0 */
+		this_cpu() -> min_vruntime = min;
+	}
+	min = this_cpu() -> min_vruntime;
+	for (idx = 0; idx < BOOST_TEST_TASKS; idx++) {
+		sleeper_tasks[idx] -> cpu = this_cpu() -> id; /* Queued here, so no migration rebases it */
+		sleeper_tasks[idx] -> vruntime = 0; /* Slept for ages */
+		sleeper_tasks[idx] -> terminal_id = (visible_terminal + idx) % TERM_NUM;
+	}
+	release_sleepers();
+	if (sleeper_tasks[0] -> vruntime != min - (uint64_t)SCHED_VISIBLE_CREDIT_MS * tsc_khz ||
+	    sleeper_tasks[1] -> vruntime != min - (uint64_t)SCHED_WAKE_CREDIT_MS * tsc_khz) {
+		result = FAIL;
+	}
+	restore_flags(flags);
+	if (wait_for_count(&sleepers_done, BOOST_TEST_TASKS) == FAIL || start_sleepers(1, NULL, NULL, "boost_test") == FAIL) {
+		return FAIL;
+	}
+	cli_and_save(flags);
+	min = this_cpu() -> min_vruntime;
+	sleeper_tasks[0] -> cpu = this_cpu() -> id;
+	sleeper_tasks[0] -> vruntime = 0;
+	sleeper_tasks[0] -> terminal_id = (visible_terminal + 1) % TERM_NUM;
+	sleepers_go = 1;
+	wake_up_input(&sleeper_queue);
+	if (sleeper_tasks[0] -> vruntime != min - (uint64_t)SCHED_INPUT_CREDIT_MS * tsc_khz) {
+		result = FAIL;
+	}
+	restore_flags(flags);
+	if (wait_for_count(&sleepers_done, 1) == FAIL) {
+		result = FAIL;
+	}
+	return result;
+}
+
+static volatile uint32_t yield_test_ran; /* Peers of yield_test that have run */
+
+/* void yield_test_peer()
+ * Description: Kernel thread of yield_test, records that it ran
+ * Inputs: uint32_t data (Unused)
+ * Outputs: None
+ * Returned Value: None
+ * Side Effect:  Exits
+ */
+static void yield_test_peer(uint32_t data) {
+	yield_test_ran++;
+}
+
+/* int yield_test()
+ * Description: Queues peers level with the running test, yields with interrupts off and checks
+ *              that the test was moved past them: every peer ran before yield() came back, the
+ *              test's vruntime ended up above theirs and the switch counted as voluntary
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Starts YIELD_TEST_PEERS kernel threads
+ * Expected outcome: Pass
+ */
+int yield_test() {
+	TEST_HEADER;
+	task_stat_t before; /* Switch counts before yielding */
+	task_stat_t after; /* Same, after */
+	uint64_t peer_vruntime; /* Largest vruntime a peer was queued with */
+	int32_t pid; /* Peer started */
+	uint32_t idx;
+	uint32_t flags; /* Saved EFLAGS */
+	pcb_t* cur_pcb; /* The test thread */
+	int32_t result = PASS;
+	cur_pcb = get_active_pcb();
+	yield_test_ran = 0;
+	peer_vruntime = 0;
+	/* cli keeps a tick off this processor. The other processors only steal with the kernel
+	 * lock, which the test holds and the switch hands to the peers, so they run here */
+	cli_and_save(flags);
+	for (idx = 0; idx < YIELD_TEST_PEERS; idx++) {
+		pid = kthread_create(yield_test_peer, 0, "yield_test");
+		if (pid == -1) {
+			restore_flags(flags);
+			return FAIL;
+		}
+		if (get_pcb(pid) -> vruntime > peer_vruntime) {
+			peer_vruntime = get_pcb(pid) -> vruntime;
+		}
+	}
+	get_task_stat(cur_pcb, &before);
+	yield();
+	get_task_stat(cur_pcb, &after);
+	if (yield_test_ran != YIELD_TEST_PEERS || cur_pcb -> vruntime <= peer_vruntime ||
+	    after.nvcsw != before.nvcsw + 1 || after.nivcsw != before.nivcsw) {
+		result = FAIL;
+	}
+	restore_flags(flags);
+	return result;
+}
+
+static uint32_t futex_test_words[FUTEX_BUCKETS + 1]; /* More words than buckets, two must collide */
+static volatile uint32_t futex_test_asleep; /* Waiters about to call futex_wait() */
+static uint32_t* futex_test_word[2]; /* Word each waiter waits on */
+static volatile uint32_t futex_test_done[2]; /* Set by each waiter once it is through */
+static int32_t futex_test_ret[2]; /* What futex_wait() returned to each waiter */
+
+/* uint32_t futex_test_hash()
+ * Description: Bucket futex.c hashes a key to
+ * Inputs: uint32_t key (Physical address of a word)
+ * Outputs: None
+ * Returned Value: Bucket index
+ * Side Effect:  None
+ */
+static uint32_t futex_test_hash(uint32_t key) {
+	return ((key >> 2) * FUTEX_HASH_MULT) >> (32 - FUTEX_HASH_BITS);
+}
+
+/* void futex_test_waiter()
+ * Description: Kernel thread of futex_handoff_test. Waits on its word while it holds 0, like
+ *              a user lock waiter does, and records what futex_wait() returned
+ * Inputs: uint32_t data (Waiter number, 0 or 1)
+ * Outputs: None
+ * Returned Value: None
+ * Side Effect:  Exits when done
+ */
+static void futex_test_waiter(uint32_t data) {
+	uint32_t flags; /* Saved EFLAGS */
+	volatile uint32_t* word; /* Word waited on */
+	word = futex_test_word[data];
+	cli_and_save(flags); /* Counted only once it can't be preempted before queueing */
+	futex_test_asleep++;
+	while (*word == 0) {
+		futex_test_ret[data] = futex_wait((uint32_t)word, 0);
+	}
+	futex_test_done[data] = 1;
+	restore_flags(flags);
+}
+
+/* int futex_handoff_test()
+ * Description: Puts two kernel threads to sleep on two words hashed to the same bucket, the
+ *              first thread on the first word. A wake on the second word must skip the
+ *              first waiter and wake the second only; a second wake then finds nobody.
+ *              Changing the first word and waking it then hands over to the first waiter
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Starts and waits for two kernel threads
+ * Expected outcome: Pass
+ */
+int futex_handoff_test() {
+	TEST_HEADER;
+	uint32_t first; /* Index of a word */
+	uint32_t second; /* Index of a later word */
+	int32_t result = PASS;
+	futex_test_word[0] = NULL;
+	for (first = 0; first < FUTEX_BUCKETS && !futex_test_word[0]; first++) {
+		for (second = first + 1; second <= FUTEX_BUCKETS; second++) {
+			if (futex_test_hash((uint32_t)&futex_test_words[first]) ==
+			    futex_test_hash((uint32_t)&futex_test_words[second])) {
+				futex_test_word[0] = &futex_test_words[first];
+				futex_test_word[1] = &futex_test_words[second];
+				break;
+			}
+		}
+	}
+	if (!futex_test_word[0] || virt_to_phys((uint32_t)page_directory, (uint32_t)futex_test_word[0]) !=
+	    (uint32_t)futex_test_word[0]) { /* Keys are physical, the same in the kernel image */
+		return FAIL;
+	}
+	*futex_test_word[0] = 0;
+	*futex_test_word[1] = 0;
+	futex_test_asleep = 0;
+	futex_test_done[0] = 0;
+	futex_test_done[1] = 0;
+	if (kthread_create(futex_test_waiter, 0, "futex_test") == -1 ||
+	    wait_for_count(&futex_test_asleep, 1) == FAIL) {
+		return FAIL;
+	}
+	if (kthread_create(futex_test_waiter, 1, "futex_test") == -1 ||
+	    wait_for_count(&futex_test_asleep, 2) == FAIL) {
+		return FAIL;
+	}
+	*futex_test_word[1] = 1;
+	if (futex_wake((uint32_t)futex_test_word[1], 1) != 1 ||
+	    wait_for_count(&futex_test_done[1], 1) == FAIL || futex_test_ret[1] != 0) {
+		result = FAIL;
+	}
+	if (futex_test_done[0] || futex_wake((uint32_t)futex_test_word[1], 1) != 0) {
+		result = FAIL;
+	}
+	*futex_test_word[0] = 1;
+	if (futex_wake((uint32_t)futex_test_word[0], 1) != 1 ||
+	    wait_for_count(&futex_test_done[0], 1) == FAIL || futex_test_ret[0] != 0) {
+		result = FAIL;
+	}
+	return result;
+}
+
+static volatile uint32_t workqueue_test_runs; /* Times workqueue_test_func() ran */
+
+/* void workqueue_test_func()
+ * Description: Work item of workqueue_test, counts its runs
+ * Inputs: work_struct_t* work (The item)
+ * Outputs: None
+ * Returned Value: None
+ * Side Effect:  Increments workqueue_test_runs
+ */
+static void workqueue_test_func(work_struct_t* work) {
+	workqueue_test_runs++;
+}
+
+/* int workqueue_test()
+ * Description: Checks that the "events" thread is a kernel-only task, that an item already
+ *              pending is not queued a second time, and that the worker then runs it once
+ *              and clears pending, so it can be queued again
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Waits for the "events" thread
+ * Expected outcome: Pass
+ */
+int workqueue_test() {
+	TEST_HEADER;
+	static work_struct_t work; /* Item under test, outlives the test if the worker is late */
+	pcb_t* worker; /* The "events" thread */
+	uint32_t flags; /* Saved EFLAGS */
+	int32_t result = PASS;
+	worker = get_pcb(system_wq.worker_pid);
+	if (worker == NULL || worker -> page_dir != NO_FRAME || worker -> context.esp0 != 0) {
+		result = FAIL;
+	}
+	workqueue_test_runs = 0;
+	init_work(&work, workqueue_test_func);
+	cli_and_save(flags); /* Not preempted, so the worker can't take the item in between */
+	if (queue_work(&system_wq, &work) != 1 || schedule_work(&work) != 0 || !work.pending) {
+		result = FAIL;
+	}
+	restore_flags(flags);
+	if (wait_for_count(&workqueue_test_runs, 1) == FAIL) {
+		return FAIL;
+	}
+	timer_sleep(1); /* A second, wrong run would show up by now */
+	if (workqueue_test_runs != 1 || work.pending) {
+		result = FAIL;
+	}
+	if (schedule_work(&work) != 1 || wait_for_count(&workqueue_test_runs, 2) == FAIL) {
+		result = FAIL;
+	}
+	return result;
+}
+
+/* int timer_cascade_test()
+ * Description: Arms a timer past the first level of the wheel and lets it fire, so it gets
+ *              cascaded down before it runs. Checks it doesn't run early
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Waits for the timer
+ * Expected outcome: Pass
+ */
+int timer_cascade_test() {
+	TEST_HEADER;
+	timer_list_t timer; /* Second level at first */
+	uint32_t start; /* Jiffy it was armed at */
+	int32_t result = PASS;
+	timer_test_fired = 0;
+	init_timer(&timer, timer_test_function, 0);
+	start = jiffies_now();
+	add_timer(&timer, TVR_SIZE + TVR_SIZE / 2);
+	if (wait_for_count(&timer_test_fired, 1) == FAIL) {
+		del_timer(&timer); /* It lives on our stack */
+		return FAIL;
+	}
+	if (timer_pending(&timer) || jiffies_now() - start < TVR_SIZE + TVR_SIZE / 2) {
+		result = FAIL;
+	}
+	return result;
+}
+
+/* Code of thread_test's user threads: thread_exit(arg) */
+static const uint8_t thread_test_code[] = {
+	0x8B, 0x5C, 0x24, 0x04,		/* movl 4(%esp), %ebx */
+	0xB8, 0x15, 0x00, 0x00, 0x00,	/* movl $21, %eax */
+	0xCD, 0x80			/* int $0x80 */
+};
+
+/* uint32_t lend_address_space()
+ * Description: Gives the running kernel thread an empty address space of its own, so it can
+ *              fault user pages in and start user threads like a process's main thread
+ * Inputs: None
+ * Outputs: None
+ * Returned Value: The page directory, or NO_FRAME when memory ran out
+ * Side Effect:  Switches the running thread to the new address space
+ */
+static uint32_t lend_address_space() {
+	pcb_t* cur_pcb; /* Running kernel thread */
+	uint32_t page_dir; /* Address space lent to it */
+	uint32_t flags; /* Saved EFLAGS */
+	cur_pcb = get_active_pcb();
+	page_dir = create_page_dir();
+	if (page_dir == NO_FRAME) {
+		return NO_FRAME;
+	}
+	cli_and_save(flags); /* cr3 and the saved one must agree when we get switched out */
+	cur_pcb -> page_dir = page_dir;
+	cur_pcb -> context.cr3 = page_dir;
+	load_page_dir(page_dir);
+	restore_flags(flags);
+	return page_dir;
+}
+
+/* void end_address_space()
+ * Description: Takes back an address space lent by lend_address_space() and frees it
+ * Inputs: uint32_t page_dir (The address space), uint32_t image_end (Running thread's own)
+ * Outputs: None
+ * Returned Value: None
+ * Side Effect:  Switches the running thread back to the boot page directory
+ */
+static void end_address_space(uint32_t page_dir, uint32_t image_end) {
+	pcb_t* cur_pcb; /* Running kernel thread */
+	uint32_t flags; /* Saved EFLAGS */
+	cur_pcb = get_active_pcb();
+	cur_pcb -> image_end = image_end;
+	cli_and_save(flags);
+	cur_pcb -> page_dir = NO_FRAME;
+	cur_pcb -> context.cr3 = (uint32_t)page_directory;
+	destroy_page_dir(page_dir); /* Loads the kernel's back */
+	restore_flags(flags);
+}
+
+/* uint32_t lend_test_program()
+ * Description: Same as lend_address_space(), with a one-page program in it. The code is at
+ *              the start of the page, the rest is bss for the threads' stacks
+ * Inputs: const uint8_t* code, uint32_t len (Program, at most a page)
+ * Outputs: None
+ * Returned Value: The page directory, or NO_FRAME when memory ran out
+ * Side Effect:  Switches the running thread to the new address space
+ */
+static uint32_t lend_test_program(const uint8_t* code, uint32_t len) {
+	uint32_t page_dir; /* Address space lent */
+	page_dir = lend_address_space();
+	if (page_dir == NO_FRAME) {
+		return NO_FRAME;
+	}
+	if (map_zeroed_page(page_dir, PROGRAM_IMG_ADDRESS) == -1) {
+		end_address_space(page_dir, get_active_pcb() -> image_end);
+		return NO_FRAME;
+	}
+	get_active_pcb() -> image_end = PROGRAM_IMG_ADDRESS + PAGE_SIZE_4KB;
+	memcpy((void*)PROGRAM_IMG_ADDRESS, code, len);
+	return page_dir;
+}
+
+/* int demand_paging_test()
+ * Description: Lends this thread an empty address space over the "ls" executable and touches
+ *              its first image page and a stack page well below the top. Checks the image
+ *              page is read from the file as a major fault, and the stack page comes zeroed
+ *              and writable as a minor one
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Temporarily runs this thread on a new address space
+ * Expected outcome: Pass
+ */
+int demand_paging_test() {
+	TEST_HEADER;
+	static uint8_t file_bytes[DEMAND_TEST_BYTES]; /* Start of the file, read directly */
+	pcb_t* cur_pcb; /* The "tests" thread */
+	dentry_t dentry; /* The executable */
+	uint32_t page_dir; /* Address space lent */
+	uint32_t image_inode; /* The thread's own image fields, put back at the end */
+	uint32_t image_len;
+	uint32_t image_end;
+	uint32_t maj_flt; /* Fault counts before touching */
+	uint32_t min_flt;
+	volatile uint32_t* stack_word; /* Word two pages below the top of the stack */
+	uint32_t idx;
+	int32_t result = PASS;
+	cur_pcb = get_active_pcb();
+	if (read_dentry_by_name("ls", &dentry) == FS_FAILURE ||
+	    read_data(dentry.inode_num, 0, (char*)file_bytes, DEMAND_TEST_BYTES) != DEMAND_TEST_BYTES) {
+		return FAIL;
+	}
+	image_inode = cur_pcb -> image_inode;
+	image_len = cur_pcb -> image_len;
+	image_end = cur_pcb -> image_end;
+	page_dir = lend_address_space();
+	if (page_dir == NO_FRAME) {
+		return FAIL;
+	}
+	cur_pcb -> image_inode = dentry.inode_num;
+	cur_pcb -> image_len = fs_inode_length(dentry.inode_num);
+	cur_pcb -> image_end = PROGRAM_IMG_ADDRESS + cur_pcb -> image_len;
+	maj_flt = cur_pcb -> maj_flt;
+	min_flt = cur_pcb -> min_flt;
+	for (idx = 0; idx < DEMAND_TEST_BYTES; idx++) { /* The first read faults the page in */
+		if (((volatile uint8_t*)PROGRAM_IMG_ADDRESS)[idx] != file_bytes[idx]) {
+			result = FAIL;
+		}
+	}
+	if (cur_pcb -> maj_flt != maj_flt + 1 || cur_pcb -> min_flt != min_flt) {
+		result = FAIL;
+	}
+	stack_word = (volatile uint32_t*)(USER_STACK_ADDRESS - 2 * PAGE_SIZE_4KB - sizeof(uint32_t));
+	if (*stack_word != 0) {
+		result = FAIL;
+	}
+	*stack_word = DEMAND_TEST_MAGIC;
+	if (*stack_word != DEMAND_TEST_MAGIC || cur_pcb -> min_flt != min_flt + 1 || cur_pcb -> maj_flt != maj_flt + 1) {
+		result = FAIL;
+	}
+	cur_pcb -> image_inode = image_inode;
+	cur_pcb -> image_len = image_len;
+	end_address_space(page_dir, image_end);
+	return result;
+}
+
+/* int thread_test()
+ * Description: Lends this thread a one-page program, starts user threads in it with
+ *              thread_create(), and checks that thread_join() returns the status each one
+ *              handed to thread_exit(), that the process is back to no threads, and that a
+ *              joined thread can't be joined again
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Waits for the threads. Temporarily runs this thread on a new address space
+ * Expected outcome: Pass
+ */
+int thread_test() {
+	TEST_HEADER;
+	pcb_t* cur_pcb; /* The "tests" thread, main thread of the threads started */
+	uint32_t page_dir; /* Address space lent to it */
+	uint32_t image_end; /* Its own image_end, put back at the end */
+	int32_t tid[THREAD_TEST_COUNT]; /* Threads started */
+	int32_t i;
+	int32_t result = PASS;
+	cur_pcb = get_active_pcb();
+	image_end = cur_pcb -> image_end;
+	page_dir = lend_test_program(thread_test_code, sizeof(thread_test_code));
+	if (page_dir == NO_FRAME) {
+		return FAIL;
+	}
+	for (i = 0; i < THREAD_TEST_COUNT; i++) { /* One stack per thread */
+		tid[i] = thread_create((void*)PROGRAM_IMG_ADDRESS, (void*)(i + 1),
+		                       (void*)(cur_pcb -> image_end - i * (PAGE_SIZE_4KB / (2 * THREAD_TEST_COUNT))));
+		if (tid[i] == -1) {
+			result = FAIL;
+		}
+	}
+	if (thread_create((void*)PROGRAM_IMG_ADDRESS, 0, (void*)USER_HEAP_LIMIT) != -1) { /* Stack outside user memory */
+		result = FAIL;
+	}
+	for (i = 0; i < THREAD_TEST_COUNT; i++) { /* Each status is its argument */
+		if (tid[i] != -1 && thread_join(tid[i]) != i + 1) {
+			result = FAIL;
+		}
+	}
+	if (cur_pcb -> nr_threads != 0 || thread_join(cur_pcb -> cur_pid) != -1) {
+		result = FAIL;
+	}
+	for (i = 0; i < THREAD_TEST_COUNT; i++) {
+		if (tid[i] != -1 && (get_pcb(tid[i]) -> existent || thread_join(tid[i]) != -1)) {
+			result = FAIL;
+		}
+	}
+	end_address_space(page_dir, image_end);
+	return result;
+}
+
+/* Code of thread_kill_test's user thread: sleep(THREAD_KILL_SLEEP_S), then thread_exit() */
+static const uint8_t thread_kill_code[] = {
+	0xB8, 0x0F, 0x00, 0x00, 0x00,			/* movl $15, %eax */
+	0xBB, THREAD_KILL_SLEEP_S, 0x00, 0x00, 0x00,	/* movl $THREAD_KILL_SLEEP_S, %ebx */
+	0xCD, 0x80,					/* int $0x80 */
+	0x89, 0xC3,					/* movl %eax, %ebx */
+	0xB8, 0x15, 0x00, 0x00, 0x00,			/* movl $21, %eax */
+	0xCD, 0x80					/* int $0x80 */
+};
+static volatile int32_t thread_kill_tid; /* Thread started by thread_kill_leader() */
+static volatile uint32_t thread_kill_asleep; /* Set when it slept as the leader halted */
+static volatile uint32_t thread_kill_ready; /* Set just before the leader halts */
+
+/* void thread_kill_leader()
+ * Description: Main thread of thread_kill_test's process: lends itself a program, starts a
+ *              thread that sleeps in it, and halts once the thread is asleep
+ * Inputs: uint32_t data (Unused)
+ * Outputs: None
+ * Returned Value: None (does not return)
+ * Side Effect:  Sets thread_kill_tid, thread_kill_asleep and thread_kill_ready
+ */
+static void thread_kill_leader(uint32_t data) {
+	int32_t tid; /* The thread */
+	uint32_t waited; /* Jiffies waited for it to sleep */
+	tid = INVALID_PID;
+	if (lend_test_program(thread_kill_code, sizeof(thread_kill_code)) != NO_FRAME) {
+		tid = thread_create((void*)PROGRAM_IMG_ADDRESS, 0, (void*)get_active_pcb() -> image_end);
+	}
+	for (waited = 0; tid != INVALID_PID && waited < TASK_TEST_TIMEOUT &&
+	     get_pcb(tid) -> state != TASK_SLEEPING; waited++) {
+		timer_sleep(1);
+	}
+	cli(); /* Nothing changes until halt() */
+	thread_kill_tid = tid;
+	thread_kill_asleep = (tid != INVALID_PID && get_pcb(tid) -> state == TASK_SLEEPING);
+	thread_kill_ready = 1;
+	halt(0);
+}
+
+/* int thread_kill_test()
+ * Description: Halts the main thread of a process while another of its threads sleeps in a
+ *              syscall. Checks the thread is woken and exits, which leaves the process no
+ *              threads and frees it: both pids and its address space
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Starts a kernel thread and waits for it and its thread to be freed
+ * Expected outcome: Pass
+ */
+int thread_kill_test() {
+	TEST_HEADER;
+	int32_t leader; /* Main thread of the process */
+	pcb_t* thread; /* Its other thread */
+	uint32_t waited; /* Jiffies waited for both to be freed */
+	thread_kill_tid = INVALID_PID;
+	thread_kill_asleep = 0;
+	thread_kill_ready = 0;
+	leader = kthread_create(thread_kill_leader, 0, "thread_kill");
+	if (leader == -1 || wait_for_count(&thread_kill_ready, 1) == FAIL) {
+		return FAIL;
+	}
+	if (thread_kill_tid == INVALID_PID || !thread_kill_asleep) {
+		return FAIL;
+	}
+	thread = get_pcb(thread_kill_tid);
+	for (waited = 0; get_pcb(leader) -> existent || thread -> existent; waited++) {
+		if (waited == TASK_TEST_TIMEOUT) { /* Well short of the thread's own sleep */
+			return FAIL;
+		}
+		timer_sleep(1);
+	}
+	if (get_pcb(leader) -> nr_threads != 0 || get_pcb(leader) -> page_dir != NO_FRAME ||
+	    thread -> exit_status != EXCEPTION_IDX) {
+		return FAIL;
+	}
+	return PASS;
+}
+
+/* Code of task_stat_test's user threads: spins in user mode for arg TSC cycles, then thread_exit(0) */
+static const uint8_t acct_test_code[] = {
+	0x8B, 0x5C, 0x24, 0x04,		/* movl 4(%esp), %ebx */
+	0x0F, 0x31,			/* rdtsc */
+	0x89, 0xC6,			/* movl %eax, %esi */
+	0x0F, 0x31,			/* 1: rdtsc */
+	0x29, 0xF0,			/* subl %esi, %eax */
+	0x39, 0xD8,			/* cmpl %ebx, %eax */
+	0x72, 0xF8,			/* jb 1b */
+	0x31, 0xDB,			/* xorl %ebx, %ebx */
+	0xB8, 0x15, 0x00, 0x00, 0x00,	/* movl $21, %eax */
+	0xCD, 0x80			/* int $0x80 */
+};
+
+/* int task_stat_test()
+ * Description: Checks the accounting of real tasks. This thread spins in the kernel and
+ *              sleeps: its system time grows by at least the spin, its user time doesn't and
+ *              the sleep counts as a voluntary switch. Then more user threads than processors
+ *              spin in user mode: each is charged user time, and some get preempted
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Waits for the threads. Temporarily runs this thread on a new address space
+ * Expected outcome: Pass
+ */
+int task_stat_test() {
+	TEST_HEADER;
+	pcb_t* cur_pcb; /* The "tests" thread */
+	task_stat_t before; /* Its accounting before the spin */
+	task_stat_t after; /* And after the spin and the sleep */
+	uint64_t start; /* TSC when the spin began */
+	uint32_t page_dir; /* Address space lent to it */
+	uint32_t image_end; /* Its own image_end, put back at the end */
+	int32_t tid[ACCT_TEST_THREADS]; /* User threads started */
+	uint32_t nivcsw; /* Preemptions of all of them */
+	uint32_t waited; /* Jiffies waited for a thread */
+	uint32_t flags; /* Saved EFLAGS */
+	int32_t i;
+	int32_t result = PASS;
+	cur_pcb = get_active_pcb();
+	get_task_stat(cur_pcb, &before);
+	cli_and_save(flags);
+	start = rdtsc();
+	while (rdtsc() - start < (uint64_t)ACCT_TEST_MS * tsc_khz);
+	restore_flags(flags);
+	timer_sleep(1);
+	get_task_stat(cur_pcb, &after);
+	if (after.stime - before.stime < (uint64_t)ACCT_TEST_MS * tsc_khz || after.utime != before.utime ||
+	    after.nvcsw <= before.nvcsw) {
+		result = FAIL;
+	}
+	image_end = cur_pcb -> image_end;
+	page_dir = lend_test_program(acct_test_code, sizeof(acct_test_code));
+	if (page_dir == NO_FRAME) {
+		return FAIL;
+	}
+	for (i = 0; i < ACCT_TEST_THREADS; i++) { /* One stack per thread */
+		tid[i] = thread_create((void*)PROGRAM_IMG_ADDRESS, (void*)(ACCT_TEST_SPIN_MS * tsc_khz),
+		                       (void*)(cur_pcb -> image_end - i * (PAGE_SIZE_4KB / (2 * ACCT_TEST_THREADS))));
+		if (tid[i] == -1) {
+			result = FAIL;
+		}
+	}
+	nivcsw = 0;
+	for (i = 0; i < ACCT_TEST_THREADS; i++) {
+		if (tid[i] == -1) {
+			continue;
+		}
+		for (waited = 0; get_pcb(tid[i]) -> state != TASK_ZOMBIE && waited < TASK_TEST_TIMEOUT; waited++) {
+			timer_sleep(1);
+		}
+		get_task_stat(get_pcb(tid[i]), &after); /* Still there until joined */
+		if (after.utime == 0) {
+			result = FAIL;
+		}
+		nivcsw += after.nivcsw;
+		if (thread_join(tid[i]) != 0) {
+			result = FAIL;
+		}
+	}
+	if (nivcsw == 0) {
+		result = FAIL;
+	}
+	end_address_space(page_dir, image_end);
+	return result;
+}
+
+static volatile uint32_t fpu_test_failed; /* Checks fpu_test_task() got wrong */
+static volatile uint32_t fpu_test_done; /* fpu_test_task() threads that finished */
+
+/* void fpu_test_task()
+ * Description: Kernel thread of fpu_switch_test. Loads a value of its own into st(0) and
+ *              xmm0, then sleeps a jiffy at a time so the other one runs in between. After
+ *              each sleep the registers must not be loaded yet, and once they are they must
+ *              still hold its value
+ * Inputs: uint32_t data (Its index)
+ * Outputs: None
+ * Returned Value: None
+ * Side Effect:  Counts wrong checks in fpu_test_failed. Exits when done
+ */
+static void fpu_test_task(uint32_t data) {
+	uint32_t value; /* Value it loads */
+	uint32_t x87; /* st(0) read back */
+	uint32_t xmm; /* xmm0 read back */
+	uint32_t cr0;
+	uint32_t flags; /* Saved EFLAGS */
+	uint32_t round;
+	value = FPU_TEST_VALUE + data;
+	asm volatile ("fildl %0" : : "m"(value)); /* First use: #NM hands it the registers */
+	asm volatile ("movss %0, %%xmm0" : : "m"(value));
+	if (!get_active_pcb() -> used_math) {
+		fpu_test_failed++;
+	}
+	for (round = 0; round < FPU_TEST_ROUNDS; round++) {
+		timer_sleep(1);
+		cli_and_save(flags); /* Stay on this processor while looking at it */
+		asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+		if (this_cpu() -> fpu_owner != NULL || !(cr0 & CR0_TS)) { /* Saved and released when we slept */
+			fpu_test_failed++;
+		}
+		restore_flags(flags);
+		asm volatile ("fistl %0" : "=m"(x87));
+		asm volatile ("movss %%xmm0, %0" : "=m"(xmm));
+		if (x87 != value || xmm != value || this_cpu() -> fpu_owner != get_active_pcb()) {
+			fpu_test_failed++;
+		}
+	}
+	asm volatile ("fstp %st(0)"); /* Leave the x87 stack empty */
+	fpu_test_done++;
+}
+
+/* int fpu_switch_test()
+ * Description: Runs two kernel threads that keep different values in the x87 and SSE
+ *              registers and take turns on the processor, and checks each one gets its own
+ *              values back every time
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success, also when the processor has no SSE
+ * Side Effect:  Starts and waits for FPU_TEST_TASKS kernel threads
+ * Expected outcome: Pass
+ */
+int fpu_switch_test() {
+	TEST_HEADER;
+	uint32_t regs[4]; /* cpuid leaf 1 */
+	uint32_t idx;
+	cpuid(1, regs);
+	if (!(regs[3] & CPUID_EDX_SSE) || !(regs[3] & CPUID_EDX_FXSR)) {
+		return PASS; /* The registers are off limits, there is nothing to switch */
+	}
+	fpu_test_failed = 0;
+	fpu_test_done = 0;
+	for (idx = 0; idx < FPU_TEST_TASKS; idx++) {
+		if (kthread_create(fpu_test_task, idx, "fpu_test") == -1) {
+			return FAIL;
+		}
+	}
+	if (wait_for_count(&fpu_test_done, FPU_TEST_TASKS) == FAIL || fpu_test_failed) {
+		return FAIL;
+	}
+	return PASS;
+}
+
+/* int idle_stat_test()
+ * Description: Sleeps IDLE_TEST_MS with nothing else to run and checks the idle time grew by
+ *              at least half of that, and never by more than the time that went by on every
+ *              processor
+ * Inputs: None
+ * Outputs: Test result. Pass/ Fail
+ * Returned Value: PASS upon success
+ * Side Effect:  Blocks the caller
+ * Expected outcome: Pass
+ */
+int idle_stat_test() {
+	TEST_HEADER;
+	idle_stat_t before; /* Accounting before the sleep */
+	idle_stat_t after; /* And after */
+	uint64_t idle; /* Idle cycles in between */
+	get_idle_stat(&before);
+	timer_sleep(IDLE_TEST_MS / TIMER_TICK_MS);
+	get_idle_stat(&after);
+	idle = after.idle_cycles - before.idle_cycles;
+	if (after.tsc_khz == 0 || idle < (uint64_t)IDLE_TEST_MS / 2 * after.tsc_khz ||
+	    idle > after.total_cycles - before.total_cycles) {
+		return FAIL;
+	}
+	return PASS;
+}
+
+/* void launch_task_tests()
+ * Description: Body of the "tests" kernel thread, runs the tests that need the scheduler
+ * Inputs: uint32_t data (Unused)
+ * Outputs: None
+ * Returned Value: None
+ * Side Effect:  The thread exits when they are done
+ */
+static void launch_task_tests(uint32_t data) {
+	TEST_OUTPUT("wait_queue_test", wait_queue_test());
+	TEST_OUTPUT("pick_order_test", pick_order_test());
+	TEST_OUTPUT("nice_weight_test", nice_weight_test());
+	TEST_OUTPUT("wake_boost_test", wake_boost_test());
+	TEST_OUTPUT("yield_test", yield_test());
+	TEST_OUTPUT("futex_handoff_test", futex_handoff_test());
+	TEST_OUTPUT("workqueue_test", workqueue_test());
+	TEST_OUTPUT("timer_cascade_test", timer_cascade_test());
+	TEST_OUTPUT("demand_paging_test", demand_paging_test());
+	TEST_OUTPUT("thread_test", thread_test());
+	TEST_OUTPUT("thread_kill_test", thread_kill_test());
+	TEST_OUTPUT("task_stat_test", task_stat_test());
+	TEST_OUTPUT("fpu_switch_test", fpu_switch_test());
+	TEST_OUTPUT("idle_stat_test", idle_stat_test()); /* Last, once the other tests' threads are gone */
+}
+
+/* void start_task_tests()
+ * Description: Queues the "tests" kernel thread. It runs once cpu_idle() starts scheduling
+ * Inputs: None
+ * Outputs: None
+ * Returned Value: None
+ * Side Effect:  Takes a pid
+ */
+void start_task_tests() {
+	kthread_create(launch_task_tests, 0, "tests");
+}
 
 /* Test suite entry point */
 void launch_tests(){
 	TEST_OUTPUT("idt_test", idt_test());
+	TEST_OUTPUT("pid_allocator_test", pid_allocator_test());
+	TEST_OUTPUT("idmap_boundary_test", idmap_boundary_test());
+	TEST_OUTPUT("fd_table_grow_test", fd_table_grow_test());
+	TEST_OUTPUT("frame_allocator_test", frame_allocator_test());
+	TEST_OUTPUT("div_u64_test", div_u64_test());
+	TEST_OUTPUT("tick_device_test", tick_device_test());
+	TEST_OUTPUT("ioapic_redir_test", ioapic_redir_test());
+	TEST_OUTPUT("smp_test", smp_test());
+	TEST_OUTPUT("migrate_vruntime_test", migrate_vruntime_test());
+	TEST_OUTPUT("spinlock_test", spinlock_test());
+	TEST_OUTPUT("futex_test", futex_test());
+	TEST_OUTPUT("fpu_test", fpu_test());
+	TEST_OUTPUT("softirq_test", softirq_test());
+	TEST_OUTPUT("irq_stack_test", irq_stack_test());
+	TEST_OUTPUT("switch_bench_test", switch_bench_test());
+	TEST_OUTPUT("timer_wheel_test", timer_wheel_test());
 	// launch your tests here
 	clear();
 	reset_cursor();
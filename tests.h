@@ -3,5 +3,7 @@
 
 // test launcher
 void launch_tests();
+// queues the tests that need the scheduler, run in a kernel thread
+void start_task_tests();
 
 #endif /* TESTS_H */
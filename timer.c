@@ -0,0 +1,338 @@
+#include "timer.h"
+#include "pit.h"
+#include "scheduler.h"
+
+/* Hierarchical timer wheel. The first level has a slot per jiffy for the next TVR_SIZE jiffies;
+ * each higher level has TVN_SIZE slots, each as long as the whole level below. Adding or
+ * deleting a timer is a list operation on one slot. When the first level wraps, the current
+ * slot of the next level is cascaded down. A tick only looks at one slot, however many timers
+ * are pending. */
+static timer_list_t tv1[TVR_SIZE]; /* List heads of the first level */
+static timer_list_t tvn[TVN_LEVELS][TVN_SIZE]; /* List heads of the higher levels */
+static uint32_t tv1_bitmap[TV1_WORDS]; /* Bit set marks a non-empty first-level slot */
+static uint32_t timer_jiffies; /* Next jiffy the wheel has to process */
+static uint32_t nr_timers; /* Timers pending */
+static uint64_t timer_base; /* TSC at jiffy 0 */
+tick_jump_table_t* tick_device = &pit_tick_jmptable; /* Source of timer interrupts */
+
+/* void list_init()
+ * Description: Makes a slot list head point to itself.
+ * Inputs: timer_list_t* head
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+static void list_init(timer_list_t* head) {
+    head -> next = head;
+    head -> prev = head;
+}
+
+/* void timer_init()
+ * Description: Empties the wheel and starts the jiffy clock. Needs the TSC calibrated by pit_init().
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+void timer_init() {
+    uint32_t slot;
+    uint32_t level;
+    for (slot = 0; slot < TVR_SIZE; slot++) {
+        list_init(&tv1[slot]);
+    }
+    for (level = 0; level < TVN_LEVELS; level++) {
+        for (slot = 0; slot < TVN_SIZE; slot++) {
+            list_init(&tvn[level][slot]);
+        }
+    }
+    timer_base = rdtsc();
+    timer_jiffies = 0;
+    nr_timers = 0;
+}
+
+/* uint32_t jiffies_now()
+ * Description: Reads the time since timer_init() from the TSC.
+ * Inputs: None
+ * Output: None
+ * Returned Value: Current time in jiffies
+ * Side Effects: None
+ */
+uint32_t jiffies_now() {
+    return (uint32_t)div_u64_u32(rdtsc() - timer_base, tsc_khz * TIMER_TICK_MS);
+}
+
+/* void internal_add_timer()
+ * Description: Puts a timer in the slot of the wheel its expiry falls into. Expiries already
+ *              passed go to the slot processed next.
+ * Inputs: timer_list_t* timer (Timer with expires set)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off.
+ */
+static void internal_add_timer(timer_list_t* timer) {
+    uint32_t expires; /* Expiry of the timer */
+    uint32_t delta; /* Jiffies until then */
+    uint32_t level; /* Higher level holding it */
+    uint32_t shift; /* Bits below the level's slot index */
+    timer_list_t* head; /* Slot list */
+    expires = timer -> expires;
+    delta = expires - timer_jiffies;
+    if ((int32_t)delta < 0) { /* Late, run it with the next slot */
+        expires = timer_jiffies;
+        delta = 0;
+    }
+    if (delta < TVR_SIZE) {
+        head = &tv1[expires & TVR_MASK];
+        tv1_bitmap[(expires & TVR_MASK) / IDMAP_WORD_BITS] |= 1 << (expires % IDMAP_WORD_BITS);
+    } else {
+        shift = TVR_BITS;
+        for (level = 0; level < TVN_LEVELS - 1; level++) { /* The last level takes the rest */
+            if (delta < (1U << (shift + TVN_BITS))) {
+                break;
+            }
+            shift += TVN_BITS;
+        }
+        head = &tvn[level][(expires >> shift) & TVN_MASK];
+    }
+    timer -> next = head; /* Append */
+    timer -> prev = head -> prev;
+    head -> prev -> next = timer;
+    head -> prev = timer;
+}
+
+/* void detach_timer()
+ * Description: Unlinks a timer from its slot, clearing the slot's bit once it is empty.
+ * Inputs: timer_list_t* timer (Pending timer)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off.
+ */
+static void detach_timer(timer_list_t* timer) {
+    timer_list_t* head; /* The slot, if the timer was alone in it */
+    timer -> prev -> next = timer -> next;
+    timer -> next -> prev = timer -> prev;
+    head = timer -> next;
+    if (head -> next == head && head >= tv1 && head < tv1 + TVR_SIZE) { /* First-level slot now empty */
+        tv1_bitmap[(head - tv1) / IDMAP_WORD_BITS] &= ~(1 << ((head - tv1) % IDMAP_WORD_BITS));
+    }
+    timer -> next = NULL;
+    timer -> prev = NULL;
+}
+
+/* void init_timer()
+ * Description: Prepares a timer before its first add_timer().
+ * Inputs: timer_list_t* timer, void (*function)(uint32_t) (Called on expiry with interrupts off),
+ *         uint32_t data (Passed to function)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+void init_timer(timer_list_t* timer, void (*function)(uint32_t), uint32_t data) {
+    timer -> next = NULL;
+    timer -> prev = NULL;
+    timer -> function = function;
+    timer -> data = data;
+}
+
+/* uint32_t timer_pending()
+ * Description: Tells whether a timer is armed and has not fired yet.
+ * Inputs: timer_list_t* timer
+ * Output: None
+ * Returned Value: 1 if pending, 0 otherwise
+ * Side Effects: None
+ */
+uint32_t timer_pending(timer_list_t* timer) {
+    return timer -> next != NULL;
+}
+
+/* uint32_t count_until()
+ * Description: Converts the time until a jiffy into PIT input cycles, for the one-shot.
+ * Inputs: uint32_t expires (Target jiffy)
+ * Output: None
+ * Returned Value: PIT input cycles, at least 1 and at most PIT_MAX_COUNT
+ * Side Effects: None
+ */
+static uint32_t count_until(uint32_t expires) {
+    int32_t delta; /* Jiffies left */
+    delta = (int32_t)(expires - jiffies_now());
+    if (delta <= 0) {
+        return 1;
+    }
+    if (delta > PIT_MAX_COUNT / (PIT_COUNTS_PER_MS * TIMER_TICK_MS)) { /* The handler re-arms for the rest */
+        return PIT_MAX_COUNT;
+    }
+    return delta * PIT_COUNTS_PER_MS * TIMER_TICK_MS;
+}
+
+/* void add_timer()
+ * Description: Arms a timer to call its function after a number of jiffies. Takes constant
+ *              time. The timer interrupt is brought forward if it would come too late.
+ * Inputs: timer_list_t* timer (Initialized and not pending), uint32_t timeout (Jiffies from now)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: May reprogram the tick device.
+ */
+void add_timer(timer_list_t* timer, uint32_t timeout) {
+    uint32_t flags; /* Saved EFLAGS */
+    uint32_t now; /* Current jiffy */
+    cli_and_save(flags);
+    if (timeout > MAX_TIMEOUT) {
+        timeout = MAX_TIMEOUT;
+    }
+    now = jiffies_now();
+    if (!nr_timers) { /* run_timers() didn't run while idle, don't make it walk the gap */
+        timer_jiffies = now;
+    }
+    timer -> expires = now + timeout;
+    internal_add_timer(timer);
+    nr_timers++;
+    tick_device -> arm_before(count_until(timer -> expires));
+    restore_flags(flags);
+}
+
+/* void del_timer()
+ * Description: Cancels a timer if it is still pending. Takes constant time.
+ * Inputs: timer_list_t* timer
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+void del_timer(timer_list_t* timer) {
+    uint32_t flags; /* Saved EFLAGS */
+    cli_and_save(flags);
+    if (timer_pending(timer)) {
+        detach_timer(timer);
+        nr_timers--;
+    }
+    restore_flags(flags);
+}
+
+/* void cascade()
+ * Description: Moves the timers of one higher-level slot down to the levels below.
+ * Inputs: uint32_t level, uint32_t slot
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Called with interrupts off.
+ */
+static void cascade(uint32_t level, uint32_t slot) {
+    timer_list_t* head; /* Slot being emptied */
+    timer_list_t* timer; /* Timer being moved */
+    head = &tvn[level][slot];
+    while (head -> next != head) {
+        timer = head -> next;
+        detach_timer(timer);
+        internal_add_timer(timer);
+    }
+}
+
+/* void run_timers()
+ * Description: Processes every jiffy up to now: cascades the higher levels when the first one
+ *              wraps and calls the function of each expired timer. With nothing pending, the
+ *              wheel just jumps to now.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Calls timer functions. Called from the timer interrupt with interrupts off.
+ */
+void run_timers() {
+    uint32_t now; /* Current jiffy */
+    uint32_t slot; /* First-level slot being processed */
+    uint32_t level; /* Higher level being cascaded */
+    uint32_t shift; /* Bits below its slot index */
+    uint32_t index; /* Its slot */
+    timer_list_t* timer; /* Expired timer */
+    now = jiffies_now();
+    while ((int32_t)(now - timer_jiffies) >= 0) {
+        if (!nr_timers) { /* Tickless idle: nothing to catch up on */
+            timer_jiffies = now + 1;
+            break;
+        }
+        slot = timer_jiffies & TVR_MASK;
+        if (!slot) { /* First level wrapped: bring down the next slot of each level that wrapped too */
+            shift = TVR_BITS;
+            for (level = 0; level < TVN_LEVELS; level++) {
+                index = (timer_jiffies >> shift) & TVN_MASK;
+                cascade(level, index);
+                if (index) {
+                    break;
+                }
+                shift += TVN_BITS;
+            }
+        }
+        timer_jiffies++;
+        while (tv1[slot].next != &tv1[slot]) {
+            timer = tv1[slot].next;
+            detach_timer(timer);
+            nr_timers--;
+            timer -> function(timer -> data);
+        }
+    }
+}
+
+/* uint32_t timer_next_count()
+ * Description: Finds when the wheel next has work: the next non-empty first-level slot, or the
+ *              next time the first level wraps and cascades, whichever comes first.
+ * Inputs: None
+ * Output: None
+ * Returned Value: PIT input cycles until then, 0 when no timer is pending
+ * Side Effects: None
+ */
+uint32_t timer_next_count() {
+    uint32_t slot; /* First-level slot being checked */
+    uint32_t end; /* Slot where the first level wraps */
+    uint32_t word; /* Its bitmap word */
+    uint32_t bits; /* Bits of that word from slot on */
+    if (!nr_timers) {
+        return 0;
+    }
+    slot = timer_jiffies & TVR_MASK;
+    end = TVR_SIZE;
+    while (slot < end) {
+        word = slot / IDMAP_WORD_BITS;
+        bits = tv1_bitmap[word] & (~0U << (slot % IDMAP_WORD_BITS));
+        if (bits) {
+            slot = word * IDMAP_WORD_BITS + find_first_zero(~bits); /* Lowest set bit */
+            break;
+        }
+        slot = (word + 1) * IDMAP_WORD_BITS;
+    }
+    if (slot > end) {
+        slot = end;
+    }
+    return count_until(timer_jiffies + slot - (timer_jiffies & TVR_MASK));
+}
+
+/* void timer_wake()
+ * Description: Timer function of timer_sleep(): wakes the sleeper.
+ * Inputs: uint32_t data (The sleeper's wait queue)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+static void timer_wake(uint32_t data) {
+    wake_up((wait_queue_t*)data);
+}
+
+/* void timer_sleep()
+ * Description: Puts the running task to sleep for a number of jiffies. It uses no processor
+ *              time until a timer wakes it. A thread killed meanwhile returns early.
+ * Inputs: uint32_t timeout (Jiffies)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Switches to other tasks.
+ */
+void timer_sleep(uint32_t timeout) {
+    uint32_t flags; /* Saved EFLAGS */
+    timer_list_t timer; /* Lives on our kernel stack while we sleep */
+    wait_queue_t queue; /* Only we wait on it */
+    queue.head = NULL;
+    queue.tail = NULL;
+    init_timer(&timer, timer_wake, (uint32_t)&queue);
+    cli_and_save(flags);
+    add_timer(&timer, timeout);
+    while (timer_pending(&timer) && !thread_killed()) {
+        sleep_on(&queue);
+    }
+    del_timer(&timer); /* It lives on our stack */
+    restore_flags(flags);
+}
@@ -0,0 +1,43 @@
+/*
+ * Header File for Kernel Timers
+ */
+
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include "types.h"
+#include "lib.h"
+
+#define TIMER_TICK_MS 1 /* One jiffy */
+#define TVR_BITS 8 /* Slots of the first wheel level, one jiffy apart */
+#define TVN_BITS 6 /* Slots of each higher level */
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVN_LEVELS 4 /* 8 + 4 * 6 bits covers every 32-bit timeout */
+#define TV1_WORDS (TVR_SIZE / IDMAP_WORD_BITS) /* Bitmap words for the first level */
+#define MAX_TIMEOUT 0x7FFFFFFF /* Longest timeout, in jiffies */
+#define NSEC_PER_MSEC 1000000
+#define MSEC_PER_SEC 1000
+
+/* Device giving the timer interrupts: the PIT, or the APIC timer once apic_init() succeeds */
+extern tick_jump_table_t* tick_device;
+
+/* Initializes the timer wheel */
+extern void timer_init(void);
+/* Current time in jiffies */
+extern uint32_t jiffies_now(void);
+/* Arm and cancel timers */
+extern void init_timer(timer_list_t* timer, void (*function)(uint32_t), uint32_t data);
+extern void add_timer(timer_list_t* timer, uint32_t timeout);
+extern void del_timer(timer_list_t* timer);
+extern uint32_t timer_pending(timer_list_t* timer);
+/* Runs the expired timers, from the timer interrupt */
+extern void run_timers(void);
+/* PIT input cycles until the wheel needs to run again, 0 when no timer is pending */
+extern uint32_t timer_next_count(void);
+/* Sleeps the running task for a number of jiffies */
+extern void timer_sleep(uint32_t timeout);
+
+#endif
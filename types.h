@@ -8,13 +8,23 @@
 #define _TYPES_H
 
 #define NULL 0
-#define TASK_MAX_FILES 8  /* Each task can have up to 8 open files. */
+#define FD_CHUNK_SIZE 8  /* Descriptors per fd table chunk; a task starts with one chunk */
 #define MAX_ARG_LENGTH 128 /* Maximum length of argument in command is 128 characters */
 #define MAX_BUF 128
 
+/* What a task is doing, for CPU time accounting; also used from assembly */
+#define ACCT_USER 0 /* Running user code */
+#define ACCT_SYSTEM 1 /* In a syscall or a fault handler */
+#define ACCT_IRQ 2 /* In an interrupt handler */
+
+#define MAX_CPUS 4 /* Processors brought up, the boot one included; also used from assembly */
+
 #ifndef ASM
 
 /* Types defined here just like in <stdint.h> */
+typedef long long int64_t;
+typedef unsigned long long uint64_t;
+
 typedef int int32_t;
 typedef unsigned int uint32_t;
 
@@ -24,6 +34,14 @@ typedef unsigned short uint16_t;
 typedef char int8_t;
 typedef unsigned char uint8_t;
 
+/*--------------------Two-level bitmap for O(1) id allocation-----------*/
+#define IDMAP_WORD_BITS 32 /* Ids tracked by one bitmap word */
+#define IDMAP_WORDS 8 /* Words in a bitmap, so up to 256 ids */
+#define IDMAP_MAX_IDS (IDMAP_WORDS * IDMAP_WORD_BITS) /* Largest number of ids a bitmap can hold */
+typedef struct {
+    uint32_t full; /* Bit w is set when words[w] has no free id left */
+    uint32_t words[IDMAP_WORDS]; /* Bit set marks the id as in use */
+} idmap_t;
 
 /*------------------File Operations jump table--------------------------*/
 typedef struct {
@@ -34,6 +52,23 @@ typedef struct {
     int32_t (*close)(int32_t*);
 } fs_jump_table_t;
 
+/*------------Timer interrupt source jump table (PIT or APIC)------------*/
+typedef struct {
+    /* Delays are in PIT input cycles, whichever device counts them */
+    void (*set_oneshot)(uint32_t);
+    void (*arm_before)(uint32_t);
+    void (*stop)(void);
+    uint32_t (*is_armed)(void);
+} tick_jump_table_t;
+
+/*--------Interrupt controller jump table (8259 PICs or IOAPIC)----------*/
+typedef struct {
+    /* IRQs are ISA numbers, 0 - 15 */
+    void (*enable)(uint32_t);
+    void (*disable)(uint32_t);
+    void (*eoi)(uint32_t);
+} irq_jump_table_t;
+
 /*--------------------Structure stored in the file array----------------*/
 typedef struct {
     fs_jump_table_t* jmp_table; /* File operations table pointer */
@@ -42,22 +77,173 @@ typedef struct {
     uint32_t flags; /* Marking this file desriptor as in-use. */
 } file_arr_struct_t;
 
+/*---------------Growable file descriptor table of a task---------------*/
+#define FD_MAX_CHUNKS (IDMAP_MAX_IDS / FD_CHUNK_SIZE) /* A task can grow to 256 open files */
+typedef struct {
+    file_arr_struct_t* chunks[FD_MAX_CHUNKS]; /* chunks[i] holds descriptors [i * 8, i * 8 + 8), NULL until needed */
+    idmap_t open_map; /* Bit set marks a descriptor as in use */
+    file_arr_struct_t first_chunk[FD_CHUNK_SIZE]; /* Chunk for descriptors 0-7, always present */
+} fd_table_t;
+
+/*-----------------------------Task states------------------------------*/
+#define TASK_RUNNABLE 0 /* Can be picked by the scheduler */
+#define TASK_SLEEPING 1 /* Waiting on a wait queue, skipped by the scheduler */
+#define TASK_DEAD 2 /* Halted, freed by the next task once it is switched away from */
+#define TASK_ZOMBIE 3 /* Exited thread, kept for its exit status until thread_join() reaps it */
+
+/*-------------Kernel context saved by switch_to (task_switch.S)---------*/
+typedef struct {
+    uint32_t ebx; /* Callee-saved registers */
+    uint32_t esi;
+    uint32_t edi;
+    uint32_t ebp;
+    uint32_t esp; /* Kernel stack pointer */
+    uint32_t eip; /* Where the task resumes */
+    uint32_t eflags;
+    uint32_t cr3; /* Page directory, 0 to keep the loaded one (idle task) */
+    uint32_t esp0; /* Kernel stack top for the TSS, 0 if the task never enters user mode */
+} task_context_t;
+
+/*-----------------FPU/SSE registers, as saved by fxsave------------------*/
+#define FXSAVE_AREA_SIZE 512
+#define FXSAVE_ALIGN 16 /* fxsave faults on areas that are not */
+typedef struct {
+    uint8_t bytes[FXSAVE_AREA_SIZE];
+} __attribute__((aligned (FXSAVE_ALIGN))) fpu_state_t;
+
 /*-----------------The Process Control Block----------------------------*/
 typedef struct process_control_block{
-    file_arr_struct_t file_desc_array[TASK_MAX_FILES]; /* The file descriptor array*/
-    uint32_t cur_esp; /* Current esp */
-    uint32_t cur_ebp; /* Current ebp */
+    task_context_t context; /* Kernel context while switched out, must stay first */
+    fd_table_t file_desc_table; /* The file descriptor table */
     uint32_t cur_pid; /* Current pid */
     uint32_t parent_pid;  /* The process id of the parent task */
-    uint32_t parent_esp; /* Save parent esp */
-    uint32_t parent_ebp; /* Save parent ebp */
+    uint32_t child_pid; /* Foreground child being waited for, INVALID_PID if none */
+    int32_t child_status; /* Exit status the child left in halt() */
     uint32_t terminal_id; /* The terminal the process is running on */
     uint32_t override_flag;
     char arg[MAX_ARG_LENGTH + 1]; /* Save current argument */
     uint32_t existent; /* Signify if this pcb is existent */
     uint32_t shell_flag;
+    uint32_t kernel_stack; /* Top of this process's kernel stack */
+    uint32_t page_dir; /* Physical address of this process's page directory */
+    uint32_t brk; /* Program break: end of the heap, pages below it are mapped on first touch */
+    uint32_t image_inode; /* Inode of the executable, image pages are read from it on first touch */
+    uint32_t image_len; /* Length of the executable in bytes */
+    uint32_t image_end; /* End of the loaded segments including bss */
+    uint32_t min_flt; /* Page faults served without I/O (zero fill, stack growth) */
+    uint32_t maj_flt; /* Page faults that read the image from the file system */
+    volatile uint32_t state; /* TASK_RUNNABLE, TASK_SLEEPING or TASK_DEAD */
+    struct process_control_block* wait_next; /* Next sleeper on the same wait queue */
+    struct wait_queue* wait_queue; /* Queue the task sleeps on, NULL while it doesn't */
+    uint32_t background; /* Started with "&": nobody waits for it to halt */
+    int32_t nice; /* NICE_MIN to NICE_MAX, lower gets a bigger share */
+    uint64_t vruntime; /* Cycles run, scaled by the nice weight */
+    uint64_t sum_exec; /* Cycles run */
+    uint64_t exec_start; /* TSC when the task was last charged */
+    uint32_t acct_mode; /* ACCT_USER, ACCT_SYSTEM or ACCT_IRQ */
+    uint64_t utime; /* Cycles in user mode */
+    uint64_t stime; /* Cycles in syscalls and fault handlers */
+    uint64_t irqtime; /* Cycles in interrupt handlers that interrupted the task */
+    uint32_t nvcsw; /* Switches away because the task slept, yielded */
+    uint32_t nivcsw; /* Switches away because the task was preempted */
+    uint32_t lock_depth; /* Nesting of the big kernel lock, held by the processor while above 0 */
+    uint32_t cpu; /* Processor whose run queue the task was last on */
+    struct process_control_block* leader; /* Main thread, which owns the address space, break and files */
+    uint32_t nr_threads; /* Main thread only: threads it started that have not exited yet */
+    int32_t exit_status; /* Status an exited thread left for thread_join() */
+    uint32_t killed; /* Set on the other threads when the main thread exits, they exit at the next safe point */
+    uint32_t used_math; /* Set once the task ran an FPU/SSE instruction, fpu_state is valid from then on */
+    fpu_state_t fpu_state; /* FPU/SSE registers saved by fxsave while the task is switched out */
 } pcb_t;
 
+/*------------------------Scheduler nice values--------------------------*/
+#define NICE_MIN (-20) /* Most urgent nice value */
+#define NICE_MAX 19 /* Least urgent nice value */
+#define SCHED_NUM_PRIO (NICE_MAX - NICE_MIN + 1) /* One load weight per nice value */
+
+/*-----------------Spinlock, with its contention statistics---------------*/
+typedef struct spinlock {
+    volatile uint32_t locked; /* 1 while held */
+    const char* name; /* Shown by print_lock_stats() */
+    struct spinlock* next; /* Next lock print_lock_stats() shows */
+    uint32_t registered; /* Set once on that list, at the first acquisition */
+    uint32_t acquired; /* Times taken */
+    uint32_t contended; /* Times it had to be waited for */
+    uint64_t wait_cycles; /* TSC cycles spent spinning on it */
+    uint64_t hold_cycles; /* TSC cycles it was held */
+    uint64_t max_hold; /* Longest hold, in TSC cycles */
+    uint64_t hold_start; /* TSC when the holder took it */
+} spinlock_t;
+
+/*------------------Queue of tasks waiting for an event------------------*/
+typedef struct wait_queue {
+    pcb_t* head; /* First sleeper, NULL when nobody waits */
+    pcb_t* tail; /* Last sleeper */
+} wait_queue_t;
+
+/*----------------Kernel timer, kept in the timer wheel (timer.c)--------*/
+typedef struct timer_list {
+    struct timer_list* next; /* Neighbours in the wheel slot, NULL when not pending */
+    struct timer_list* prev;
+    uint32_t expires; /* Jiffy the timer fires at */
+    void (*function)(uint32_t data); /* Called on expiry */
+    uint32_t data; /* Argument for function */
+} timer_list_t;
+
+/*------------Deferred work item, run by a workqueue's thread------------*/
+typedef struct work_struct {
+    struct work_struct* next; /* Next item queued on the same workqueue */
+    void (*func)(struct work_struct* work); /* Called from the worker thread */
+    volatile uint32_t pending; /* Queued and not started yet */
+} work_struct_t;
+
+typedef struct {
+    spinlock_t lock; /* Guards the item list */
+    work_struct_t* head; /* Items to run, in submission order */
+    work_struct_t* tail;
+    wait_queue_t more_work; /* The worker sleeps here while the list is empty */
+    int32_t worker_pid; /* Pid of the worker thread */
+} workqueue_t;
+
+/*--------------Task waiting in futex(), kept in a futex bucket----------*/
+typedef struct futex_q {
+    struct futex_q* next; /* Next waiter hashed to the same bucket */
+    uint32_t key; /* Physical address of the word waited on */
+    uint32_t woken; /* Set by futex_wake() when it takes the waiter off the bucket */
+    wait_queue_t queue; /* The waiter sleeps here */
+} futex_q_t;
+
+typedef struct {
+    spinlock_t lock; /* Guards the waiter list */
+    futex_q_t* head; /* Waiters, in arrival order */
+    futex_q_t* tail;
+} futex_bucket_t;
+
+/*---------------------Duration passed to nanosleep()--------------------*/
+typedef struct {
+    uint32_t tv_sec; /* Seconds */
+    uint32_t tv_nsec; /* Nanoseconds, below one second */
+} timespec_t;
+
+/*-------------CPU time of a task, as reported by taskstat()-------------*/
+typedef struct {
+    uint32_t tsc_khz; /* TSC cycles per millisecond */
+    uint32_t nvcsw; /* Voluntary context switches */
+    uint32_t nivcsw; /* Involuntary context switches */
+    uint32_t min_flt; /* Page faults served without I/O */
+    uint32_t maj_flt; /* Page faults that read the file system */
+    uint64_t utime; /* TSC cycles in user mode */
+    uint64_t stime; /* TSC cycles in the kernel on the task's behalf */
+    uint64_t irqtime; /* TSC cycles in interrupt handlers while it ran */
+} task_stat_t;
+
+/*----------------Idle time, as reported by idlestat()------------------*/
+typedef struct {
+    uint32_t tsc_khz; /* TSC cycles per millisecond */
+    uint64_t total_cycles; /* TSC cycles since scheduling started */
+    uint64_t idle_cycles; /* TSC cycles spent halted */
+} idle_stat_t;
+
 /*---------------------------terminal structure-------------------------*/
 typedef struct {
     pcb_t * pcb; /* Active PCB */
@@ -67,16 +253,44 @@ typedef struct {
     uint32_t term_x;
     uint32_t term_y;
     volatile uint8_t enter_flag;
+    wait_queue_t read_queue; /* Tasks in terminal_read waiting for enter */
     volatile uint8_t line_buff[MAX_BUF];
     volatile int32_t buf_idx;
 
     volatile uint8_t flag;
     int32_t vid_mem;
+    spinlock_t lock; /* Line buffer, enter flag and cursor, shared with the keyboard bottom half */
 
 
 }term_t;
 
-volatile uint32_t running_process_id; /* Pid of current running process */
+/*---------------------State kept for each processor----------------------*/
+typedef struct {
+    uint32_t id; /* Index in cpus[] */
+    uint32_t apic_id; /* Local APIC id, for IPIs */
+    volatile uint32_t online; /* Set once the processor runs its idle task */
+    volatile uint32_t running_pid; /* Pid of the process running here, INVALID_PID for the idle task */
+    int32_t running_term; /* Terminal of the last process that ran here */
+    struct tss_t* tss; /* Its task state segment */
+    pcb_t idle_task; /* Boot context of the processor, runs when nothing else can */
+    pcb_t* run_heap[IDMAP_MAX_IDS]; /* Run queue, a min-heap on vruntime, one slot per pid */
+    uint32_t nr_queued; /* Tasks in the run queue */
+    uint32_t queued_weight; /* Sum of their weights */
+    uint64_t min_vruntime; /* Never decreasing floor of the runnable vruntimes */
+    uint64_t sched_start; /* TSC when the idle task started */
+    uint64_t idle_cycles; /* TSC cycles the idle task spent halted */
+    uint64_t halt_start; /* TSC when the idle task halted, 0 while it is awake */
+    uint64_t acct_stamp; /* TSC of the last CPU time accounting event */
+    uint32_t yield_pending; /* The running task gives up the processor on its own */
+    uint32_t preempt_count; /* Spinlocks held here; the running task can't be preempted above 0 */
+    uint32_t need_resched; /* A preemption waits for preempt_count to drop to 0 */
+    uint32_t in_softirq; /* Set while do_softirq() runs here; nested interrupts leave their work to it */
+    uint32_t irq_stack; /* Top of its interrupt stack, 0 until smp_init() gives it one */
+    uint32_t irq_depth; /* Interrupt handlers running here in irq_call(), nested ones included */
+    pcb_t* fpu_owner; /* Task whose registers are loaded in the FPU, NULL while TS is set */
+    volatile uint32_t tick_armed; /* Set while a local APIC timer one-shot is pending */
+    uint64_t tick_deadline; /* TSC when it fires */
+} cpu_t;
 
 #endif /* ASM */
 
@@ -0,0 +1,118 @@
+#include "workqueue.h"
+#include "kthread.h"
+#include "scheduler.h"
+
+/* A workqueue is a list of work items served by one kernel thread. Interrupt handlers and
+ * syscalls queue what doesn't have to be done right away and return; the thread runs the
+ * items later, in order, with interrupts on and as a task the scheduler shares out fairly. */
+workqueue_t system_wq; /* Served by the "events" thread */
+
+/* void worker_thread()
+ * Description: Body of a workqueue's thread. Takes the items off the list one at a time and
+ *              runs them, sleeping while the list is empty.
+ * Inputs: uint32_t data (The workqueue)
+ * Output: None
+ * Returned Value: None (does not return)
+ * Side Effects: Runs the queued items.
+ */
+static void worker_thread(uint32_t data) {
+    workqueue_t* wq; /* Queue served */
+    work_struct_t* work; /* Item being run */
+    uint32_t flags; /* Saved EFLAGS */
+    wq = (workqueue_t*)data;
+    while (1) {
+        spin_lock_irqsave(&wq -> lock, flags);
+        while (!wq -> head) {
+            sleep_on_locked(&wq -> more_work, &wq -> lock);
+        }
+        work = wq -> head;
+        wq -> head = work -> next;
+        if (!wq -> head) {
+            wq -> tail = NULL;
+        }
+        work -> pending = 0; /* It may be queued again while it runs */
+        spin_unlock_irqrestore(&wq -> lock, flags);
+        work -> func(work);
+    }
+}
+
+/* int32_t create_workqueue()
+ * Description: Sets up a workqueue and starts its worker thread.
+ * Inputs: workqueue_t* wq (Queue to set up), const char* name (Name of the thread and lock)
+ * Output: None
+ * Returned Value: 0 upon success, -1 when the thread can't be started
+ * Side Effects: Takes a pid.
+ */
+int32_t create_workqueue(workqueue_t* wq, const char* name) {
+    spin_lock_init(&wq -> lock, name);
+    wq -> head = NULL;
+    wq -> tail = NULL;
+    wq -> more_work.head = NULL;
+    wq -> more_work.tail = NULL;
+    wq -> worker_pid = kthread_create(worker_thread, (uint32_t)wq, name);
+    return (wq -> worker_pid == INVALID_PID) ? -1 : 0;
+}
+
+/* void workqueue_init()
+ * Description: Starts the "events" thread serving system_wq.
+ * Inputs: None
+ * Output: None
+ * Returned Value: None
+ * Side Effects: Takes a pid.
+ */
+void workqueue_init() {
+    create_workqueue(&system_wq, "events");
+}
+
+/* void init_work()
+ * Description: Prepares a work item before its first use.
+ * Inputs: work_struct_t* work (The item), void (*func)(work_struct_t*) (What it runs)
+ * Output: None
+ * Returned Value: None
+ * Side Effects: None
+ */
+void init_work(work_struct_t* work, void (*func)(work_struct_t*)) {
+    work -> next = NULL;
+    work -> func = func;
+    work -> pending = 0;
+}
+
+/* int32_t queue_work()
+ * Description: Queues a work item to run on a workqueue's thread. An item already waiting
+ *              is not queued twice: the run to come covers this request too. Safe from
+ *              interrupt handlers.
+ * Inputs: workqueue_t* wq (The queue), work_struct_t* work (The item)
+ * Output: None
+ * Returned Value: 1 if the item was queued, 0 if it was already pending
+ * Side Effects: Wakes the worker thread.
+ */
+int32_t queue_work(workqueue_t* wq, work_struct_t* work) {
+    uint32_t flags; /* Saved EFLAGS */
+    spin_lock_irqsave(&wq -> lock, flags);
+    if (work -> pending) {
+        spin_unlock_irqrestore(&wq -> lock, flags);
+        return 0;
+    }
+    work -> pending = 1;
+    work -> next = NULL;
+    if (wq -> tail) {
+        wq -> tail -> next = work;
+    } else {
+        wq -> head = work;
+    }
+    wq -> tail = work;
+    wake_up(&wq -> more_work);
+    spin_unlock_irqrestore(&wq -> lock, flags);
+    return 1;
+}
+
+/* int32_t schedule_work()
+ * Description: Queues a work item on system_wq.
+ * Inputs: work_struct_t* work (The item)
+ * Output: None
+ * Returned Value: 1 if the item was queued, 0 if it was already pending
+ * Side Effects: Wakes the "events" thread.
+ */
+int32_t schedule_work(work_struct_t* work) {
+    return queue_work(&system_wq, work);
+}
@@ -0,0 +1,23 @@
+/*
+ * Header File for Workqueues
+ */
+
+#ifndef _WORKQUEUE_H
+#define _WORKQUEUE_H
+
+#include "types.h"
+#include "lib.h"
+
+/* Queue served by the "events" thread, for work without a queue of its own */
+extern workqueue_t system_wq;
+
+/* Starts the "events" thread */
+extern void workqueue_init(void);
+/* Starts a workqueue with its own worker thread */
+extern int32_t create_workqueue(workqueue_t* wq, const char* name);
+/* Submit deferred work */
+extern void init_work(work_struct_t* work, void (*func)(work_struct_t*));
+extern int32_t queue_work(workqueue_t* wq, work_struct_t* work);
+extern int32_t schedule_work(work_struct_t* work);
+
+#endif
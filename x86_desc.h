@@ -21,6 +21,9 @@
 #define USER_DS     0x002B
 #define KERNEL_TSS  0x0030
 #define KERNEL_LDT  0x0038
+#define DOUBLE_FAULT_TSS 0x0040 /* TSS of the double fault task */
+#define AP_TSS_BASE 0x0048 /* TSS of the other processors, one entry each */
+#define TSS_SELECTOR(cpu) ((cpu) ? AP_TSS_BASE + ((cpu) - 1) * 8 : KERNEL_TSS)
 
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE    104
@@ -128,6 +131,8 @@ extern uint32_t ldt;
 
 extern uint32_t tss_size;
 extern seg_desc_t tss_desc_ptr;
+extern seg_desc_t df_tss_desc_ptr;
+extern seg_desc_t ap_tss_desc_ptr[MAX_CPUS - 1];
 extern tss_t tss;
 
 /* Entries of a page directory (switches between 4KB / 4 MB page tables) */
@@ -191,8 +196,9 @@ pde_instance page_directory[NUM_PDE_ENTRIES] __attribute__ ((aligned (PDE_SIZE))
 /* Aligned full page table */
 pte_instance page_table[NUM_PTE_ENTRIES] __attribute__ ((aligned (PTE_SIZE)));
 
-/* Aligned full page table for user vidmap */
-pte_instance user_vidmap_page_table[NUM_PTE_ENTRIES] __attribute__((aligned (PTE_SIZE)));
+/* Aligned full page tables for user vidmap, one per terminal */
+#define VIDMAP_TABLES 3
+pte_instance user_vidmap_page_table[VIDMAP_TABLES][NUM_PTE_ENTRIES] __attribute__((aligned (PTE_SIZE)));
 
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim)                          \